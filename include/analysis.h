@@ -0,0 +1,95 @@
+/**
+ * analysis.h
+ *
+ * Static analysis of MOS 6502 program images: reachable code, maximum stack
+ * depth per subroutine and register values known to be constant.
+ *
+ * Starting from a set of entry points, every subroutine is analysed by a
+ * worklist dataflow pass over its control-flow graph of instructions. The
+ * subroutines called from it are queued as new entry points, so a single
+ * call finds all code reachable without following pointers.
+ */
+
+#ifndef INC_65EMU2_ANALYSIS_H
+#define INC_65EMU2_ANALYSIS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "opcode.h"
+
+#define ANALYSIS_SPACE (UINT16_MAX + 1)
+
+#define DEPTH_UNBOUNDED (-1)
+
+/* Flags of every address in analysis_t.marks */
+#define MARK_IMAGE 0x01                   /* Byte is part of the image */
+#define MARK_CODE  0x02                   /* Byte of a reachable instruction */
+#define MARK_START 0x04                   /* First byte of a reachable instruction */
+#define MARK_ENTRY 0x08                   /* Entry point of a subroutine */
+
+/* Registers in analysis_t.known */
+#define REG_A 0x01
+#define REG_X 0x02
+#define REG_Y 0x04
+
+/* Flags of a subroutine_t */
+#define SUB_RECURSIVE 0x01                /* Calls itself directly or indirectly */
+#define SUB_INDIRECT  0x02                /* Jumps through a pointer, not followed */
+#define SUB_SETS_SP   0x04                /* Loads the stack pointer with TXS */
+#define SUB_STALLS    0x08                /* Reaches an undefined opcode */
+
+typedef struct subroutine_t {
+    uint16_t entry;                       /* Address of the first instruction */
+    uint8_t flags;                        /* Combination of SUB_* flags */
+    int depth;                            /* Bytes pushed at most, including
+                                           * callees, or DEPTH_UNBOUNDED */
+} subroutine_t;
+
+/* Range of image bytes not covered by any reachable instruction */
+typedef struct region_t {
+    uint16_t first;                       /* First address of the region */
+    uint16_t last;                        /* Last address of the region */
+    uint8_t code;                         /* Non-zero if it decodes as code */
+} region_t;
+
+typedef struct analysis_t {
+    uint8_t marks[ANALYSIS_SPACE];        /* MARK_* flags of every address */
+    uint8_t known[ANALYSIS_SPACE];        /* REG_* constant on instruction entry */
+    uint8_t values[ANALYSIS_SPACE][3];    /* Constant values of A, X and Y */
+
+    subroutine_t* subroutines;            /* Subroutines in order of discovery */
+    size_t subroutine_count;
+
+    region_t* regions;                    /* Unreachable regions in address order */
+    size_t region_count;
+} analysis_t;
+
+/**
+ * Analyses the program image in an address space.
+ *
+ * The maximum stack depth of a subroutine is counted from its entry, with
+ * the return address pushed by each nested JSR. Register values are only
+ * propagated within subroutines, so they are unknown at every entry point
+ * and after every JSR.
+ *
+ * @param mem complete address space containing the image
+ * @param load address of the first byte of the image
+ * @param len length of the image in bytes
+ * @param entries addresses where execution may start
+ * @param entry_count number of entry points
+ * @param variant CPU variant to decode the instructions for
+ * @return result of the analysis, or NULL if the allocation failed
+ */
+analysis_t*
+analyze (const uint8_t* mem, uint16_t load, size_t len,
+         const uint16_t* entries, size_t entry_count, const variant_t* variant);
+
+/**
+ * Releases the result of an analysis.
+ *
+ * @param analysis result to be released, may be NULL
+ */
+void
+analysis_free (analysis_t* analysis);
+
+#endif //INC_65EMU2_ANALYSIS_H
@@ -0,0 +1,183 @@
+/**
+ * cache.h
+ *
+ * Content-addressed on-disk cache of preprocessed program images.
+ *
+ * A cache file holds everything the tools derive from an image: the memory
+ * it is loaded into, its reachable instructions predecoded, the basic blocks
+ * over them, the subroutines as symbols and the unreachable regions. Files
+ * are named after a hash of the image and the parameters of the analysis,
+ * and laid out as fixed-size records in the byte order of the host, so a
+ * hit is mapped into memory and used in place.
+ */
+
+#ifndef INC_65EMU2_CACHE_H
+#define INC_65EMU2_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "opcode.h"
+
+#define CACHE_MEMORY_SIZE (UINT16_MAX + 1)
+
+typedef enum CacheSection {
+    SECTION_MEMORY,                       /* Address space with the image loaded */
+    SECTION_INSNS,                        /* cache_insn_t in address order */
+    SECTION_BLOCKS,                       /* cache_block_t in address order */
+    SECTION_SYMBOLS,                      /* cache_symbol_t in address order */
+    SECTION_REGIONS,                      /* cache_region_t in address order */
+    SECTION_COUNT,
+} CacheSection;
+
+typedef struct cache_section_t {
+    uint64_t offset;                      /* Offset from the start of the file */
+    uint64_t count;                       /* Number of records */
+} cache_section_t;
+
+typedef struct cache_header_t {
+    char magic[8];                        /* CACHE_MAGIC */
+    uint32_t version;                     /* Layout version of the file */
+    uint32_t len;                         /* Length of the image in bytes */
+    uint64_t key;                         /* Key the file is named after */
+    uint16_t load;                        /* Load address of the image */
+    uint8_t variant;                      /* CPU variant of the analysis */
+    uint8_t reserved[5];
+    cache_section_t sections[SECTION_COUNT];
+} cache_header_t;
+
+/* Reachable instruction, decoded for the variant of the cache */
+typedef struct cache_insn_t {
+    uint16_t addr;                        /* Address of the opcode byte */
+    uint8_t code;                         /* OpCode */
+    uint8_t mode;                         /* AddressMode */
+    uint8_t length;                       /* Length in bytes */
+    uint8_t marks;                        /* MARK_* flags of the analysis */
+    uint8_t known;                        /* REG_* constant on entry */
+    uint8_t values[3];                    /* Constant values of A, X and Y */
+} cache_insn_t;
+
+/* Straight-line run of instructions entered only at its first one */
+typedef struct cache_block_t {
+    uint16_t addr;                        /* Address of the first instruction */
+    uint16_t reserved;
+    uint32_t first;                       /* Index of its first instruction */
+    uint32_t count;                       /* Number of instructions */
+} cache_block_t;
+
+/* Subroutine found by the analysis */
+typedef struct cache_symbol_t {
+    uint16_t addr;                        /* Entry point */
+    uint8_t flags;                        /* SUB_* flags */
+    uint8_t reserved;
+    int32_t depth;                        /* Maximum stack depth, or DEPTH_UNBOUNDED */
+} cache_symbol_t;
+
+typedef struct cache_region_t {
+    uint16_t first;                       /* First address of the region */
+    uint16_t last;                        /* Last address of the region */
+    uint8_t code;                         /* Non-zero if it decodes as code */
+    uint8_t reserved[3];
+} cache_region_t;
+
+/**
+ * Preprocessed image, either mapped from a cache file or built in memory.
+ * The record arrays point into a single buffer laid out like the file.
+ */
+typedef struct cache_t {
+    uint8_t* base;                        /* Mapped file or allocated buffer */
+    size_t size;                          /* Size of the buffer in bytes */
+    int mapped;                           /* Non-zero if mapped from a file */
+
+    const cache_header_t* header;
+    const uint8_t* memory;
+    const cache_insn_t* insns;
+    size_t insn_count;
+    const cache_block_t* blocks;
+    size_t block_count;
+    const cache_symbol_t* symbols;
+    size_t symbol_count;
+    const cache_region_t* regions;
+    size_t region_count;
+} cache_t;
+
+/**
+ * Computes the key of an image together with the parameters of its analysis.
+ *
+ * @param image contents of the image
+ * @param len length of the image in bytes
+ * @param load load address of the image
+ * @param entries entry points of the analysis
+ * @param entry_count number of entry points
+ * @param variant CPU variant of the analysis
+ * @return key naming the cache file
+ */
+uint64_t
+cache_key (const uint8_t* image, size_t len, uint16_t load,
+           const uint16_t* entries, size_t entry_count, Variant variant);
+
+/**
+ * Returns the cache directory, which is $EMU2_CACHE_DIR if set and
+ * ~/.cache/65emu2 otherwise.
+ *
+ * @param dest buffer for the path
+ * @param size size of the buffer in bytes
+ * @return dest, or NULL if no directory could be determined
+ */
+char*
+cache_default_dir (char* dest, size_t size);
+
+/**
+ * Maps the cache file of a key, checking that it is intact, that all of its
+ * records can be used as they are and that it holds the specified image.
+ *
+ * @param cache destination of the mapped cache
+ * @param dir cache directory
+ * @param key key of the image
+ * @param image contents of the image
+ * @param len length of the image in bytes
+ * @param load load address of the image
+ * @return 0 on a hit, or -1 if there is no usable file
+ */
+int
+cache_open (cache_t* cache, const char* dir, uint64_t key, const uint8_t* image,
+            size_t len, uint16_t load);
+
+/**
+ * Loads and analyses an image, building the cache contents in memory.
+ *
+ * @param cache destination of the built cache
+ * @param key key of the image
+ * @param image contents of the image
+ * @param len length of the image in bytes
+ * @param load load address of the image
+ * @param entries entry points of the analysis
+ * @param entry_count number of entry points
+ * @param variant CPU variant of the analysis
+ * @return 0 on success, or -1 if an allocation failed
+ */
+int
+cache_build (cache_t* cache, uint64_t key, const uint8_t* image, size_t len,
+             uint16_t load, const uint16_t* entries, size_t entry_count,
+             Variant variant);
+
+/**
+ * Writes a built cache to its file in the cache directory, creating the
+ * directory if needed. The file is written under a temporary name and
+ * renamed, so concurrent readers never see a partial file.
+ *
+ * @param cache cache to be written
+ * @param dir cache directory
+ * @return 0 on success, or -1 if the file could not be written
+ */
+int
+cache_store (const cache_t* cache, const char* dir);
+
+/**
+ * Unmaps or frees a cache.
+ *
+ * @param cache cache to be closed, may have been left unset by a failed call
+ */
+void
+cache_close (cache_t* cache);
+
+#endif //INC_65EMU2_CACHE_H
@@ -0,0 +1,229 @@
+/**
+ * core.h
+ *
+ * Internals shared by the instruction-stepped and the cycle-stepped CPU
+ * cores: bus accesses, flag layout and the arithmetic of the ALU.
+ */
+
+#ifndef INC_65EMU2_CORE_H
+#define INC_65EMU2_CORE_H
+
+#include "cpu.h"
+#include "memory.h"
+
+#define STACK_BASE 0x0100
+#define NMI_VECTOR 0xFFFA
+#define IRQ_VECTOR 0xFFFE
+
+#define FLAG_CARRY     0x01
+#define FLAG_ZERO      0x02
+#define FLAG_INTERRUPT 0x04
+#define FLAG_DECIMAL   0x08
+#define FLAG_BREAK     0x10
+#define FLAG_RESERVED  0x20
+#define FLAG_OVERFLOW  0x40
+#define FLAG_NEGATIVE  0x80
+
+/*
+ * Decimal mode arithmetic is split into a low and a high nibble step, each
+ * looked up in a table indexed by the incoming carry and the two operand
+ * nibbles. The low tables hold the low result nibble and the carry (or
+ * borrow) into the high nibble in bit 4. The high tables hold the high
+ * result nibble in the upper four bits and, for ADC, the N, V and C flags
+ * in the lower ones, which the NMOS 6502 derives from intermediate results.
+ */
+#define BCD_CARRY    0x01
+#define BCD_OVERFLOW 0x02
+#define BCD_NEGATIVE 0x04
+
+extern uint8_t adc_low[512];
+extern uint8_t adc_high[512];
+extern uint8_t sbc_low[512];
+extern uint8_t sbc_high[512];
+
+static inline uint8_t
+read_byte (bus_t* bus, uint16_t addr)
+{
+  if (bus->page_flags[addr >> 8] & PAGE_TRAP)
+    return bus_read_trap (bus, addr);
+
+  return bus->pages[addr >> 8][addr & 0xFF];
+}
+
+/* Stores into owned memory pages right away, anything else takes a call */
+static inline void
+write_byte (bus_t* bus, uint16_t addr, uint8_t value)
+{
+  uint8_t const flags = bus->page_flags[addr >> 8];
+
+  if (flags == 0)
+    bus->pages[addr >> 8][addr & 0xFF] = value;
+  else if (flags & PAGE_IO)
+    bus->io_write (addr, value, bus->io_user);
+  else
+    bus_poke (bus, addr, value);
+}
+
+static inline void
+push (cpu_t* state, bus_t* bus, uint8_t value)
+{
+  write_byte (bus, STACK_BASE | state->sp--, value);
+}
+
+static inline uint8_t
+pull (cpu_t* state, bus_t* bus)
+{
+  return read_byte (bus, STACK_BASE | ++state->sp);
+}
+
+static inline void
+set_nz (cpu_t* state, uint8_t value)
+{
+  state->s_negative = value >> 7;
+  state->s_zero = value == 0;
+}
+
+static inline void
+compare (cpu_t* state, uint8_t reg, uint8_t value)
+{
+  state->s_carry = reg >= value;
+  set_nz (state, reg - value);
+}
+
+static inline void
+add_binary (cpu_t* state, uint8_t value)
+{
+  unsigned int sum = state->acc + value + state->s_carry;
+
+  state->s_carry = sum > 0xFF;
+  state->s_overflow = (~(state->acc ^ value) & (state->acc ^ sum) & 0x80) != 0;
+  state->acc = sum;
+  set_nz (state, state->acc);
+}
+
+/* Decimal ADC of the NMOS 6502, where Z follows the binary sum */
+static inline void
+add_decimal (cpu_t* state, uint8_t value)
+{
+  uint8_t const acc = state->acc;
+  uint8_t const low = adc_low[state->s_carry << 8 | (acc & 0x0F) << 4 | (value & 0x0F)];
+  uint8_t const high = adc_high[(low >> 4) << 8 | (acc & 0xF0) | value >> 4];
+
+  state->s_zero = (uint8_t) (acc + value + state->s_carry) == 0;
+  state->s_negative = (high & BCD_NEGATIVE) != 0;
+  state->s_overflow = (high & BCD_OVERFLOW) != 0;
+  state->s_carry = high & BCD_CARRY;
+  state->acc = (high & 0xF0) | (low & 0x0F);
+}
+
+/* Decimal SBC of the NMOS 6502, where all flags follow the binary result */
+static inline void
+subtract_decimal (cpu_t* state, uint8_t value)
+{
+  uint8_t const acc = state->acc;
+  uint8_t const low = sbc_low[state->s_carry << 8 | (acc & 0x0F) << 4 | (value & 0x0F)];
+  uint8_t const high = sbc_high[(low >> 4) << 8 | (acc & 0xF0) | value >> 4];
+
+  add_binary (state, ~value);
+  state->acc = high | (low & 0x0F);
+}
+
+/*
+ * Decimal SBC of the 65C02, which adjusts the whole binary difference rather
+ * than each nibble on its own, so invalid BCD gives other results than on
+ * the NMOS 6502
+ */
+static inline void
+subtract_decimal_cmos (cpu_t* state, uint8_t value)
+{
+  int const borrow = 1 - state->s_carry;
+  int const low = (state->acc & 0x0F) - (value & 0x0F) - borrow;
+  int difference = state->acc - value - borrow;
+
+  if (difference < 0)
+    difference -= 0x60;
+  if (low < 0)
+    difference -= 0x06;
+
+  add_binary (state, ~value);
+  state->acc = difference;
+}
+
+/* ADC in binary or decimal mode, returning any extra clock cycle taken */
+static inline unsigned int
+add (cpu_t* state, uint8_t value)
+{
+  if (!state->s_decimal || !state->variant->decimal) {
+    add_binary (state, value);
+    return 0;
+  }
+
+  add_decimal (state, value);
+  if (!state->variant->cmos)
+    return 0;
+
+  /* The 65C02 takes an extra cycle to set N and Z from the result */
+  set_nz (state, state->acc);
+  return 1;
+}
+
+/* SBC in binary or decimal mode, returning any extra clock cycle taken */
+static inline unsigned int
+subtract (cpu_t* state, uint8_t value)
+{
+  if (!state->s_decimal || !state->variant->decimal) {
+    add_binary (state, ~value);
+    return 0;
+  }
+
+  if (!state->variant->cmos) {
+    subtract_decimal (state, value);
+    return 0;
+  }
+
+  subtract_decimal_cmos (state, value);
+  set_nz (state, state->acc);
+  return 1;
+}
+
+static inline uint8_t
+shift_left (cpu_t* state, uint8_t value)
+{
+  state->s_carry = value >> 7;
+  value <<= 1;
+  set_nz (state, value);
+  return value;
+}
+
+static inline uint8_t
+shift_right (cpu_t* state, uint8_t value)
+{
+  state->s_carry = value & 1;
+  value >>= 1;
+  set_nz (state, value);
+  return value;
+}
+
+static inline uint8_t
+rotate_left (cpu_t* state, uint8_t value)
+{
+  uint8_t const carry = state->s_carry;
+
+  state->s_carry = value >> 7;
+  value = value << 1 | carry;
+  set_nz (state, value);
+  return value;
+}
+
+static inline uint8_t
+rotate_right (cpu_t* state, uint8_t value)
+{
+  uint8_t const carry = state->s_carry;
+
+  state->s_carry = value & 1;
+  value = value >> 1 | carry << 7;
+  set_nz (state, value);
+  return value;
+}
+
+#endif //INC_65EMU2_CORE_H
@@ -9,6 +9,7 @@
 
 #include <inttypes.h>
 #include "memory.h"
+#include "opcode.h"
 
 typedef struct cpu_t {
     uint8_t acc;                          /* Accumulator register A */
@@ -27,9 +28,73 @@ typedef struct cpu_t {
     unsigned int s_interrupt : 1;         /* Interrupt flag */
     unsigned int s_zero      : 1;         /* Zero flag */
     unsigned int s_carry     : 1;         /* Carry flag */
+
+    uint8_t irq;                          /* Interrupt request line asserted */
+    uint8_t nmi;                          /* Non-maskable interrupt pending */
+
+    const variant_t* variant;             /* Dispatch tables of the CPU */
+
+    uint64_t instructions;                /* Instructions executed */
+    uint64_t fused;                       /* Of those, executed in fused sequences */
+    uint64_t interrupts;                  /* Interrupts taken, not counting BRK */
 } cpu_t;
 
+/**
+ * Prepares the lookup tables shared by all CPUs. Must be called before the
+ * first tick(), and may safely be called repeatedly and from several
+ * threads.
+ */
+void
+cpu_init (void);
+
+/**
+ * Executes the instruction at the current program counter, or enters the
+ * interrupt handler if an interrupt is pending and not masked.
+ *
+ * @param state CPU state to be advanced
+ * @param bus address space the CPU is attached to
+ * @return number of clock cycles taken, or 0 if the CPU stalled on an
+ *         undefined opcode
+ */
+unsigned int
+tick (cpu_t* state, bus_t* bus);
+
+/**
+ * Executes like tick(), but runs a whole sequence of instructions at once
+ * if it is one of the idioms dominating hot loops: CLC; ADC #imm, LDA; STA
+ * between immediate, zero page and absolute operands, INX; CPX #imm; BNE
+ * and DEY; BNE. The registers, flags, memory and cycles afterwards are the
+ * same as after stepping through the sequence, and a sequence is only fused
+ * if the caller would run its last instruction anyway.
+ *
+ * @param state CPU state to be advanced
+ * @param bus address space the CPU is attached to
+ * @param budget number of clock cycles the caller is going to run, where
+ *               a new instruction is started as long as some are left
+ * @return number of clock cycles taken, or 0 if the CPU stalled on an
+ *         undefined opcode
+ */
+unsigned int
+tick_fused (cpu_t* state, bus_t* bus, uint64_t budget);
+
+/**
+ * Returns the processor status register packed into a single byte in the
+ * order NV-BDIZC, with the reserved bit always set.
+ *
+ * @param state CPU state to read the flags from
+ * @return packed processor status
+ */
+uint8_t
+cpu_get_status (const cpu_t* state);
+
+/**
+ * Sets the flags of the processor status register from a packed byte in the
+ * order NV-BDIZC.
+ *
+ * @param state CPU state to write the flags to
+ * @param status packed processor status
+ */
 void
-tick (cpu_t* state, mem_t* mem);
+cpu_set_status (cpu_t* state, uint8_t status);
 
 #endif //INC_65EMU2_CPU_H
@@ -0,0 +1,43 @@
+/**
+ * cycle.h
+ *
+ * Cycle-stepped core of the NMOS 6502, which performs exactly one bus access
+ * per call, including the dummy reads on page crossings and the double
+ * writes of read-modify-write instructions. It is meant for peripherals that
+ * depend on the timing of individual accesses, while tick() stays the fast
+ * default.
+ */
+
+#ifndef INC_65EMU2_CYCLE_H
+#define INC_65EMU2_CYCLE_H
+
+#include "cpu.h"
+#include "memory.h"
+
+/**
+ * Progress through the current instruction, which is all the state the core
+ * keeps in addition to the registers so it can be suspended after any cycle.
+ */
+typedef struct cycle_t {
+    uint8_t step;                         /* Next cycle, 0 at an instruction boundary */
+    uint8_t opcode;                       /* Opcode byte being executed */
+    uint8_t data;                         /* Operand or read-modify-write latch */
+    uint16_t vector;                      /* Vector of an interrupt being entered, or 0 */
+    uint16_t addr;                        /* Effective address */
+    uint16_t base;                        /* Address before indexing */
+} cycle_t;
+
+/**
+ * Performs a single clock cycle of the CPU. At an instruction boundary, a
+ * pending interrupt is entered instead of fetching the next opcode. The
+ * variant of the CPU must not be a 65C02, whose bus accesses differ.
+ *
+ * @param state CPU state to be advanced
+ * @param cycle progress through the current instruction, zeroed initially
+ * @param bus address space the CPU is attached to
+ * @return 1, or 0 if the CPU stalled on an undefined opcode
+ */
+unsigned int
+tick_cycle (cpu_t* state, cycle_t* cycle, bus_t* bus);
+
+#endif //INC_65EMU2_CYCLE_H
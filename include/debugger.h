@@ -0,0 +1,30 @@
+/**
+ * debugger.h
+ *
+ * Interactive step debugger in a terminal, showing the registers, the
+ * disassembly around the program counter and views of memory.
+ *
+ * The screen is kept as a grid of cells and only the cells that changed
+ * since the previous frame are sent to the terminal. Continuing and running
+ * to the cursor hand the machine to emu2_run() with breakpoints set, so the
+ * program runs at full speed until it stops or a key is pressed.
+ */
+
+#ifndef INC_65EMU2_DEBUGGER_H
+#define INC_65EMU2_DEBUGGER_H
+
+#include "emu2.h"
+
+/**
+ * Serves a debug session on a terminal until the user quits, leaving the
+ * machine where it stopped.
+ *
+ * @param machine machine to be debugged
+ * @param in descriptor of the terminal to read keys from
+ * @param out descriptor of the terminal to draw on
+ * @return 0 when the user quit, or -1 if the input is no terminal
+ */
+int
+debugger_run (emu2_machine_t* machine, int in, int out);
+
+#endif //INC_65EMU2_DEBUGGER_H
@@ -7,10 +7,31 @@
 #ifndef INC_65EMU2_DIS_ASM_H
 #define INC_65EMU2_DIS_ASM_H
 
-void
-disassemble (const unsigned char* buf, size_t fsize, FILE* dest);
+#include <stdio.h>
+#include <stdint.h>
+#include "opcode.h"
+
+/**
+ * Writes a single instruction in assembler syntax to a stream, without its
+ * address or a line break.
+ *
+ * @param opcode decoded opcode of the instruction
+ * @param code machine code starting with the opcode byte
+ * @param dest stream to write the instruction to
+ * @return length of the instruction in bytes
+ */
+size_t
+disassemble_instruction (const opcode_t* opcode, const uint8_t* code, FILE* dest);
 
-int
-main (int argc, char* argv[]);
+/**
+ * Writes the disassembly of the specified buffer to a stream, one
+ * instruction per line.
+ *
+ * @param buf buffer containing the machine code
+ * @param fsize size of the buffer in bytes
+ * @param dest stream to write the disassembly to
+ */
+void
+disassemble (const uint8_t* buf, size_t fsize, FILE* dest);
 
 #endif //INC_65EMU2_DIS_ASM_H
@@ -0,0 +1,503 @@
+/**
+ * emu2.h
+ *
+ * Public C interface of the 65emu2 library for embedding the emulator into
+ * other programs.
+ *
+ * Every emulated machine is represented by an opaque handle that owns all of
+ * its state. The library has no mutable global state, so distinct handles
+ * may be used from different threads concurrently, while a single handle
+ * must not be used by more than one thread at a time.
+ *
+ * Memory is allocated a page of 256 bytes at a time when it is first
+ * written, so untouched memory reads as zeros and costs nothing. If a page
+ * cannot be allocated, the write is lost and the next emu2_step() or
+ * emu2_run() returns EMU2_NOMEM.
+ */
+
+#ifndef INC_65EMU2_EMU2_H
+#define INC_65EMU2_EMU2_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define EMU2_MEMORY_SIZE (UINT16_MAX + 1)
+
+typedef struct emu2_machine emu2_machine_t;
+typedef struct emu2_system emu2_system_t;
+
+typedef enum emu2_status_t {
+    EMU2_OK,                              /* Operation succeeded */
+    EMU2_STALLED,                         /* CPU hit an undefined opcode */
+    EMU2_BREAKPOINT,                      /* CPU reached a breakpoint */
+    EMU2_NOMEM,                           /* Allocation failed */
+    EMU2_DIVERGED,                        /* Replay no longer matches log */
+    EMU2_UNSUPPORTED,                     /* Not available for the CPU variant */
+} emu2_status_t;
+
+typedef enum emu2_variant_t {
+    EMU2_NMOS_6502,                       /* NMOS 6502 with undocumented opcodes */
+    EMU2_CMOS_65C02,                      /* CMOS 65C02 */
+    EMU2_RICOH_2A03,                      /* NMOS 6502 without decimal mode */
+} emu2_variant_t;
+
+/**
+ * Allocator hooks used by a machine for all of its allocations. The user
+ * pointer is passed through unchanged to both hooks.
+ */
+typedef struct emu2_allocator_t {
+    void* (* alloc) (size_t size, void* user);
+    void (* free) (void* ptr, void* user);
+    void* user;
+} emu2_allocator_t;
+
+/**
+ * Handlers of the devices mapped into the address space with emu2_map_io().
+ * Missing handlers read as $FF and ignore writes.
+ */
+typedef struct emu2_io_t {
+    uint8_t (* read) (uint16_t addr, void* user);
+    void (* write) (uint16_t addr, uint8_t value, void* user);
+    void* user;
+} emu2_io_t;
+
+typedef struct emu2_regs_t {
+    uint8_t a;                            /* Accumulator register A */
+    uint8_t x;                            /* Index register X */
+    uint8_t y;                            /* Index register Y */
+    uint8_t sp;                           /* Stack pointer */
+    uint8_t p;                            /* Processor status (NV-BDIZC) */
+    uint16_t pc;                          /* Program counter */
+} emu2_regs_t;
+
+/**
+ * Provider of pages mapped with emu2_map_pages(), returning the 256 bytes
+ * of a page, or NULL if they are not available. The user pointer is passed
+ * through unchanged.
+ */
+typedef const uint8_t* (* emu2_page_source_t) (uint8_t page, void* user);
+
+typedef struct emu2_snapshot_t {
+    emu2_regs_t regs;                     /* CPU registers */
+    uint64_t cycles;                      /* Elapsed clock cycles */
+    uint8_t irq;                          /* Interrupt request line asserted */
+    uint8_t nmi;                          /* Non-maskable interrupt pending */
+    struct {
+        uint8_t step;                     /* Next cycle, 0 at an instruction boundary */
+        uint8_t opcode;                   /* Opcode byte being executed */
+        uint8_t data;                     /* Operand or read-modify-write latch */
+        uint16_t vector;                  /* Vector of an interrupt being entered, or 0 */
+        uint16_t addr;                    /* Effective address */
+        uint16_t base;                    /* Address before indexing */
+    } progress;                           /* Progress of the cycle-exact core */
+    uint8_t mem[EMU2_MEMORY_SIZE];        /* Contents of the whole memory */
+} emu2_snapshot_t;
+
+/**
+ * Creates a new machine with an NMOS 6502 and cleared memory and registers.
+ *
+ * @param allocator allocator hooks to be used by the machine, or NULL to use
+ *                  malloc and free; the hooks are copied
+ * @return handle of the new machine, or NULL if the allocation failed
+ */
+emu2_machine_t*
+emu2_create (const emu2_allocator_t* allocator);
+
+/**
+ * Creates a new machine like emu2_create() with the specified CPU variant,
+ * which stays fixed for the lifetime of the machine.
+ *
+ * @param allocator allocator hooks to be used by the machine, or NULL to use
+ *                  malloc and free; the hooks are copied
+ * @param variant CPU variant to be emulated
+ * @return handle of the new machine, or NULL if the allocation failed or
+ *         the variant is unknown
+ */
+emu2_machine_t*
+emu2_create_variant (const emu2_allocator_t* allocator, emu2_variant_t variant);
+
+/**
+ * Destroys a machine and releases all of its memory.
+ *
+ * @param machine machine to be destroyed, may be NULL
+ */
+void
+emu2_destroy (emu2_machine_t* machine);
+
+/**
+ * Resets the CPU of the machine, that is the program counter is loaded from
+ * the reset vector at $FFFC and interrupts are disabled.
+ *
+ * @param machine machine to be reset
+ */
+void
+emu2_reset (emu2_machine_t* machine);
+
+/**
+ * Executes a single instruction.
+ *
+ * @param machine machine to be stepped
+ * @return EMU2_OK, or EMU2_STALLED if the instruction was not executed, or
+ *         EMU2_NOMEM if a page of memory could not be allocated
+ */
+emu2_status_t
+emu2_step (emu2_machine_t* machine);
+
+/**
+ * Executes instructions until at least the specified number of clock cycles
+ * have elapsed, the CPU stalls or reaches a breakpoint. The instruction at
+ * the initial program counter is always executed, so a run can be resumed
+ * from a breakpoint. Breakpoints only cost time while at least one is set.
+ *
+ * @param machine machine to be run
+ * @param cycles number of clock cycles to run for
+ * @return EMU2_OK, EMU2_STALLED or EMU2_BREAKPOINT if the CPU stopped
+ *         early, EMU2_DIVERGED if a replay no longer matches its log, or
+ *         EMU2_NOMEM if a page of memory could not be allocated
+ */
+emu2_status_t
+emu2_run (emu2_machine_t* machine, uint64_t cycles);
+
+/**
+ * Switches between the default core, which executes whole instructions at
+ * once, and the cycle-exact core, which performs the bus accesses of each
+ * instruction one clock cycle at a time, including the dummy reads on page
+ * crossings and the double writes of read-modify-write instructions. This
+ * is considerably slower, so it is best enabled only for timing sensitive
+ * parts of a program.
+ *
+ * In cycle-exact mode, emu2_run() stops as soon as the requested number of
+ * cycles has elapsed, possibly in the middle of an instruction, and resumes
+ * from there. emu2_step() completes the current instruction. Registers read
+ * or saved in the middle of an instruction reflect its partial progress.
+ * Disabling the mode completes the current instruction first.
+ *
+ * @param machine machine to be switched
+ * @param enabled non-zero to step single cycles, zero for whole instructions
+ * @return EMU2_OK, EMU2_UNSUPPORTED for a 65C02, whose bus accesses are
+ *         not modelled, or EMU2_NOMEM if completing the current instruction
+ *         failed to allocate a page of memory
+ */
+emu2_status_t
+emu2_set_cycle_exact (emu2_machine_t* machine, int enabled);
+
+/**
+ * Sets a breakpoint, which stops emu2_run() before the instruction at the
+ * address is executed.
+ *
+ * @param machine machine to set the breakpoint on
+ * @param addr address of the instruction
+ * @return EMU2_OK, or EMU2_NOMEM if the breakpoint table could not be
+ *         allocated
+ */
+emu2_status_t
+emu2_set_breakpoint (emu2_machine_t* machine, uint16_t addr);
+
+/**
+ * Removes a breakpoint, if there is one at the address.
+ *
+ * @param machine machine to remove the breakpoint from
+ * @param addr address of the instruction
+ */
+void
+emu2_clear_breakpoint (emu2_machine_t* machine, uint16_t addr);
+
+/**
+ * Checks whether a breakpoint is set at an address.
+ *
+ * @param machine machine to be queried
+ * @param addr address of the instruction
+ * @return non-zero if there is a breakpoint at the address
+ */
+int
+emu2_is_breakpoint (const emu2_machine_t* machine, uint16_t addr);
+
+/**
+ * Removes all breakpoints of the machine.
+ *
+ * @param machine machine to remove the breakpoints from
+ */
+void
+emu2_clear_breakpoints (emu2_machine_t* machine);
+
+/**
+ * Returns the number of clock cycles elapsed since the machine was created.
+ *
+ * @param machine machine to be queried
+ * @return elapsed clock cycles
+ */
+uint64_t
+emu2_get_cycles (const emu2_machine_t* machine);
+
+/**
+ * Installs the handlers for the I/O pages of the machine.
+ *
+ * @param machine machine to be modified
+ * @param io handlers to be copied, or NULL to remove them
+ */
+void
+emu2_set_io (emu2_machine_t* machine, const emu2_io_t* io);
+
+/**
+ * Routes CPU accesses to all pages overlapping the address range to the I/O
+ * handlers instead of memory. Accesses through emu2_read() and friends
+ * always go to memory.
+ *
+ * @param machine machine to be modified
+ * @param first first address of the range
+ * @param last last address of the range
+ */
+void
+emu2_map_io (emu2_machine_t* machine, uint16_t first, uint16_t last);
+
+/**
+ * Sets the level of the interrupt request line. The interrupt is taken
+ * before the next instruction as long as the line is asserted and
+ * interrupts are not disabled.
+ *
+ * @param machine machine to be interrupted
+ * @param asserted non-zero to assert the line, zero to release it
+ */
+void
+emu2_set_irq (emu2_machine_t* machine, int asserted);
+
+/**
+ * Raises a non-maskable interrupt, which is taken before the next
+ * instruction.
+ *
+ * @param machine machine to be interrupted
+ */
+void
+emu2_nmi (emu2_machine_t* machine);
+
+/**
+ * Starts recording the nondeterministic inputs of the machine, that is the
+ * bytes read from I/O pages and the cycles at which interrupts arrive.
+ * Together with a snapshot taken right before, the log reproduces the run.
+ *
+ * @param machine machine to be recorded
+ * @return EMU2_OK, or EMU2_NOMEM if the log could not be allocated
+ */
+emu2_status_t
+emu2_record_start (emu2_machine_t* machine);
+
+/**
+ * Starts replaying a log of inputs, which must have been recorded from the
+ * current state of the machine. While replaying, I/O reads are served from
+ * the log and interrupts are raised on the recorded cycles, so calls to
+ * emu2_set_irq() and emu2_nmi() are ignored. Once the log is exhausted, the
+ * machine goes back to its devices.
+ *
+ * @param machine machine to be replayed
+ * @param log recorded log, which must stay valid while replaying
+ * @param len length of the log in bytes
+ */
+void
+emu2_replay_start (emu2_machine_t* machine, const uint8_t* log, size_t len);
+
+/**
+ * Stops recording or replaying. A recorded log stays available.
+ *
+ * @param machine machine to be stopped
+ */
+void
+emu2_replay_stop (emu2_machine_t* machine);
+
+/**
+ * Returns the log recorded by the machine so far.
+ *
+ * @param machine machine that recorded the log
+ * @param len destination of the length of the log in bytes
+ * @return recorded log, or NULL if the log ran out of memory; valid until
+ *         the next recording is started or the machine is destroyed
+ */
+const uint8_t*
+emu2_get_log (const emu2_machine_t* machine, size_t* len);
+
+/**
+ * Copies the CPU registers of the machine.
+ *
+ * @param machine machine to be queried
+ * @param regs destination of the registers
+ */
+void
+emu2_get_regs (const emu2_machine_t* machine, emu2_regs_t* regs);
+
+/**
+ * Overwrites the CPU registers of the machine.
+ *
+ * @param machine machine to be modified
+ * @param regs new values of the registers
+ */
+void
+emu2_set_regs (emu2_machine_t* machine, const emu2_regs_t* regs);
+
+/**
+ * Reads a single byte from the memory of the machine.
+ *
+ * @param machine machine to be read from
+ * @param addr address to be read
+ * @return byte at the address
+ */
+uint8_t
+emu2_read (const emu2_machine_t* machine, uint16_t addr);
+
+/**
+ * Writes a single byte to the memory of the machine.
+ *
+ * @param machine machine to be written to
+ * @param addr address to be written
+ * @param value byte to be stored
+ */
+void
+emu2_write (emu2_machine_t* machine, uint16_t addr, uint8_t value);
+
+/**
+ * Copies a block of memory out of the machine, wrapping around at the end
+ * of the address space.
+ *
+ * @param machine machine to be read from
+ * @param addr first address to be read
+ * @param dest destination buffer of at least len bytes
+ * @param len number of bytes to be read
+ */
+void
+emu2_read_block (const emu2_machine_t* machine, uint16_t addr, uint8_t* dest,
+                 size_t len);
+
+/**
+ * Copies a block of memory into the machine, wrapping around at the end of
+ * the address space.
+ *
+ * @param machine machine to be written to
+ * @param addr first address to be written
+ * @param src source buffer of at least len bytes
+ * @param len number of bytes to be written
+ */
+void
+emu2_write_block (emu2_machine_t* machine, uint16_t addr, const uint8_t* src,
+                  size_t len);
+
+/**
+ * Maps an image into the memory of the machine without copying it, so
+ * machines running the same program share its pages until they write to
+ * them. Pages only partly covered by the image are copied, and the image
+ * wraps around at the end of the address space.
+ *
+ * @param machine machine to be loaded
+ * @param addr load address of the image
+ * @param image contents of the image, which must stay valid and unchanged
+ *              as long as the machine exists
+ * @param len length of the image in bytes
+ * @return EMU2_OK, or EMU2_NOMEM if a partly covered page could not be
+ *         allocated
+ */
+emu2_status_t
+emu2_map_image (emu2_machine_t* machine, uint16_t addr, const uint8_t* image,
+                size_t len);
+
+/**
+ * Maps pages into the memory of the machine whose contents are only asked
+ * for when the machine first accesses them, by the CPU or through the
+ * functions of this interface. Pages still pending from a previous source
+ * are asked for right away. If the source fails, the page reads as zeros
+ * and the next emu2_step() or emu2_run() returns EMU2_NOMEM.
+ *
+ * @param machine machine to be loaded
+ * @param first number of the first page
+ * @param count number of pages
+ * @param source provider of the pages, whose contents must stay valid and
+ *               unchanged as long as the machine exists
+ * @param user passed through to the source
+ */
+void
+emu2_map_pages (emu2_machine_t* machine, uint8_t first, unsigned int count,
+                emu2_page_source_t source, void* user);
+
+/**
+ * Saves the complete state of the machine into a snapshot.
+ *
+ * @param machine machine to be saved
+ * @param snapshot destination of the saved state
+ */
+void
+emu2_save (const emu2_machine_t* machine, emu2_snapshot_t* snapshot);
+
+/**
+ * Restores the complete state of the machine from a snapshot. A snapshot
+ * taken in the middle of an instruction in cycle-exact mode resumes there,
+ * and a machine that is not in cycle-exact mode completes the instruction
+ * first.
+ *
+ * @param machine machine to be restored
+ * @param snapshot state to be restored
+ */
+void
+emu2_restore (emu2_machine_t* machine, const emu2_snapshot_t* snapshot);
+
+/**
+ * Combines several machines into a system whose CPUs run concurrently and
+ * communicate through shared memory pages. Each CPU keeps all of its state
+ * in its machine and is resumed from there, so the system interleaves them
+ * like stackless coroutines on the calling thread: the CPU furthest behind
+ * runs for a quantum of cycles at full speed, and only accesses to shared
+ * pages force the others into lockstep. Before such an access, every CPU
+ * behind the accessing one is stepped up to its clock, so all CPUs observe
+ * the accesses to shared pages in the order of their cycle counts, at the
+ * granularity of instructions.
+ *
+ * The system takes over the I/O handlers of the machines. Handlers set
+ * with emu2_set_io() beforehand keep serving the other I/O pages, and must
+ * not be replaced while the machines are part of the system.
+ *
+ * @param allocator allocator hooks to be used by the system, or NULL to use
+ *                  malloc and free; the hooks are copied
+ * @param machines machines to be combined, which must outlive the system
+ * @param count number of machines
+ * @param quantum number of clock cycles a CPU runs before the next one is
+ *                scheduled; larger quanta are faster, smaller ones keep the
+ *                CPUs closer together for their private I/O
+ * @return handle of the new system, or NULL if the allocation failed
+ */
+emu2_system_t*
+emu2_system_create (const emu2_allocator_t* allocator, emu2_machine_t* const* machines,
+                    size_t count, uint64_t quantum);
+
+/**
+ * Destroys a system and gives the machines back their own I/O handlers.
+ * The machines themselves are left alone.
+ *
+ * @param system system to be destroyed, may be NULL
+ */
+void
+emu2_system_destroy (emu2_system_t* system);
+
+/**
+ * Shares all pages overlapping the address range between the CPUs of the
+ * system. The pages start out with the contents of the first machine, and
+ * writes by any CPU are visible in the memory of all machines.
+ *
+ * @param system system to be modified
+ * @param first first address of the range
+ * @param last last address of the range
+ */
+void
+emu2_system_share (emu2_system_t* system, uint16_t first, uint16_t last);
+
+/**
+ * Runs all CPUs until each has reached the clock of the CPU furthest behind
+ * plus the specified number of cycles, or one of them stops. Breakpoints
+ * are checked while a CPU runs its own quantum, but not while it is stepped
+ * to catch up with another CPU.
+ *
+ * @param system system to be run
+ * @param cycles number of clock cycles to run for
+ * @param stopped destination of the index of the CPU that stopped, may be
+ *                NULL
+ * @return EMU2_OK, or the status of the CPU that stopped early as returned
+ *         by emu2_run()
+ */
+emu2_status_t
+emu2_system_run (emu2_system_t* system, uint64_t cycles, size_t* stopped);
+
+#endif //INC_65EMU2_EMU2_H
@@ -0,0 +1,38 @@
+/**
+ * file.h
+ *
+ * File helpers shared by the command line tools.
+ */
+
+#ifndef INC_65EMU2_FILE_H
+#define INC_65EMU2_FILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "pack.h"
+
+/**
+ * Opens a pack, given either as PACK or as PACK:NAME to select an image by
+ * name, with the first image being selected otherwise. Exits the program if
+ * the pack holds no such image.
+ *
+ * @param filename path of the pack, optionally followed by the image name
+ * @param index pointer to store the index of the selected image in
+ * @return opened pack, or NULL if the file is no pack
+ */
+pack_t*
+open_pack (const char* filename, size_t* index);
+
+/**
+ * Reads the whole file into a newly allocated buffer, or the selected image
+ * if the file is a pack. Exits the program if the file cannot be read.
+ *
+ * @param filename path of the file to be read
+ * @param dest pointer to store the allocated buffer in, to be freed by the
+ *             caller
+ * @return size of the file in bytes
+ */
+size_t
+read_file (const char* filename, uint8_t** dest);
+
+#endif //INC_65EMU2_FILE_H
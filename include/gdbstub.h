@@ -0,0 +1,63 @@
+/**
+ * gdbstub.h
+ *
+ * Remote debugging stub speaking the GDB remote serial protocol over a local
+ * TCP or Unix domain socket.
+ *
+ * The registers are exposed in the order A, X, Y, SP, P (one byte each)
+ * followed by the little-endian PC, with register numbers 0 to 5.
+ */
+
+#ifndef INC_65EMU2_GDBSTUB_H
+#define INC_65EMU2_GDBSTUB_H
+
+#include "emu2.h"
+
+typedef struct gdbstub gdbstub_t;
+
+/**
+ * Creates a stub listening for a debugger on the specified address, which is
+ * either a TCP port number on localhost or "unix:" followed by a socket path.
+ *
+ * @param machine machine to be debugged
+ * @param address address to listen on
+ * @return new stub, or NULL if the socket could not be set up
+ */
+gdbstub_t*
+gdbstub_create (emu2_machine_t* machine, const char* address);
+
+/**
+ * Closes the socket of the stub and releases it.
+ *
+ * @param stub stub to be destroyed, may be NULL
+ */
+void
+gdbstub_destroy (gdbstub_t* stub);
+
+/**
+ * Checks without blocking whether a debugger is trying to attach. If one
+ * does, the machine is halted and the debug session is served until the
+ * debugger detaches, so this is meant to be called between run slices of
+ * the host. Breakpoints the debugger inserted are removed when it detaches,
+ * while those set by the host stay in place. Without a debugger, this costs
+ * a single poll() per call.
+ *
+ * @param stub stub to be polled
+ * @return 0 to keep running, or -1 if the debugger killed the program
+ */
+int
+gdbstub_poll (gdbstub_t* stub);
+
+/**
+ * Waits for a debugger to attach after the host stopped running the machine,
+ * and serves its session until it detaches, so a stall or the end of a run
+ * can still be inspected. The debugger is told why the machine stopped.
+ *
+ * @param stub stub to wait on
+ * @param status status the last run of the host ended with
+ * @return 0 once the debugger detached, or -1 if it killed the program
+ */
+int
+gdbstub_wait (gdbstub_t* stub, emu2_status_t status);
+
+#endif //INC_65EMU2_GDBSTUB_H
@@ -0,0 +1,51 @@
+/**
+ * machine.h
+ *
+ * Internal layout of the machine handles shared by the library modules.
+ */
+
+#ifndef INC_65EMU2_MACHINE_H
+#define INC_65EMU2_MACHINE_H
+
+#include "emu2.h"
+#include "cpu.h"
+#include "cycle.h"
+#include "memory.h"
+#include "metrics.h"
+#include "replay.h"
+
+struct emu2_machine {
+    cpu_t cpu;
+    bus_t bus;
+    uint64_t cycles;
+    emu2_allocator_t allocator;
+    emu2_io_t io;                         /* Device handlers of the host */
+
+    cycle_t cycle;                        /* Progress of the cycle-stepped core */
+    uint8_t cycle_exact;                  /* Non-zero to use the cycle-stepped core */
+
+    uint8_t* breakpoints;                 /* Bitmap over the address space */
+    unsigned int breakpoint_count;        /* Number of bits set in bitmap */
+
+    replay_t replay;
+
+    uint64_t stalls;                      /* Runs stopped on undefined opcodes */
+    metrics_slot_t* metrics;              /* Slot of the running thread, or NULL */
+    metrics_sample_t published;           /* Counters already added to the slot */
+};
+
+/* Reads from the device handlers of the host, bypassing any replay log */
+static inline uint8_t
+device_read (emu2_machine_t* machine, uint16_t addr)
+{
+  if (machine->io.read == NULL)
+    return 0xFF;
+
+  machine->replay.in_access = 1;
+  uint8_t const value = machine->io.read (addr, machine->io.user);
+  machine->replay.in_access = 0;
+
+  return value;
+}
+
+#endif //INC_65EMU2_MACHINE_H
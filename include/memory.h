@@ -1,12 +1,173 @@
 /**
  * memory.h
+ *
+ * Address space of a CPU as a map of 256 byte pages. Pages start out shared,
+ * either the common page of zeros or pages of an image mapped in place, and
+ * are copied into a page of their own on the first write. Machines running
+ * small programs thus only hold the few pages they actually write. Pages
+ * can also be left to a source providing them on their first access.
  */
 
 #ifndef INC_65EMU2_MEMORY_H
 #define INC_65EMU2_MEMORY_H
 
+#include <stddef.h>
 #include <stdint.h>
 
-typedef uint8_t mem_t[UINT16_MAX];
+#define PAGE_COUNT 256
+#define BUS_PAGE_SIZE 0x100
+
+#define PAGE_IO     0x01                  /* Accesses go to the I/O handlers */
+#define PAGE_SHARED 0x02                  /* Contents not owned, copied on write */
+#define PAGE_LAZY   0x04                  /* Contents still to be provided */
+
+/* Pages a CPU cannot read directly */
+#define PAGE_TRAP (PAGE_IO | PAGE_LAZY)
+
+typedef uint8_t (* io_read_t) (uint16_t addr, void* user);
+typedef void (* io_write_t) (uint16_t addr, uint8_t value, void* user);
+
+typedef void* (* page_alloc_t) (size_t size, void* user);
+typedef void (* page_free_t) (void* ptr, void* user);
+typedef const uint8_t* (* page_source_t) (uint8_t page, void* user);
+
+/**
+ * Address space as seen by the CPU: pages of memory, of which whole pages
+ * can be routed to I/O handlers instead.
+ */
+typedef struct bus_t {
+    uint8_t* pages[PAGE_COUNT];           /* Contents, only written if owned */
+    uint8_t page_flags[PAGE_COUNT];       /* PAGE_* flags of every page */
+    io_read_t io_read;                    /* Handler for reads from I/O pages */
+    io_write_t io_write;                  /* Handler for writes to I/O pages */
+    void* io_user;                        /* Passed through to the handlers */
+
+    page_alloc_t page_alloc;              /* Allocator of owned pages */
+    page_free_t page_free;
+    void* page_user;                      /* Passed through to the allocator */
+    uint8_t failed;                       /* Non-zero if a page could not be copied */
+
+    page_source_t source;                 /* Provider of PAGE_LAZY pages */
+    void* source_user;                    /* Passed through to the provider */
+} bus_t;
+
+/**
+ * Maps the page of zeros everywhere and sets up the allocator of the pages
+ * copied on write.
+ *
+ * @param bus bus to be initialized
+ * @param alloc allocation hook
+ * @param free release hook
+ * @param user passed through to the hooks
+ */
+void
+bus_init (bus_t* bus, page_alloc_t alloc, page_free_t free, void* user);
+
+/**
+ * Releases all pages owned by the bus.
+ *
+ * @param bus bus to be released
+ */
+void
+bus_free (bus_t* bus);
+
+/**
+ * Returns a page owned by the bus, copying its shared contents first. If
+ * no page can be allocated, the failed flag of the bus is set.
+ *
+ * @param bus bus owning the page
+ * @param page number of the page
+ * @return writable contents of the page, or NULL if the allocation failed
+ */
+uint8_t*
+bus_own_page (bus_t* bus, unsigned int page);
+
+/**
+ * Maps shared contents into a page, releasing the page owned so far.
+ *
+ * @param bus bus to be modified
+ * @param page number of the page
+ * @param contents BUS_PAGE_SIZE bytes that stay valid and unchanged while
+ *                 they are mapped, or NULL for the page of zeros
+ */
+void
+bus_share_page (bus_t* bus, unsigned int page, const uint8_t* contents);
+
+/**
+ * Leaves pages to a source providing their contents on the first access.
+ * Pages still pending from a previous source are provided before.
+ *
+ * @param bus bus to be modified
+ * @param first number of the first page
+ * @param count number of pages
+ * @param source provider of the pages, whose contents must stay valid and
+ *               unchanged while they are mapped
+ * @param user passed through to the source
+ */
+void
+bus_map_source (bus_t* bus, unsigned int first, unsigned int count,
+                page_source_t source, void* user);
+
+/**
+ * Maps a PAGE_LAZY page in from its source. If the source fails, the page
+ * reads as zeros and the failed flag of the bus is set.
+ *
+ * @param bus bus owning the page
+ * @param page number of the page
+ */
+void
+bus_fault (bus_t* bus, unsigned int page);
+
+/**
+ * Reads a byte from a PAGE_TRAP page, either through the I/O handler or
+ * after mapping the page in.
+ *
+ * @param bus bus to read from
+ * @param addr address to be read
+ * @return byte read
+ */
+uint8_t
+bus_read_trap (bus_t* bus, uint16_t addr);
+
+/**
+ * Returns non-zero if a page is mapped to the page of zeros.
+ *
+ * @param bus bus to be queried
+ * @param page number of the page
+ * @return non-zero for the page of zeros
+ */
+int
+bus_is_zero_page (const bus_t* bus, unsigned int page);
+
+/* Returns the contents of a page, even of an I/O page */
+static inline const uint8_t*
+bus_page (bus_t* bus, unsigned int page)
+{
+  if (bus->page_flags[page] & PAGE_LAZY)
+    bus_fault (bus, page);
+
+  return bus->pages[page];
+}
+
+/* Reads memory directly, even on I/O pages */
+static inline uint8_t
+bus_peek (bus_t* bus, uint16_t addr)
+{
+  return bus_page (bus, addr >> 8)[addr & 0xFF];
+}
+
+/* Writes memory directly, even on I/O pages, copying a shared page first */
+static inline void
+bus_poke (bus_t* bus, uint16_t addr, uint8_t value)
+{
+  if (!(bus->page_flags[addr >> 8] & PAGE_SHARED)) {
+    bus->pages[addr >> 8][addr & 0xFF] = value;
+  } else {
+    uint8_t* page = bus_own_page (bus, addr >> 8);
+
+    if (page != NULL)
+      page[addr & 0xFF] = value;
+  }
+}
 
 #endif //INC_65EMU2_MEMORY_H
@@ -0,0 +1,115 @@
+/**
+ * metrics.h
+ *
+ * Runtime counters of the machines run by a program, exported periodically
+ * in the Prometheus text format to a file or over a Unix domain socket.
+ *
+ * Every thread running machines owns a slot of counters in a cache line of
+ * its own. A machine adds its progress to the slot of its thread when
+ * emu2_step() or emu2_run() returns, so counting costs nothing within a
+ * run, and the exporter sums the slots without taking any lock.
+ */
+
+#ifndef INC_65EMU2_METRICS_H
+#define INC_65EMU2_METRICS_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "emu2.h"
+
+#define METRICS_LINE_SIZE 64
+
+/* Counters of one thread, written by that thread only */
+typedef struct metrics_slot_t {
+    _Alignas (METRICS_LINE_SIZE)
+    _Atomic uint64_t instructions;        /* Instructions executed */
+    _Atomic uint64_t fused;               /* Of those, executed in fused sequences */
+    _Atomic uint64_t cycles;              /* Clock cycles elapsed */
+    _Atomic uint64_t interrupts;          /* Interrupts taken */
+    _Atomic uint64_t stalls;              /* Runs stopped on undefined opcodes */
+} metrics_slot_t;
+
+/* Counters of a machine as last added to its slot */
+typedef struct metrics_sample_t {
+    uint64_t instructions;
+    uint64_t fused;
+    uint64_t cycles;
+    uint64_t interrupts;
+    uint64_t stalls;
+} metrics_sample_t;
+
+typedef struct metrics metrics_t;
+
+/**
+ * Creates a set of counters for the specified number of threads.
+ *
+ * @param threads number of threads running machines
+ * @return new counters, or NULL if the allocation failed
+ */
+metrics_t*
+metrics_create (size_t threads);
+
+/**
+ * Stops the exporter, writing the final counters to its file, and releases
+ * the counters. The machines must have been detached before.
+ *
+ * @param metrics counters to be destroyed, may be NULL
+ */
+void
+metrics_destroy (metrics_t* metrics);
+
+/**
+ * Makes a machine count into the slot of a thread, which must then be the
+ * only thread running the machine.
+ *
+ * @param machine machine to be counted
+ * @param metrics counters to count into, or NULL to detach the machine
+ * @param thread index of the slot of the thread
+ * @return 0 on success, or -1 if there is no slot with that index, in which
+ *         case the machine is left as it was
+ */
+int
+metrics_attach (emu2_machine_t* machine, metrics_t* metrics, size_t thread);
+
+/**
+ * Writes the counters summed over all threads in the Prometheus text format,
+ * together with the emulated clock rate the exporter measured over its last
+ * interval, which is zero until it has measured one. Only one thread may
+ * write the counters at a time, which is the exporter once it has been
+ * started.
+ *
+ * @param metrics counters to be written
+ * @param dest destination stream
+ * @return 0 on success, or -1 on a write error
+ */
+int
+metrics_write (metrics_t* metrics, FILE* dest);
+
+/**
+ * Starts a thread exporting the counters, either by rewriting a file every
+ * interval or by writing them to every client connecting to a socket, if
+ * the target is "unix:" followed by a socket path.
+ *
+ * @param metrics counters to be exported
+ * @param target path of the file or socket
+ * @param interval interval between writes of the file and between
+ *                 measurements of the clock rate in milliseconds
+ * @return 0 on success, or -1 if the socket or thread could not be set up
+ */
+int
+metrics_export (metrics_t* metrics, const char* target, unsigned int interval);
+
+/* Adds the progress of a counter since the last call to the slot */
+static inline void
+metrics_add (_Atomic uint64_t* counter, uint64_t value, uint64_t* published)
+{
+  /* Counters go back when a machine is restored from a snapshot */
+  if (value > *published)
+    atomic_store_explicit (counter, atomic_load_explicit (counter, memory_order_relaxed)
+                                    + (value - *published), memory_order_relaxed);
+  *published = value;
+}
+
+#endif //INC_65EMU2_METRICS_H
@@ -7,6 +7,8 @@
 #ifndef INC_65EMU2_OPCODE_H
 #define INC_65EMU2_OPCODE_H
 
+#include <stdint.h>
+
 typedef enum AddressMode {
     UNDEFINED_MODE,
 
@@ -115,6 +117,31 @@ typedef enum AddressMode {
     INDIRECT,
     INDEXED_INDIRECT,
     INDIRECT_INDEXED,
+
+    /**
+     * Zero page indirection addressing (65C02 only)
+     *
+     * Instructions in zero page indirect addressing mode work with a single
+     * byte operand, which is the zero page location of a pointer to the
+     * actual target value.
+     */
+    ZERO_PAGE_INDIRECT,
+
+    /**
+     * Absolute indexed indirection addressing (65C02 only)
+     *
+     * Instructions in absolute indexed indirect addressing mode work with a
+     * double byte operand, which the current value of the X index register is
+     * added to in order to fetch the target address. This addressing mode is
+     * only available for the JMP instruction.
+     */
+    ABSOLUTE_INDEXED_INDIRECT,
+
+    /**
+     * Size of the address mode enumeration
+     */
+    ADDRESS_MODE_SIZE,
+
 } AddressMode;
 
 typedef enum OpCode {
@@ -400,6 +427,146 @@ typedef enum OpCode {
      */
     TYA,
 
+    /**
+     * ALR - AND then Logical shift Right instruction (undocumented)
+     */
+    ALR,
+
+    /**
+     * ANC - AND then copy N to Carry instruction (undocumented)
+     */
+    ANC,
+
+    /**
+     * ANE - AND X then AND immediate instruction (undocumented, unstable)
+     */
+    ANE,
+
+    /**
+     * ARR - AND then Rotate Right instruction (undocumented)
+     */
+    ARR,
+
+    /**
+     * DCP - DeCrement memory then comPare instruction (undocumented)
+     */
+    DCP,
+
+    /**
+     * ISC - Increment memory then Subtract with Carry instruction
+     * (undocumented)
+     */
+    ISC,
+
+    /**
+     * LAS - Load Accumulator, X and Stack pointer instruction (undocumented)
+     */
+    LAS,
+
+    /**
+     * LAX - Load Accumulator and X register instruction (undocumented)
+     */
+    LAX,
+
+    /**
+     * LXA - Load X and Accumulator immediate instruction (undocumented,
+     * unstable)
+     */
+    LXA,
+
+    /**
+     * RLA - Rotate Left then AND instruction (undocumented)
+     */
+    RLA,
+
+    /**
+     * RRA - Rotate Right then Add with carry instruction (undocumented)
+     */
+    RRA,
+
+    /**
+     * SAX - Store Accumulator AND X register instruction (undocumented)
+     */
+    SAX,
+
+    /**
+     * SBX - Subtract from Accumulator AND X register instruction
+     * (undocumented)
+     */
+    SBX,
+
+    /**
+     * SHA - Store Accumulator AND X AND High byte instruction (undocumented,
+     * unstable)
+     */
+    SHA,
+
+    /**
+     * SHX - Store X AND High byte instruction (undocumented, unstable)
+     */
+    SHX,
+
+    /**
+     * SHY - Store Y AND High byte instruction (undocumented, unstable)
+     */
+    SHY,
+
+    /**
+     * SLO - Shift Left then OR instruction (undocumented)
+     */
+    SLO,
+
+    /**
+     * SRE - Shift Right then Exclusive OR instruction (undocumented)
+     */
+    SRE,
+
+    /**
+     * TAS - Transfer Accumulator AND X to Stack pointer instruction
+     * (undocumented, unstable)
+     */
+    TAS,
+
+    /**
+     * BRA - BRanch Always instruction (65C02 only)
+     */
+    BRA,
+
+    /**
+     * PHX - PusH X register instruction (65C02 only)
+     */
+    PHX,
+
+    /**
+     * PHY - PusH Y register instruction (65C02 only)
+     */
+    PHY,
+
+    /**
+     * PLX - PuLl X register instruction (65C02 only)
+     */
+    PLX,
+
+    /**
+     * PLY - PuLl Y register instruction (65C02 only)
+     */
+    PLY,
+
+    /**
+     * STZ - STore Zero instruction (65C02 only)
+     */
+    STZ,
+
+    /**
+     * TRB - Test and Reset memory Bits instruction (65C02 only)
+     */
+    TRB,
+
+    /**
+     * TSB - Test and Set memory Bits instruction (65C02 only)
+     */
+    TSB,
+
     /**
      * Size of the opcode enumeration
      */
@@ -412,8 +579,50 @@ typedef struct opcode_t {
     AddressMode mode;
 } opcode_t;
 
+typedef enum Variant {
+    /**
+     * Original NMOS 6502 including its undocumented instructions
+     */
+    VARIANT_NMOS,
+
+    /**
+     * CMOS 65C02 without the Rockwell bit manipulation instructions
+     */
+    VARIANT_CMOS,
+
+    /**
+     * Ricoh 2A03 of the NES, which is an NMOS 6502 without decimal mode
+     */
+    VARIANT_RICOH,
+
+    /**
+     * Size of the variant enumeration
+     */
+    VARIANT_SIZE,
+} Variant;
+
+/**
+ * Dispatch tables and behaviour of a CPU variant. Every variant has its own
+ * tables, so choosing one costs nothing per instruction.
+ */
+typedef struct variant_t {
+    const opcode_t* opcodes;              /* Decoded opcode per byte */
+    const uint8_t* cycles;                /* Base clock cycles per byte */
+    unsigned int decimal : 1;             /* Decimal mode is implemented */
+    unsigned int cmos    : 1;             /* CMOS fixes and extensions */
+} variant_t;
+
+/**
+ * Returns the dispatch tables of the specified CPU variant.
+ *
+ * @param variant CPU variant to get the tables for
+ * @return tables of the variant
+ */
+const variant_t*
+get_variant (Variant variant);
+
 /**
- * Returns the corresponding opcode for the specified byte.
+ * Returns the corresponding NMOS 6502 opcode for the specified byte.
  *
  * @param byte byte to be decoded
  * @return opcode decoded from byte
@@ -430,4 +639,23 @@ decode_opcode (const uint8_t* byte);
 const char*
 get_opcode_name (const opcode_t* opcode);
 
+/**
+ * Returns a short descriptive name for the specified address mode.
+ *
+ * @param mode address mode to get the name for
+ * @return name string for the address mode
+ */
+const char*
+get_address_mode_name (AddressMode mode);
+
+/**
+ * Returns the length in bytes of an instruction with the specified opcode,
+ * that is the opcode byte itself plus the operand bytes of its address mode.
+ *
+ * @param opcode opcode to get the instruction length for
+ * @return instruction length in bytes (1 to 3)
+ */
+unsigned int
+get_instruction_length (const opcode_t* opcode);
+
 #endif //INC_65EMU2_OPCODE_H
@@ -0,0 +1,174 @@
+/**
+ * pack.h
+ *
+ * Container of program images and snapshots, stored as pages of the address
+ * space. Identical pages are stored once across all images of a pack, each
+ * compressed on its own, and found through an index, so a single page can
+ * be read without touching the rest of the file. A machine loading an image
+ * from a pack only decompresses the pages it actually accesses.
+ *
+ * All fields are little-endian. The file starts with a header, followed by
+ * the image table, the page references of all images, the page index and
+ * the compressed pages:
+ *
+ *   header       "65E2PACK", version, image, reference and page counts
+ *   images       name, load address, length, index of first reference
+ *   references   page index of every page an image covers, in order
+ *   index        offset and compressed size of every distinct page
+ *   pages        compressed pages, see pack_decode()
+ */
+
+#ifndef INC_65EMU2_PACK_H
+#define INC_65EMU2_PACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "emu2.h"
+
+#define PACK_MAGIC "65E2PACK"
+#define PACK_PAGE_SIZE 0x100
+#define PACK_NAME_SIZE 32
+
+typedef struct pack pack_t;
+
+/* Image to be stored in a pack */
+typedef struct pack_source_t {
+    const char* name;                     /* Name, truncated to PACK_NAME_SIZE - 1 */
+    uint16_t load;                        /* Load address */
+    const uint8_t* data;                  /* Contents */
+    size_t len;                           /* Length, at most up to the end of memory */
+} pack_source_t;
+
+/* Image stored in a pack */
+typedef struct pack_image_t {
+    char name[PACK_NAME_SIZE];            /* Name, terminated */
+    uint16_t load;                        /* Load address */
+    uint32_t len;                         /* Length in bytes */
+    uint32_t first_ref;                   /* Index of the reference of its first page */
+} pack_image_t;
+
+/**
+ * Compresses a page. The encoding is a sequence of tokens, each starting
+ * with a control byte: below $80 it is followed by that many plus one
+ * literal bytes, otherwise by a byte holding a distance minus one, from
+ * which the control byte minus $7D bytes are copied.
+ *
+ * @param page contents of the page
+ * @param dest destination of at least PACK_PAGE_SIZE bytes
+ * @return length of the encoding, or PACK_PAGE_SIZE if the page does not
+ *         compress and is to be stored as it is
+ */
+size_t
+pack_encode (const uint8_t* page, uint8_t* dest);
+
+/**
+ * Decompresses a page encoded with pack_encode().
+ *
+ * @param src encoding of the page
+ * @param len length of the encoding, PACK_PAGE_SIZE for a stored page
+ * @param page destination of the contents of the page
+ * @return 0 on success, or -1 if the encoding is corrupt
+ */
+int
+pack_decode (const uint8_t* src, size_t len, uint8_t* page);
+
+/**
+ * Writes a pack holding the specified images, storing every distinct page
+ * only once.
+ *
+ * @param path path of the file to be written
+ * @param sources images to be stored
+ * @param count number of images
+ * @return 0 on success, or -1 if the file could not be written
+ */
+int
+pack_write (const char* path, const pack_source_t* sources, size_t count);
+
+/**
+ * Maps a pack into memory, checking its tables but none of the pages.
+ *
+ * @param path path of the pack
+ * @return opened pack, or NULL if the file is no valid pack
+ */
+pack_t*
+pack_open (const char* path);
+
+/**
+ * Unmaps a pack. Machines that loaded images from it must be destroyed
+ * before.
+ *
+ * @param pack pack to be closed, may be NULL
+ */
+void
+pack_close (pack_t* pack);
+
+/**
+ * Returns the number of images in a pack.
+ *
+ * @param pack pack to be queried
+ * @return number of images
+ */
+size_t
+pack_image_count (const pack_t* pack);
+
+/**
+ * Looks up an image of a pack.
+ *
+ * @param pack pack to be queried
+ * @param index index of the image
+ * @param image destination of the description of the image
+ */
+void
+pack_get_image (const pack_t* pack, size_t index, pack_image_t* image);
+
+/**
+ * Finds an image of a pack by name.
+ *
+ * @param pack pack to be searched
+ * @param name name of the image
+ * @return index of the first image with the name, or -1 if there is none
+ */
+long
+pack_find (const pack_t* pack, const char* name);
+
+/**
+ * Returns a page of an image, decompressing it on first use. Decompressed
+ * pages are kept with the pack and shared by all users, also across
+ * threads.
+ *
+ * @param pack pack holding the image
+ * @param index index of the image
+ * @param page number of the page relative to the first page of the image
+ * @return PACK_PAGE_SIZE bytes valid until the pack is closed, or NULL if
+ *         the page is corrupt or could not be allocated
+ */
+const uint8_t*
+pack_page (pack_t* pack, size_t index, size_t page);
+
+/**
+ * Copies the contents of an image into a newly allocated buffer.
+ *
+ * @param pack pack holding the image
+ * @param index index of the image
+ * @param dest pointer to store the buffer in, to be freed by the caller
+ * @return length of the image, or -1 if a page is corrupt or the buffer
+ *         could not be allocated
+ */
+long
+pack_extract (pack_t* pack, size_t index, uint8_t** dest);
+
+/**
+ * Maps an image into the memory of a machine, decompressing each of its
+ * pages when the machine first accesses it. Bytes of the first and last
+ * page that are not part of the image read as zeros.
+ *
+ * @param pack pack holding the image, which must stay open as long as the
+ *             machine exists
+ * @param index index of the image
+ * @param machine machine to be loaded
+ * @return EMU2_OK
+ */
+emu2_status_t
+pack_map (pack_t* pack, size_t index, emu2_machine_t* machine);
+
+#endif //INC_65EMU2_PACK_H
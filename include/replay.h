@@ -0,0 +1,122 @@
+/**
+ * replay.h
+ *
+ * Recording and replaying of the nondeterministic inputs of a machine, that
+ * is values read from I/O pages and the cycles at which interrupt lines
+ * change. Everything else follows deterministically from a snapshot.
+ *
+ * The log is a stream of records, each starting with a varint holding the
+ * cycles elapsed since the previous record shifted left by two and the
+ * record kind in the low two bits. I/O read records are followed by the
+ * byte that was read.
+ */
+
+#ifndef INC_65EMU2_REPLAY_H
+#define INC_65EMU2_REPLAY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "emu2.h"
+
+typedef enum replay_mode_t {
+    REPLAY_OFF,                           /* Inputs come from the devices */
+    REPLAY_RECORD,                        /* Inputs are appended to the log */
+    REPLAY_PLAY,                          /* Inputs are taken from the log */
+} replay_mode_t;
+
+typedef enum replay_kind_t {
+    RECORD_IO_READ,                       /* Byte read from an I/O page */
+    RECORD_IRQ_ASSERT,                    /* Interrupt request line asserted */
+    RECORD_IRQ_RELEASE,                   /* Interrupt request line released */
+    RECORD_NMI,                           /* Non-maskable interrupt raised */
+} replay_kind_t;
+
+/* Position in a log being replayed */
+typedef struct replay_cursor_t {
+    size_t pos;                           /* Offset of the next record */
+    uint64_t cycle;                       /* Cycle of the previous record */
+} replay_cursor_t;
+
+typedef struct replay_t {
+    replay_mode_t mode;
+
+    uint8_t* buf;                         /* Log written while recording */
+    size_t len;
+    size_t capacity;
+    uint64_t last_cycle;                  /* Cycle of the last record written */
+    int failed;                           /* Log could not be grown */
+    int in_access;                        /* Device handler is being called */
+    int deferred;                         /* Interrupt changed during an access */
+    int deferred_nmi;                     /* NMI raised during an access */
+    int logged_irq;                       /* IRQ line as of the last record */
+
+    const uint8_t* log;                   /* Log read while replaying */
+    size_t size;
+    replay_cursor_t io;                   /* Next I/O read record */
+    replay_cursor_t event;                /* Past the next interrupt record */
+    replay_kind_t pending;                /* Kind of the next interrupt */
+    uint64_t next_event;                  /* Cycle of the next interrupt */
+    int diverged;                         /* Replay no longer matches log */
+} replay_t;
+
+/**
+ * Appends a record to the log of a recording machine.
+ *
+ * @param machine machine that is recording
+ * @param kind kind of the record
+ * @param value byte read for I/O read records, ignored otherwise
+ */
+void
+replay_append (emu2_machine_t* machine, replay_kind_t kind, uint8_t value);
+
+/**
+ * Logs a change of an interrupt line on a recording machine. Changes made
+ * by a device while the CPU accesses it only take effect with the next
+ * instruction, so they are held back until replay_flush() logs them at its
+ * cycle.
+ *
+ * @param machine machine that is recording
+ * @param kind kind of the interrupt record
+ */
+void
+replay_interrupt (emu2_machine_t* machine, replay_kind_t kind);
+
+/**
+ * Logs the interrupt changes held back during the instruction or cycle
+ * that just completed.
+ *
+ * @param machine machine that is recording
+ */
+void
+replay_flush (emu2_machine_t* machine);
+
+/**
+ * Returns the byte of the next I/O read from the log of a replaying
+ * machine. Once the log is exhausted, the machine goes back to reading from
+ * its devices.
+ *
+ * @param machine machine that is replaying
+ * @param addr address being read
+ * @return recorded byte
+ */
+uint8_t
+replay_io_read (emu2_machine_t* machine, uint16_t addr);
+
+/**
+ * Applies all interrupt records of a replaying machine that are due at the
+ * current cycle and looks up the cycle of the next one.
+ *
+ * @param machine machine that is replaying
+ */
+void
+replay_events (emu2_machine_t* machine);
+
+/**
+ * Releases the log buffer of a machine.
+ *
+ * @param machine machine owning the log
+ */
+void
+replay_free (emu2_machine_t* machine);
+
+#endif //INC_65EMU2_REPLAY_H
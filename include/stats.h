@@ -0,0 +1,55 @@
+/**
+ * stats.h
+ *
+ * Opcode frequency statistics over MOS 6502 binaries, collected by the same
+ * linear sweep as the disassembler.
+ */
+
+#ifndef INC_65EMU2_STATS_H
+#define INC_65EMU2_STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/**
+ * Counts of a set of binaries. Only the opcode bytes are counted, as the op
+ * code, address mode and length of an instruction all follow from its
+ * byte, so the other histograms are derived when the statistics are
+ * printed and a table can be merged by adding up its counts.
+ */
+typedef struct stats_t {
+    uint64_t bytes[256];                  /* Instructions per opcode byte */
+    uint64_t files;                       /* Number of binaries counted */
+    uint64_t size;                        /* Total size of the binaries */
+} stats_t;
+
+/**
+ * Counts the instructions of a binary, decoded like disassemble() does.
+ *
+ * @param stats statistics to add the counts to
+ * @param buf buffer containing the machine code
+ * @param size size of the buffer in bytes
+ */
+void
+stats_count (stats_t* stats, const uint8_t* buf, size_t size);
+
+/**
+ * Adds the counts of one table to another.
+ *
+ * @param dest statistics to add the counts to
+ * @param src statistics to be added
+ */
+void
+stats_merge (stats_t* dest, const stats_t* src);
+
+/**
+ * Writes the histograms of op codes, address modes, opcode bytes and
+ * instruction lengths, each sorted by decreasing count.
+ *
+ * @param stats statistics to be written
+ * @param dest stream to write the histograms to
+ */
+void
+stats_print (const stats_t* stats, FILE* dest);
+
+#endif //INC_65EMU2_STATS_H
@@ -0,0 +1,624 @@
+/**
+ * analysis.c
+ *
+ * Worklist dataflow over the instructions of each subroutine. The fact on
+ * entry of an instruction is the stack depth relative to the subroutine
+ * entry together with the registers known to be constant. Facts are merged
+ * by taking the larger depth and the registers constant on every path, so
+ * each instruction is only revisited when its fact changed, and depths are
+ * capped at the size of the stack so loops that keep pushing terminate.
+ *
+ * The per-address arrays are shared by all subroutines and tagged with the
+ * number of the pass that set them, so nothing has to be cleared between
+ * subroutines and the cost of a pass only depends on the code it reaches.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "analysis.h"
+
+#define DEPTH_LIMIT 256
+#define NONE UINT32_MAX
+
+#define A 0
+#define X 1
+#define Y 2
+
+/* Dataflow fact on entry of an instruction */
+typedef struct fact_t {
+    int16_t depth;                        /* Bytes pushed since the subroutine entry */
+    uint8_t known;                        /* REG_* with constant values */
+    uint8_t values[3];                    /* Constant values of A, X and Y */
+} fact_t;
+
+/* Call of a subroutine, linked with the other calls of the same caller */
+typedef struct call_t {
+    uint32_t callee;                      /* Index of the called subroutine */
+    int depth;                            /* Depth of the caller at the callee entry */
+    uint32_t next;                        /* Next call of the caller, or NONE */
+} call_t;
+
+typedef enum Visit {
+    VISIT_NONE,
+    VISIT_ACTIVE,
+    VISIT_DONE,
+} Visit;
+
+typedef struct context_t {
+    analysis_t* result;
+    const uint8_t* mem;
+    const variant_t* variant;
+    int failed;                           /* Set if an allocation failed */
+
+    fact_t* facts;                        /* Facts of the addresses of this pass */
+    uint32_t* stamps;                     /* Pass that set each fact */
+    uint32_t* queued;                     /* Pass an address is queued in */
+    uint16_t* worklist;
+    size_t pending;
+    uint16_t* visited;                    /* Addresses reached by this pass */
+    size_t visited_count;
+    uint32_t pass;
+
+    uint32_t* sub_index;                  /* Subroutine entered at each address */
+    int* local_depths;                    /* Depth without callees per subroutine */
+    uint32_t* first_calls;                /* First call made by each subroutine */
+    uint8_t* visits;                      /* Visit state of the depth search */
+    size_t sub_capacity;
+
+    call_t* calls;
+    size_t call_count;
+    size_t call_capacity;
+} context_t;
+
+static inline size_t
+next_capacity (size_t capacity)
+{
+  return capacity > 0 ? capacity * 2 : 64;
+}
+
+/* Returns the index of the subroutine at the address, adding it if needed */
+static uint32_t
+add_subroutine (context_t* ctx, uint16_t entry)
+{
+  analysis_t* result = ctx->result;
+
+  if (ctx->sub_index[entry] != NONE)
+    return ctx->sub_index[entry];
+
+  if (result->subroutine_count == ctx->sub_capacity) {
+    size_t const capacity = next_capacity (ctx->sub_capacity);
+    subroutine_t* subs = realloc (result->subroutines, capacity * sizeof (*subs));
+    if (subs != NULL)
+      result->subroutines = subs;
+    int* depths = realloc (ctx->local_depths, capacity * sizeof (*depths));
+    if (depths != NULL)
+      ctx->local_depths = depths;
+    uint32_t* calls = realloc (ctx->first_calls, capacity * sizeof (*calls));
+    if (calls != NULL)
+      ctx->first_calls = calls;
+    uint8_t* visits = realloc (ctx->visits, capacity * sizeof (*visits));
+    if (visits != NULL)
+      ctx->visits = visits;
+
+    if (subs == NULL || depths == NULL || calls == NULL || visits == NULL) {
+      ctx->failed = 1;
+      return NONE;
+    }
+    ctx->sub_capacity = capacity;
+  }
+
+  uint32_t const index = result->subroutine_count++;
+  subroutine_t sub = {entry, 0, 0};
+
+  result->subroutines[index] = sub;
+  ctx->local_depths[index] = 0;
+  ctx->first_calls[index] = NONE;
+  ctx->visits[index] = VISIT_NONE;
+  ctx->sub_index[entry] = index;
+  result->marks[entry] |= MARK_ENTRY;
+
+  return index;
+}
+
+static void
+add_call (context_t* ctx, uint32_t caller, uint32_t callee, int depth)
+{
+  if (callee == NONE)
+    return;
+
+  if (ctx->call_count == ctx->call_capacity) {
+    size_t const capacity = next_capacity (ctx->call_capacity);
+    call_t* calls = realloc (ctx->calls, capacity * sizeof (*calls));
+    if (calls == NULL) {
+      ctx->failed = 1;
+      return;
+    }
+    ctx->calls = calls;
+    ctx->call_capacity = capacity;
+  }
+
+  call_t const call = {callee, depth, ctx->first_calls[caller]};
+  ctx->first_calls[caller] = ctx->call_count;
+  ctx->calls[ctx->call_count++] = call;
+}
+
+static void
+note_depth (context_t* ctx, uint32_t index, int depth)
+{
+  if (ctx->local_depths[index] != DEPTH_UNBOUNDED && depth > ctx->local_depths[index])
+    ctx->local_depths[index] = depth;
+}
+
+static inline void
+set_register (fact_t* fact, int reg, uint8_t value)
+{
+  fact->known |= 1 << reg;
+  fact->values[reg] = value;
+}
+
+static inline void
+copy_register (fact_t* fact, int dest, int src)
+{
+  if (fact->known >> src & 1)
+    set_register (fact, dest, fact->values[src]);
+  else
+    fact->known &= ~(1 << dest);
+}
+
+static inline void
+add_register (fact_t* fact, int reg, int delta)
+{
+  if (fact->known >> reg & 1)
+    fact->values[reg] += delta;
+}
+
+/* Applies the effect of an instruction on the constant registers */
+static void
+propagate (fact_t* fact, const opcode_t* op, uint8_t operand)
+{
+  int const immediate = op->mode == IMMEDIATE;
+  int const acc_known = fact->known & REG_A;
+
+  switch (op->code) {
+    case LDA:
+    case LDX:
+    case LDY:
+      {
+        int const reg = op->code == LDA ? A : op->code == LDX ? X : Y;
+        if (immediate)
+          set_register (fact, reg, operand);
+        else
+          fact->known &= ~(1 << reg);
+      }
+      break;
+    case TAX:
+      copy_register (fact, X, A);
+      break;
+    case TAY:
+      copy_register (fact, Y, A);
+      break;
+    case TXA:
+      copy_register (fact, A, X);
+      break;
+    case TYA:
+      copy_register (fact, A, Y);
+      break;
+    case INX:
+      add_register (fact, X, 1);
+      break;
+    case DEX:
+      add_register (fact, X, -1);
+      break;
+    case INY:
+      add_register (fact, Y, 1);
+      break;
+    case DEY:
+      add_register (fact, Y, -1);
+      break;
+    case INC:
+    case DEC:
+      if (op->mode == ACCUMULATOR)
+        add_register (fact, A, op->code == INC ? 1 : -1);
+      break;
+    case AND:
+      if (immediate && operand == 0x00)
+        set_register (fact, A, 0x00);
+      else if (immediate && acc_known)
+        fact->values[A] &= operand;
+      else
+        fact->known &= ~REG_A;
+      break;
+    case ORA:
+      if (immediate && operand == 0xFF)
+        set_register (fact, A, 0xFF);
+      else if (immediate && acc_known)
+        fact->values[A] |= operand;
+      else
+        fact->known &= ~REG_A;
+      break;
+    case EOR:
+      if (immediate && acc_known)
+        fact->values[A] ^= operand;
+      else
+        fact->known &= ~REG_A;
+      break;
+    case ASL:
+      if (op->mode == ACCUMULATOR)
+        fact->values[A] <<= 1;
+      break;
+    case LSR:
+      if (op->mode == ACCUMULATOR)
+        fact->values[A] >>= 1;
+      break;
+    case ROL:
+    case ROR:
+      if (op->mode == ACCUMULATOR)
+        fact->known &= ~REG_A;
+      break;
+    case ADC:
+    case SBC:
+    case PLA:
+    case ALR:
+    case ANC:
+    case ARR:
+    case ISC:
+    case RLA:
+    case RRA:
+    case SLO:
+    case SRE:
+      fact->known &= ~REG_A;
+      break;
+    case ANE:
+    case LAS:
+    case LAX:
+    case LXA:
+      fact->known &= ~(REG_A | REG_X);
+      break;
+    case PLX:
+    case SBX:
+    case TSX:
+      fact->known &= ~REG_X;
+      break;
+    case PLY:
+      fact->known &= ~REG_Y;
+      break;
+    case BRK:
+    case JSR:
+      /* The called code may change any register */
+      fact->known = 0;
+      break;
+    default:
+      break;
+  }
+}
+
+static void
+merge (context_t* ctx, uint16_t addr, const fact_t* fact)
+{
+  fact_t* old = &ctx->facts[addr];
+  int changed = 0;
+
+  if (ctx->stamps[addr] != ctx->pass) {
+    *old = *fact;
+    ctx->stamps[addr] = ctx->pass;
+    ctx->visited[ctx->visited_count++] = addr;
+    changed = 1;
+  } else {
+    uint8_t known = old->known & fact->known;
+
+    for (int reg = A; reg <= Y; reg++) {
+      if (known >> reg & 1 && old->values[reg] != fact->values[reg])
+        known &= ~(1 << reg);
+    }
+
+    if (fact->depth > old->depth) {
+      old->depth = fact->depth;
+      changed = 1;
+    }
+
+    if (known != old->known) {
+      old->known = known;
+      changed = 1;
+    }
+  }
+
+  if (changed && ctx->queued[addr] != ctx->pass) {
+    ctx->queued[addr] = ctx->pass;
+    ctx->worklist[ctx->pending++] = addr;
+  }
+}
+
+/* Flows into a successor, which ends the pass if it enters another subroutine */
+static void
+follow (context_t* ctx, uint32_t index, uint16_t addr, const fact_t* fact)
+{
+  uint32_t const callee = ctx->sub_index[addr];
+
+  if (callee != NONE && callee != index)
+    add_call (ctx, index, callee, fact->depth);
+  else
+    merge (ctx, addr, fact);
+}
+
+static void
+step (context_t* ctx, uint32_t index, uint16_t addr)
+{
+  const uint8_t* mem = ctx->mem;
+  opcode_t const* op = &ctx->variant->opcodes[mem[addr]];
+  uint8_t const operand = mem[(uint16_t) (addr + 1)];
+  uint16_t const word = mem[(uint16_t) (addr + 2)] << 8 | operand;
+  uint16_t const next = addr + get_instruction_length (op);
+  uint16_t const target = next + (int8_t) operand;
+  fact_t out = ctx->facts[addr];
+
+  switch (op->code) {
+    case UNDEFINED_OP:
+      ctx->result->subroutines[index].flags |= SUB_STALLS;
+      return;
+    case PHA:
+    case PHP:
+    case PHX:
+    case PHY:
+      out.depth++;
+      note_depth (ctx, index, out.depth);
+      break;
+    case PLA:
+    case PLP:
+    case PLX:
+    case PLY:
+      out.depth--;
+      break;
+    case TXS:
+      ctx->result->subroutines[index].flags |= SUB_SETS_SP;
+      break;
+    case JSR:
+      add_call (ctx, index, add_subroutine (ctx, word), out.depth + 2);
+      break;
+    case BRK:
+      /* The handler is entered with the return address and status pushed */
+      note_depth (ctx, index, out.depth + 3);
+      break;
+    default:
+      break;
+  }
+
+  if (out.depth > DEPTH_LIMIT) {
+    ctx->local_depths[index] = DEPTH_UNBOUNDED;
+    out.depth = DEPTH_LIMIT;
+  }
+
+  propagate (&out, op, operand);
+
+  switch (op->code) {
+    case RTI:
+    case RTS:
+      break;
+    case JMP:
+      if (op->mode == ABSOLUTE)
+        follow (ctx, index, word, &out);
+      else
+        ctx->result->subroutines[index].flags |= SUB_INDIRECT;
+      break;
+    case BRK:
+      /* BRK returns behind its padding byte */
+      follow (ctx, index, addr + 2, &out);
+      break;
+    case BRA:
+      follow (ctx, index, target, &out);
+      break;
+    default:
+      if (op->mode == RELATIVE)
+        follow (ctx, index, target, &out);
+      follow (ctx, index, next, &out);
+  }
+}
+
+/* Records the facts of a pass, meeting them with those of earlier passes */
+static void
+publish (context_t* ctx)
+{
+  analysis_t* result = ctx->result;
+
+  for (size_t i = 0; i < ctx->visited_count; i++) {
+    uint16_t const addr = ctx->visited[i];
+    fact_t const* fact = &ctx->facts[addr];
+    opcode_t const* op = &ctx->variant->opcodes[ctx->mem[addr]];
+
+    if (op->code == UNDEFINED_OP)
+      continue;
+
+    if (!(result->marks[addr] & MARK_START)) {
+      result->marks[addr] |= MARK_START;
+      result->known[addr] = fact->known;
+      memcpy (result->values[addr], fact->values, sizeof (fact->values));
+    } else {
+      for (int reg = A; reg <= Y; reg++) {
+        if (result->values[addr][reg] != fact->values[reg])
+          result->known[addr] &= ~(1 << reg);
+      }
+      result->known[addr] &= fact->known;
+    }
+
+    for (unsigned int j = 0; j < get_instruction_length (op); j++)
+      result->marks[(uint16_t) (addr + j)] |= MARK_CODE;
+  }
+}
+
+static void
+analyze_subroutine (context_t* ctx, uint32_t index)
+{
+  fact_t const start = {0, 0, {0, 0, 0}};
+
+  ctx->pass++;
+  ctx->pending = 0;
+  ctx->visited_count = 0;
+  merge (ctx, ctx->result->subroutines[index].entry, &start);
+
+  while (ctx->pending > 0 && !ctx->failed) {
+    uint16_t const addr = ctx->worklist[--ctx->pending];
+
+    ctx->queued[addr] = 0;
+    step (ctx, index, addr);
+  }
+
+  publish (ctx);
+}
+
+/* Adds the deepest chain of callees to the depth of a subroutine */
+static int
+total_depth (context_t* ctx, uint32_t index)
+{
+  subroutine_t* sub = &ctx->result->subroutines[index];
+
+  switch (ctx->visits[index]) {
+    case VISIT_DONE:
+      return sub->depth;
+    case VISIT_ACTIVE:
+      sub->flags |= SUB_RECURSIVE;
+      return DEPTH_UNBOUNDED;
+    default:
+      break;
+  }
+
+  ctx->visits[index] = VISIT_ACTIVE;
+
+  int depth = ctx->local_depths[index];
+  for (uint32_t c = ctx->first_calls[index]; c != NONE && depth != DEPTH_UNBOUNDED;
+       c = ctx->calls[c].next) {
+    int const callee = total_depth (ctx, ctx->calls[c].callee);
+
+    if (callee == DEPTH_UNBOUNDED || ctx->calls[c].depth + callee > DEPTH_LIMIT)
+      depth = DEPTH_UNBOUNDED;
+    else if (ctx->calls[c].depth + callee > depth)
+      depth = ctx->calls[c].depth + callee;
+  }
+
+  sub->depth = depth;
+  ctx->visits[index] = VISIT_DONE;
+
+  return depth;
+}
+
+/* Tells whether a region decodes into whole instructions and is not a fill */
+static int
+decodes_as_code (const uint8_t* mem, const variant_t* variant, unsigned int first,
+                 unsigned int last)
+{
+  unsigned int addr = first;
+
+  while (addr <= last && mem[addr] == mem[first])
+    addr++;
+  if (addr > last)
+    return 0;
+
+  for (addr = first; addr <= last;) {
+    opcode_t const* op = &variant->opcodes[mem[addr]];
+
+    if (op->code == UNDEFINED_OP)
+      return 0;
+    addr += get_instruction_length (op);
+  }
+
+  return addr == last + 1;
+}
+
+static void
+find_regions (context_t* ctx)
+{
+  analysis_t* result = ctx->result;
+  size_t capacity = 0;
+
+  for (unsigned int addr = 0; addr < ANALYSIS_SPACE; addr++) {
+    if ((result->marks[addr] & (MARK_IMAGE | MARK_CODE)) != MARK_IMAGE)
+      continue;
+
+    unsigned int last = addr;
+    while (last + 1 < ANALYSIS_SPACE
+           && (result->marks[last + 1] & (MARK_IMAGE | MARK_CODE)) == MARK_IMAGE)
+      last++;
+
+    if (result->region_count == capacity) {
+      region_t* regions = realloc (result->regions,
+                                   next_capacity (capacity) * sizeof (*regions));
+      if (regions == NULL) {
+        ctx->failed = 1;
+        return;
+      }
+      result->regions = regions;
+      capacity = next_capacity (capacity);
+    }
+
+    region_t const region = {addr, last, decodes_as_code (ctx->mem, ctx->variant, addr, last)};
+    result->regions[result->region_count++] = region;
+    addr = last;
+  }
+}
+
+analysis_t*
+analyze (const uint8_t* mem, uint16_t load, size_t len,
+         const uint16_t* entries, size_t entry_count, const variant_t* variant)
+{
+  context_t ctx = {0};
+
+  ctx.result = calloc (1, sizeof (*ctx.result));
+  ctx.mem = mem;
+  ctx.variant = variant;
+  ctx.facts = malloc (ANALYSIS_SPACE * sizeof (*ctx.facts));
+  ctx.stamps = calloc (ANALYSIS_SPACE, sizeof (*ctx.stamps));
+  ctx.queued = calloc (ANALYSIS_SPACE, sizeof (*ctx.queued));
+  ctx.worklist = malloc (ANALYSIS_SPACE * sizeof (*ctx.worklist));
+  ctx.visited = malloc (ANALYSIS_SPACE * sizeof (*ctx.visited));
+  ctx.sub_index = malloc (ANALYSIS_SPACE * sizeof (*ctx.sub_index));
+
+  if (ctx.result == NULL || ctx.facts == NULL || ctx.stamps == NULL || ctx.queued == NULL
+      || ctx.worklist == NULL || ctx.visited == NULL || ctx.sub_index == NULL) {
+    ctx.failed = 1;
+  } else {
+    memset (ctx.sub_index, 0xFF, ANALYSIS_SPACE * sizeof (*ctx.sub_index));
+
+    for (size_t i = 0; i < len && i < ANALYSIS_SPACE; i++)
+      ctx.result->marks[(uint16_t) (load + i)] |= MARK_IMAGE;
+
+    for (size_t i = 0; i < entry_count; i++)
+      add_subroutine (&ctx, entries[i]);
+
+    /* Subroutines called from the ones analysed are appended to the list */
+    for (uint32_t i = 0; i < ctx.result->subroutine_count && !ctx.failed; i++)
+      analyze_subroutine (&ctx, i);
+
+    for (uint32_t i = 0; i < ctx.result->subroutine_count && !ctx.failed; i++)
+      total_depth (&ctx, i);
+
+    if (!ctx.failed)
+      find_regions (&ctx);
+  }
+
+  free (ctx.facts);
+  free (ctx.stamps);
+  free (ctx.queued);
+  free (ctx.worklist);
+  free (ctx.visited);
+  free (ctx.sub_index);
+  free (ctx.local_depths);
+  free (ctx.first_calls);
+  free (ctx.visits);
+  free (ctx.calls);
+
+  if (ctx.failed) {
+    analysis_free (ctx.result);
+    return NULL;
+  }
+
+  return ctx.result;
+}
+
+void
+analysis_free (analysis_t* analysis)
+{
+  if (analysis == NULL)
+    return;
+
+  free (analysis->subroutines);
+  free (analysis->regions);
+  free (analysis);
+}
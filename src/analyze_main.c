@@ -0,0 +1,183 @@
+/**
+ * analyze_main.c
+ *
+ * Command line front-end of the static analysis of MOS 6502 images.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "analysis.h"
+#include "cache.h"
+#include "disasm.h"
+#include "file.h"
+
+#define MAX_ENTRIES 64
+#define NMI_VECTOR 0xFFFA
+#define MAX_PATH 4096
+
+static void
+usage (const char* name)
+{
+  fprintf (stderr, "Usage: %s [-l LOAD] [-e ENTRY]... [-q] [-C DIR | -N] FILE\n", name);
+  exit (EXIT_FAILURE);
+}
+
+static void
+print_subroutines (const cache_t* cache)
+{
+  printf ("Subroutines:\n");
+  for (size_t i = 0; i < cache->symbol_count; i++) {
+    cache_symbol_t const* sub = &cache->symbols[i];
+
+    if (sub->depth == DEPTH_UNBOUNDED)
+      printf ("  $%04x  depth unbounded", sub->addr);
+    else
+      printf ("  $%04x  depth %d", sub->addr, sub->depth);
+
+    if (sub->flags & SUB_RECURSIVE)
+      printf (", recursive");
+    if (sub->flags & SUB_INDIRECT)
+      printf (", indirect jumps");
+    if (sub->flags & SUB_SETS_SP)
+      printf (", sets stack pointer");
+    if (sub->flags & SUB_STALLS)
+      printf (", undefined opcodes");
+    printf ("\n");
+  }
+}
+
+static void
+print_regions (const cache_t* cache)
+{
+  printf ("Unreachable:\n");
+  for (size_t i = 0; i < cache->region_count; i++) {
+    cache_region_t const* region = &cache->regions[i];
+
+    printf ("  $%04x-$%04x  %s\n", region->first, region->last,
+            region->code ? "code" : "data");
+  }
+}
+
+/* Prints an instruction with the registers known on entry */
+static void
+print_insn (const cache_insn_t* insn, const uint8_t* mem)
+{
+  static char const names[] = "AXY";
+  opcode_t const opcode = {insn->code, insn->mode};
+  uint16_t const addr = insn->addr;
+  uint8_t code[3] = {mem[addr], mem[(uint16_t) (addr + 1)], mem[(uint16_t) (addr + 2)]};
+
+  printf ("%04x:  ", addr);
+  disassemble_instruction (&opcode, code, stdout);
+
+  if (insn->known != 0) {
+    printf ("\t;");
+    for (int reg = 0; reg < 3; reg++) {
+      if (insn->known >> reg & 1)
+        printf (" %c=$%02x", names[reg], insn->values[reg]);
+    }
+  }
+  printf ("\n");
+}
+
+/* Lists the reachable instructions by basic block */
+static void
+print_listing (const cache_t* cache)
+{
+  printf ("Listing:\n");
+  for (size_t i = 0; i < cache->block_count; i++) {
+    cache_block_t const* block = &cache->blocks[i];
+
+    /* Subroutines are separated by a blank line */
+    if (cache->insns[block->first].marks & MARK_ENTRY && i > 0)
+      printf ("\n");
+
+    printf ("       ; block of %u instruction%s\n", (unsigned int) block->count,
+            block->count == 1 ? "" : "s");
+    for (uint32_t j = 0; j < block->count; j++)
+      print_insn (&cache->insns[block->first + j], cache->memory);
+  }
+}
+
+int
+main (int argc, char* argv[])
+{
+  unsigned long load = 0;
+  uint16_t entries[MAX_ENTRIES];
+  size_t entry_count = 0;
+  char dir[MAX_PATH];
+  int use_cache = cache_default_dir (dir, sizeof (dir)) != NULL;
+  int quiet = 0;
+  int opt;
+
+  while ((opt = getopt (argc, argv, "l:e:qC:N")) != -1) {
+    switch (opt) {
+      case 'l':
+        load = strtoul (optarg, NULL, 16) & UINT16_MAX;
+        break;
+      case 'e':
+        if (entry_count == MAX_ENTRIES)
+          usage (argv[0]);
+        entries[entry_count++] = strtoul (optarg, NULL, 16) & UINT16_MAX;
+        break;
+      case 'q':
+        quiet = 1;
+        break;
+      case 'C':
+        if (strlen (optarg) >= sizeof (dir))
+          usage (argv[0]);
+        strcpy (dir, optarg);
+        use_cache = 1;
+        break;
+      case 'N':
+        use_cache = 0;
+        break;
+      default:
+        usage (argv[0]);
+    }
+  }
+
+  if (optind != argc - 1)
+    usage (argv[0]);
+
+  uint8_t* buf;
+  size_t fsize = read_file (argv[optind], &buf);
+
+  if (fsize > ANALYSIS_SPACE - load)
+    fsize = ANALYSIS_SPACE - load;
+
+  /* Without explicit entries, start from the vectors if the image has them */
+  if (entry_count == 0) {
+    if (load + fsize == ANALYSIS_SPACE && load <= NMI_VECTOR) {
+      for (unsigned int vector = NMI_VECTOR; vector < ANALYSIS_SPACE; vector += 2)
+        entries[entry_count++] = buf[vector + 1 - load] << 8 | buf[vector - load];
+    } else {
+      entries[entry_count++] = load;
+    }
+  }
+
+  /* The analysis is only run when no cache file holds it yet */
+  uint64_t const key = cache_key (buf, fsize, load, entries, entry_count, VARIANT_NMOS);
+  cache_t cache;
+
+  if (!use_cache || cache_open (&cache, dir, key, buf, fsize, load) != 0) {
+    if (cache_build (&cache, key, buf, fsize, load, entries, entry_count, VARIANT_NMOS) != 0) {
+      fprintf (stderr, "Could not allocate analysis.\n");
+      exit (EXIT_FAILURE);
+    }
+
+    if (use_cache && cache_store (&cache, dir) != 0)
+      fprintf (stderr, "Could not write cache to %s.\n", dir);
+  }
+  free (buf);
+
+  print_subroutines (&cache);
+  print_regions (&cache);
+  if (!quiet)
+    print_listing (&cache);
+
+  cache_close (&cache);
+  exit (EXIT_SUCCESS);
+}
@@ -0,0 +1,455 @@
+/**
+ * cache.c
+ *
+ * Implementation of the content-addressed image cache. A cache is built as a
+ * single buffer with the same layout as its file, so a built cache and a
+ * mapped one are accessed the same way and storing it is a single write.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "analysis.h"
+#include "cache.h"
+
+#define CACHE_MAGIC "65E2CACH"
+#define CACHE_VERSION 1
+#define CACHE_SUFFIX ".e2c"
+#define CACHE_ALIGN 8
+
+#define FNV_OFFSET 0xCBF29CE484222325ULL
+#define FNV_PRIME  0x00000100000001B3ULL
+
+static const size_t record_sizes[SECTION_COUNT] = {
+    [SECTION_MEMORY] = 1,
+    [SECTION_INSNS] = sizeof (cache_insn_t),
+    [SECTION_BLOCKS] = sizeof (cache_block_t),
+    [SECTION_SYMBOLS] = sizeof (cache_symbol_t),
+    [SECTION_REGIONS] = sizeof (cache_region_t),
+};
+
+static uint64_t
+hash_bytes (uint64_t hash, const uint8_t* bytes, size_t len)
+{
+  for (size_t i = 0; i < len; i++)
+    hash = (hash ^ bytes[i]) * FNV_PRIME;
+
+  return hash;
+}
+
+uint64_t
+cache_key (const uint8_t* image, size_t len, uint16_t load,
+           const uint16_t* entries, size_t entry_count, Variant variant)
+{
+  uint8_t params[5] = {load, load >> 8, variant, CACHE_VERSION, entry_count};
+  uint64_t hash = hash_bytes (FNV_OFFSET, image, len);
+
+  hash = hash_bytes (hash, params, sizeof (params));
+  for (size_t i = 0; i < entry_count; i++) {
+    uint8_t const entry[2] = {entries[i], entries[i] >> 8};
+    hash = hash_bytes (hash, entry, sizeof (entry));
+  }
+
+  return hash;
+}
+
+char*
+cache_default_dir (char* dest, size_t size)
+{
+  char const* dir = getenv ("EMU2_CACHE_DIR");
+  char const* home = getenv ("HOME");
+  int written;
+
+  if (dir != NULL && *dir != '\0')
+    written = snprintf (dest, size, "%s", dir);
+  else if (home != NULL && *home != '\0')
+    written = snprintf (dest, size, "%s/.cache/65emu2", home);
+  else
+    return NULL;
+
+  return written > 0 && (size_t) written < size ? dest : NULL;
+}
+
+static int
+cache_path (char* dest, size_t size, const char* dir, uint64_t key)
+{
+  int const written = snprintf (dest, size, "%s/%016llx" CACHE_SUFFIX, dir,
+                                (unsigned long long) key);
+
+  return written > 0 && (size_t) written < size ? 0 : -1;
+}
+
+/*
+ * Checks that the records only hold values the tools can use as they are:
+ * decodable instructions and symbols in address order, blocks over the
+ * instructions and unreachable regions within the image
+ */
+static int
+check_records (const cache_t* cache)
+{
+  uint32_t const load = cache->header->load;
+  uint32_t const len = cache->header->len;
+
+  for (size_t i = 0; i < cache->insn_count; i++) {
+    cache_insn_t const* insn = &cache->insns[i];
+
+    if (insn->code >= OPCODE_SIZE || insn->mode >= ADDRESS_MODE_SIZE
+        || (i > 0 && insn->addr <= cache->insns[i - 1].addr))
+      return -1;
+  }
+
+  for (size_t i = 0; i < cache->block_count; i++) {
+    cache_block_t const* block = &cache->blocks[i];
+
+    if (block->count == 0 || block->first >= cache->insn_count
+        || block->count > cache->insn_count - block->first
+        || cache->insns[block->first].addr != block->addr)
+      return -1;
+  }
+
+  /* Subroutines may be called outside the image, in memory it does not cover */
+  for (size_t i = 0; i < cache->symbol_count; i++) {
+    cache_symbol_t const* symbol = &cache->symbols[i];
+
+    if (symbol->flags & ~(SUB_RECURSIVE | SUB_INDIRECT | SUB_SETS_SP | SUB_STALLS)
+        || symbol->depth < DEPTH_UNBOUNDED
+        || (i > 0 && symbol->addr <= cache->symbols[i - 1].addr))
+      return -1;
+  }
+
+  for (size_t i = 0; i < cache->region_count; i++) {
+    cache_region_t const* region = &cache->regions[i];
+
+    if (region->first < load || region->first > region->last
+        || region->last - load >= len)
+      return -1;
+  }
+
+  return 0;
+}
+
+/* Points the record arrays into the buffer, checking all bounds */
+static int
+set_views (cache_t* cache)
+{
+  cache_header_t const* header = (const cache_header_t*) cache->base;
+
+  if (cache->size < sizeof (*header) || memcmp (header->magic, CACHE_MAGIC, 8) != 0
+      || header->version != CACHE_VERSION)
+    return -1;
+
+  for (int i = 0; i < SECTION_COUNT; i++) {
+    cache_section_t const* section = &header->sections[i];
+
+    if (section->offset % CACHE_ALIGN != 0 || section->offset > cache->size
+        || section->count > (cache->size - section->offset) / record_sizes[i])
+      return -1;
+  }
+
+  if (header->sections[SECTION_MEMORY].count != CACHE_MEMORY_SIZE)
+    return -1;
+
+  cache->header = header;
+  cache->memory = cache->base + header->sections[SECTION_MEMORY].offset;
+  cache->insns = (const cache_insn_t*) (cache->base + header->sections[SECTION_INSNS].offset);
+  cache->insn_count = header->sections[SECTION_INSNS].count;
+  cache->blocks = (const cache_block_t*) (cache->base + header->sections[SECTION_BLOCKS].offset);
+  cache->block_count = header->sections[SECTION_BLOCKS].count;
+  cache->symbols = (const cache_symbol_t*) (cache->base + header->sections[SECTION_SYMBOLS].offset);
+  cache->symbol_count = header->sections[SECTION_SYMBOLS].count;
+  cache->regions = (const cache_region_t*) (cache->base + header->sections[SECTION_REGIONS].offset);
+  cache->region_count = header->sections[SECTION_REGIONS].count;
+
+  return check_records (cache);
+}
+
+int
+cache_open (cache_t* cache, const char* dir, uint64_t key, const uint8_t* image,
+            size_t len, uint16_t load)
+{
+  char path[4096];
+  struct stat st;
+
+  memset (cache, 0, sizeof (*cache));
+  if (cache_path (path, sizeof (path), dir, key) != 0)
+    return -1;
+
+  int const fd = open (path, O_RDONLY);
+  if (fd < 0)
+    return -1;
+
+  if (fstat (fd, &st) != 0 || st.st_size < (off_t) sizeof (cache_header_t)) {
+    close (fd);
+    return -1;
+  }
+
+  void* base = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close (fd);
+  if (base == MAP_FAILED)
+    return -1;
+
+  cache->base = base;
+  cache->size = st.st_size;
+  cache->mapped = 1;
+
+  /* The snapshot must hold the image, which also rules out hash collisions */
+  if (set_views (cache) != 0 || cache->header->key != key || cache->header->len != len
+      || cache->header->load != load || len > (size_t) (CACHE_MEMORY_SIZE - load)
+      || memcmp (cache->memory + load, image, len) != 0) {
+    cache_close (cache);
+    return -1;
+  }
+
+  return 0;
+}
+
+static int
+compare_symbols (const void* a, const void* b)
+{
+  cache_symbol_t const* x = a;
+  cache_symbol_t const* y = b;
+
+  return (x->addr > y->addr) - (x->addr < y->addr);
+}
+
+/* Marks the targets of the reachable jumps and branches as block leaders */
+static void
+find_leaders (const analysis_t* analysis, const uint8_t* mem,
+              const variant_t* variant, uint8_t* leaders)
+{
+  for (unsigned int addr = 0; addr < CACHE_MEMORY_SIZE; addr++) {
+    if (!(analysis->marks[addr] & MARK_START))
+      continue;
+
+    opcode_t const* op = &variant->opcodes[mem[addr]];
+    uint8_t const operand = mem[(uint16_t) (addr + 1)];
+
+    if (analysis->marks[addr] & MARK_ENTRY)
+      leaders[addr] = 1;
+
+    if (op->mode == RELATIVE)
+      leaders[(uint16_t) (addr + 2 + (int8_t) operand)] = 1;
+    else if ((op->code == JMP || op->code == JSR) && op->mode == ABSOLUTE)
+      leaders[mem[(uint16_t) (addr + 2)] << 8 | operand] = 1;
+  }
+}
+
+static int
+ends_block (const opcode_t* op)
+{
+  switch (op->code) {
+    case BRK:
+    case JMP:
+    case JSR:
+    case RTI:
+    case RTS:
+      return 1;
+    default:
+      return op->mode == RELATIVE;
+  }
+}
+
+int
+cache_build (cache_t* cache, uint64_t key, const uint8_t* image, size_t len,
+             uint16_t load, const uint16_t* entries, size_t entry_count,
+             Variant variant)
+{
+  variant_t const* tables = get_variant (variant);
+  size_t counts[SECTION_COUNT] = {[SECTION_MEMORY] = CACHE_MEMORY_SIZE};
+  size_t offsets[SECTION_COUNT];
+  uint8_t* leaders = calloc (CACHE_MEMORY_SIZE, 1);
+  uint8_t* mem = calloc (CACHE_MEMORY_SIZE, 1);
+  analysis_t* analysis = NULL;
+
+  memset (cache, 0, sizeof (*cache));
+  if (len > (size_t) (CACHE_MEMORY_SIZE - load))
+    len = CACHE_MEMORY_SIZE - load;
+
+  if (mem != NULL && leaders != NULL) {
+    memcpy (mem + load, image, len);
+    analysis = analyze (mem, load, len, entries, entry_count, tables);
+  }
+
+  if (analysis == NULL) {
+    free (leaders);
+    free (mem);
+    return -1;
+  }
+
+  /* Count the records first to lay out the whole file in one buffer */
+  find_leaders (analysis, mem, tables, leaders);
+  uint32_t next = 0;
+  int ended = 1;
+  for (unsigned int addr = 0; addr < CACHE_MEMORY_SIZE; addr++) {
+    if (!(analysis->marks[addr] & MARK_START))
+      continue;
+
+    opcode_t const* op = &tables->opcodes[mem[addr]];
+    if (ended || leaders[addr] || addr != next)
+      counts[SECTION_BLOCKS]++;
+    counts[SECTION_INSNS]++;
+    ended = ends_block (op);
+    next = addr + get_instruction_length (op);
+  }
+  counts[SECTION_SYMBOLS] = analysis->subroutine_count;
+  counts[SECTION_REGIONS] = analysis->region_count;
+
+  size_t size = sizeof (cache_header_t);
+  for (int i = 0; i < SECTION_COUNT; i++) {
+    size = (size + CACHE_ALIGN - 1) / CACHE_ALIGN * CACHE_ALIGN;
+    offsets[i] = size;
+    size += counts[i] * record_sizes[i];
+  }
+
+  cache->base = calloc (size, 1);
+  if (cache->base == NULL) {
+    analysis_free (analysis);
+    free (leaders);
+    free (mem);
+    return -1;
+  }
+  cache->size = size;
+
+  cache_header_t* header = (cache_header_t*) cache->base;
+  memcpy (header->magic, CACHE_MAGIC, 8);
+  header->version = CACHE_VERSION;
+  header->len = len;
+  header->key = key;
+  header->load = load;
+  header->variant = variant;
+  for (int i = 0; i < SECTION_COUNT; i++) {
+    header->sections[i].offset = offsets[i];
+    header->sections[i].count = counts[i];
+  }
+
+  memcpy (cache->base + offsets[SECTION_MEMORY], mem, CACHE_MEMORY_SIZE);
+
+  cache_insn_t* insns = (cache_insn_t*) (cache->base + offsets[SECTION_INSNS]);
+  cache_block_t* blocks = (cache_block_t*) (cache->base + offsets[SECTION_BLOCKS]);
+  cache_block_t* block = NULL;
+  uint32_t index = 0;
+  next = 0;
+  ended = 1;
+  for (unsigned int addr = 0; addr < CACHE_MEMORY_SIZE; addr++) {
+    if (!(analysis->marks[addr] & MARK_START))
+      continue;
+
+    opcode_t const* op = &tables->opcodes[mem[addr]];
+    cache_insn_t* insn = &insns[index];
+
+    insn->addr = addr;
+    insn->code = op->code;
+    insn->mode = op->mode;
+    insn->length = get_instruction_length (op);
+    insn->marks = analysis->marks[addr];
+    insn->known = analysis->known[addr];
+    memcpy (insn->values, analysis->values[addr], sizeof (insn->values));
+
+    if (ended || leaders[addr] || addr != next) {
+      block = block == NULL ? blocks : block + 1;
+      block->addr = addr;
+      block->first = index;
+    }
+    block->count++;
+
+    ended = ends_block (op);
+    next = addr + insn->length;
+    index++;
+  }
+
+  cache_symbol_t* symbols = (cache_symbol_t*) (cache->base + offsets[SECTION_SYMBOLS]);
+  for (size_t i = 0; i < analysis->subroutine_count; i++) {
+    subroutine_t const* sub = &analysis->subroutines[i];
+
+    symbols[i].addr = sub->entry;
+    symbols[i].flags = sub->flags;
+    symbols[i].depth = sub->depth;
+  }
+  qsort (symbols, analysis->subroutine_count, sizeof (*symbols), compare_symbols);
+
+  cache_region_t* regions = (cache_region_t*) (cache->base + offsets[SECTION_REGIONS]);
+  for (size_t i = 0; i < analysis->region_count; i++) {
+    regions[i].first = analysis->regions[i].first;
+    regions[i].last = analysis->regions[i].last;
+    regions[i].code = analysis->regions[i].code;
+  }
+
+  analysis_free (analysis);
+  free (leaders);
+  free (mem);
+
+  return set_views (cache);
+}
+
+/* Creates a directory and all of its missing parents */
+static int
+make_dirs (const char* dir)
+{
+  char path[4096];
+  size_t const len = strlen (dir);
+
+  if (len >= sizeof (path))
+    return -1;
+  memcpy (path, dir, len + 1);
+
+  for (size_t i = 1; i <= len; i++) {
+    if (path[i] != '/' && path[i] != '\0')
+      continue;
+
+    path[i] = '\0';
+    if (mkdir (path, 0777) != 0 && errno != EEXIST)
+      return -1;
+    path[i] = i < len ? '/' : '\0';
+  }
+
+  return 0;
+}
+
+int
+cache_store (const cache_t* cache, const char* dir)
+{
+  char path[4096];
+  char temp[4096];
+
+  if (cache_path (path, sizeof (path), dir, cache->header->key) != 0
+      || snprintf (temp, sizeof (temp), "%s.%ld.tmp", path, (long) getpid ()) >= (int) sizeof (temp)
+      || make_dirs (dir) != 0)
+    return -1;
+
+  int const fd = open (temp, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (fd < 0)
+    return -1;
+
+  size_t written = 0;
+  while (written < cache->size) {
+    ssize_t const n = write (fd, cache->base + written, cache->size - written);
+    if (n <= 0)
+      break;
+    written += n;
+  }
+
+  if (close (fd) != 0 || written != cache->size || rename (temp, path) != 0) {
+    unlink (temp);
+    return -1;
+  }
+
+  return 0;
+}
+
+void
+cache_close (cache_t* cache)
+{
+  if (cache->base != NULL) {
+    if (cache->mapped)
+      munmap (cache->base, cache->size);
+    else
+      free (cache->base);
+  }
+
+  memset (cache, 0, sizeof (*cache));
+}
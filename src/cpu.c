@@ -3,56 +3,699 @@
  */
 
 #include <stddef.h>
-#include "cpu.h"
+#include <pthread.h>
+#include "core.h"
 #include "opcode.h"
 
+#define INTERRUPT_CYCLES 7
+#define FUSED_LENGTH 6
+
+uint8_t adc_low[512];
+uint8_t adc_high[512];
+uint8_t sbc_low[512];
+uint8_t sbc_high[512];
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+
+static void
+build_tables (void)
+{
+  for (int carry = 0; carry < 2; carry++) {
+    for (int a = 0; a < 16; a++) {
+      for (int b = 0; b < 16; b++) {
+        int const index = carry << 8 | a << 4 | b;
+
+        /* In the low tables a and b are the low nibbles of the operands */
+        int low = a + b + carry;
+        if (low >= 0x0A)
+          low = ((low + 0x06) & 0x0F) + 0x10;
+        adc_low[index] = low;
+
+        low = a - b + carry - 1;
+        if (low < 0)
+          low = ((low - 0x06) & 0x0F) - 0x10;
+        sbc_low[index] = (low & 0x0F) | (low < 0 ? 0x10 : 0);
+
+        /* In the high tables they are the high nibbles, carry is the one
+         * out of the low nibble for ADC and the borrow for SBC */
+        int high = (a + b + carry) << 4;
+        uint8_t flags = (high & 0x80 ? BCD_NEGATIVE : 0)
+                        | (~(a ^ b) & (a ^ high >> 4) & 0x08 ? BCD_OVERFLOW : 0);
+        if (high >= 0xA0)
+          high += 0x60;
+        adc_high[index] = (high & 0xF0) | flags | (high >= 0x100 ? BCD_CARRY : 0);
+
+        high = a - b - carry;
+        if (high < 0)
+          high -= 0x06;
+        sbc_high[index] = (high & 0x0F) << 4;
+      }
+    }
+  }
+}
+
+void
+cpu_init (void)
+{
+  pthread_once (&tables_once, build_tables);
+}
+
+static inline uint16_t
+read_word (bus_t* bus, uint16_t addr)
+{
+  return read_byte (bus, addr + 1) << 8 | read_byte (bus, addr);
+}
+
+/* Reads a pointer from the zero page, wrapping around within it */
+static inline uint16_t
+read_zero_page_word (bus_t* bus, uint8_t addr)
+{
+  return read_byte (bus, (uint8_t) (addr + 1)) << 8 | read_byte (bus, addr);
+}
+
+static inline unsigned int
+branch (cpu_t* state, uint16_t target, int condition)
+{
+  if (!condition)
+    return 0;
+
+  unsigned int extra = (state->pc ^ target) & 0xFF00 ? 2 : 1;
+  state->pc = target;
+  return extra;
+}
+
+/*
+ * Stores of the unstable SHA, SHX, SHY and TAS instructions, which AND the
+ * value with the high byte of the base address plus one. If the indexing
+ * crossed a page, the value also replaces the high byte of the address.
+ */
+static inline void
+store_high (bus_t* bus, uint16_t addr, unsigned int crossed, uint16_t index,
+            uint8_t value)
+{
+  uint16_t const base = addr - index;
+
+  value &= (base >> 8) + 1;
+  if (crossed)
+    addr = value << 8 | (addr & 0xFF);
+
+  write_byte (bus, addr, value);
+}
+
+uint8_t
+cpu_get_status (const cpu_t* state)
+{
+  return state->s_negative << 7 | state->s_overflow << 6 | FLAG_RESERVED
+         | state->s_break << 4 | state->s_decimal << 3
+         | state->s_interrupt << 2 | state->s_zero << 1 | state->s_carry;
+}
+
 void
-tick (cpu_t* state, mem_t* mem)
+cpu_set_status (cpu_t* state, uint8_t status)
+{
+  state->s_negative = (status & FLAG_NEGATIVE) != 0;
+  state->s_overflow = (status & FLAG_OVERFLOW) != 0;
+  state->s_break = (status & FLAG_BREAK) != 0;
+  state->s_decimal = (status & FLAG_DECIMAL) != 0;
+  state->s_interrupt = (status & FLAG_INTERRUPT) != 0;
+  state->s_zero = (status & FLAG_ZERO) != 0;
+  state->s_carry = (status & FLAG_CARRY) != 0;
+}
+
+static unsigned int
+interrupt (cpu_t* state, bus_t* bus, uint16_t vector, uint8_t status)
+{
+  push (state, bus, state->pc >> 8);
+  push (state, bus, state->pc);
+  push (state, bus, status);
+  state->s_interrupt = 1;
+  if (state->variant->cmos)
+    state->s_decimal = 0;
+  state->pc = read_word (bus, vector);
+
+  return INTERRUPT_CYCLES;
+}
+
+unsigned int
+tick (cpu_t* state, bus_t* bus)
 {
-  uint8_t const* curr = mem[state->pc];
-  opcode_t const* op = decode_opcode (curr);
-  uint8_t const* operand = NULL;
-  uint8_t temp = 0;
+  if (state->nmi) {
+    state->nmi = 0;
+    state->interrupts++;
+    return interrupt (state, bus, NMI_VECTOR, cpu_get_status (state) & ~FLAG_BREAK);
+  }
+
+  if (state->irq && !state->s_interrupt) {
+    state->interrupts++;
+    return interrupt (state, bus, IRQ_VECTOR, cpu_get_status (state) & ~FLAG_BREAK);
+  }
 
+  variant_t const* variant = state->variant;
+  uint16_t const pc = state->pc;
+  uint8_t const byte = read_byte (bus, pc);
+  opcode_t const* op = &variant->opcodes[byte];
+  unsigned int cycles = variant->cycles[byte];
+  unsigned int crossed = 0;
+  uint16_t addr = 0;
+  uint16_t base;
+  uint8_t value;
+
+  /* Operand bytes are only fetched as needed, as they may be I/O registers */
   switch (op->mode) {
     case UNDEFINED_MODE:
-      return;
+    case ADDRESS_MODE_SIZE:
+      return 0;
     case IMPLICIT:
-      break;
     case ACCUMULATOR:
-      operand = &state->acc;
       break;
     case IMMEDIATE:
-      temp = *(curr + 1);
-      operand = &temp;
+      addr = pc + 1;
       break;
     case ZERO_PAGE:
-      operand = mem[*(curr + 1)];
+      addr = read_byte (bus, pc + 1);
       break;
     case ZERO_PAGE_X:
-      operand = mem[*(curr + 1) + state->idx_x % 0xFF];
+      addr = (uint8_t) (read_byte (bus, pc + 1) + state->idx_x);
       break;
     case ZERO_PAGE_Y:
-      operand = mem[*(curr + 1) + state->idx_y % 0xFF];
+      addr = (uint8_t) (read_byte (bus, pc + 1) + state->idx_y);
       break;
     case RELATIVE:
-      operand = *(mem + (int8_t) * (curr + 1));
+      addr = pc + 2 + (int8_t) read_byte (bus, pc + 1);
       break;
     case ABSOLUTE:
-      operand = mem[*(curr + 1) << 8 | *(curr + 2)];
+      addr = read_word (bus, pc + 1);
       break;
     case ABSOLUTE_X:
-      operand = mem[*(curr + 1) << 8 | *(curr + 2) + state->idx_x];
+      base = read_word (bus, pc + 1);
+      addr = base + state->idx_x;
+      crossed = (base ^ addr) >> 8 != 0;
       break;
     case ABSOLUTE_Y:
-      operand = mem[*(curr + 1) << 8 | *(curr + 2) + state->idx_y];
+      base = read_word (bus, pc + 1);
+      addr = base + state->idx_y;
+      crossed = (base ^ addr) >> 8 != 0;
       break;
     case INDIRECT:
-      operand = mem[*mem[*(curr + 1)]];
+      base = read_word (bus, pc + 1);
+      if (variant->cmos) {
+        addr = read_word (bus, base);
+      } else {
+        /* The NMOS 6502 does not carry into the high byte of the pointer */
+        addr = read_byte (bus, (base & 0xFF00) | (uint8_t) (base + 1)) << 8
+               | read_byte (bus, base);
+      }
       break;
     case INDEXED_INDIRECT:
+      addr = read_zero_page_word (bus, read_byte (bus, pc + 1) + state->idx_x);
       break;
     case INDIRECT_INDEXED:
+      base = read_zero_page_word (bus, read_byte (bus, pc + 1));
+      addr = base + state->idx_y;
+      crossed = (base ^ addr) >> 8 != 0;
+      break;
+    case ZERO_PAGE_INDIRECT:
+      addr = read_zero_page_word (bus, read_byte (bus, pc + 1));
+      break;
+    case ABSOLUTE_INDEXED_INDIRECT:
+      addr = read_word (bus, read_word (bus, pc + 1) + state->idx_x);
+      break;
+  }
+
+  state->pc = pc + get_instruction_length (op);
+
+  switch (op->code) {
+    case UNDEFINED_OP:
+      state->pc = pc;
+      return 0;
+    case ADC:
+      cycles += add (state, read_byte (bus, addr)) + crossed;
+      break;
+    case AND:
+      state->acc &= read_byte (bus, addr);
+      set_nz (state, state->acc);
+      cycles += crossed;
+      break;
+    case ASL:
+      if (op->mode == ACCUMULATOR) {
+        state->acc = shift_left (state, state->acc);
+      } else {
+        write_byte (bus, addr, shift_left (state, read_byte (bus, addr)));
+        cycles += crossed & variant->cmos;
+      }
+      break;
+    case BCC:
+      cycles += branch (state, addr, !state->s_carry);
+      break;
+    case BCS:
+      cycles += branch (state, addr, state->s_carry);
+      break;
+    case BEQ:
+      cycles += branch (state, addr, state->s_zero);
+      break;
+    case BIT:
+      value = read_byte (bus, addr);
+      /* BIT #imm of the 65C02 only affects the zero flag */
+      if (op->mode != IMMEDIATE) {
+        state->s_negative = value >> 7;
+        state->s_overflow = (value >> 6) & 1;
+      }
+      state->s_zero = (state->acc & value) == 0;
+      cycles += crossed;
+      break;
+    case BMI:
+      cycles += branch (state, addr, state->s_negative);
+      break;
+    case BNE:
+      cycles += branch (state, addr, !state->s_zero);
+      break;
+    case BPL:
+      cycles += branch (state, addr, !state->s_negative);
+      break;
+    case BRK:
+      /* BRK has a padding byte after the opcode */
+      state->pc = pc + 2;
+      interrupt (state, bus, IRQ_VECTOR, cpu_get_status (state) | FLAG_BREAK);
+      break;
+    case BVC:
+      cycles += branch (state, addr, !state->s_overflow);
+      break;
+    case BVS:
+      cycles += branch (state, addr, state->s_overflow);
+      break;
+    case CLC:
+      state->s_carry = 0;
+      break;
+    case CLD:
+      state->s_decimal = 0;
+      break;
+    case CLI:
+      state->s_interrupt = 0;
+      break;
+    case CLV:
+      state->s_overflow = 0;
+      break;
+    case CMP:
+      compare (state, state->acc, read_byte (bus, addr));
+      cycles += crossed;
+      break;
+    case CPX:
+      compare (state, state->idx_x, read_byte (bus, addr));
+      break;
+    case CPY:
+      compare (state, state->idx_y, read_byte (bus, addr));
+      break;
+    case DEC:
+      if (op->mode == ACCUMULATOR) {
+        set_nz (state, --state->acc);
+      } else {
+        value = read_byte (bus, addr) - 1;
+        write_byte (bus, addr, value);
+        set_nz (state, value);
+      }
+      break;
+    case DEX:
+      set_nz (state, --state->idx_x);
+      break;
+    case DEY:
+      set_nz (state, --state->idx_y);
+      break;
+    case EOR:
+      state->acc ^= read_byte (bus, addr);
+      set_nz (state, state->acc);
+      cycles += crossed;
+      break;
+    case INC:
+      if (op->mode == ACCUMULATOR) {
+        set_nz (state, ++state->acc);
+      } else {
+        value = read_byte (bus, addr) + 1;
+        write_byte (bus, addr, value);
+        set_nz (state, value);
+      }
+      break;
+    case INX:
+      set_nz (state, ++state->idx_x);
       break;
+    case INY:
+      set_nz (state, ++state->idx_y);
+      break;
+    case JMP:
+      state->pc = addr;
+      break;
+    case JSR:
+      /* The pushed return address points to the last byte of the JSR */
+      push (state, bus, (state->pc - 1) >> 8);
+      push (state, bus, state->pc - 1);
+      /*
+       * The high byte of the target is only fetched after the pushes, so a
+       * JSR in the stack page may jump through what it just overwrote
+       */
+      if ((uint16_t) (pc + 2) == (0x0100 | (uint8_t) (state->sp + 1))
+          || (uint16_t) (pc + 2) == (0x0100 | (uint8_t) (state->sp + 2)))
+        addr = (addr & 0xFF) | read_byte (bus, pc + 2) << 8;
+      state->pc = addr;
+      break;
+    case LDA:
+      state->acc = read_byte (bus, addr);
+      set_nz (state, state->acc);
+      cycles += crossed;
+      break;
+    case LDX:
+      state->idx_x = read_byte (bus, addr);
+      set_nz (state, state->idx_x);
+      cycles += crossed;
+      break;
+    case LDY:
+      state->idx_y = read_byte (bus, addr);
+      set_nz (state, state->idx_y);
+      cycles += crossed;
+      break;
+    case LSR:
+      if (op->mode == ACCUMULATOR) {
+        state->acc = shift_right (state, state->acc);
+      } else {
+        write_byte (bus, addr, shift_right (state, read_byte (bus, addr)));
+        cycles += crossed & variant->cmos;
+      }
+      break;
+    case NOP:
+      cycles += crossed;
+      break;
+    case ORA:
+      state->acc |= read_byte (bus, addr);
+      set_nz (state, state->acc);
+      cycles += crossed;
+      break;
+    case PHA:
+      push (state, bus, state->acc);
+      break;
+    case PHP:
+      push (state, bus, cpu_get_status (state) | FLAG_BREAK);
+      break;
+    case PLA:
+      state->acc = pull (state, bus);
+      set_nz (state, state->acc);
+      break;
+    case PLP:
+      cpu_set_status (state, pull (state, bus) & ~FLAG_BREAK);
+      break;
+    case ROL:
+      if (op->mode == ACCUMULATOR) {
+        state->acc = rotate_left (state, state->acc);
+      } else {
+        write_byte (bus, addr, rotate_left (state, read_byte (bus, addr)));
+        cycles += crossed & variant->cmos;
+      }
+      break;
+    case ROR:
+      if (op->mode == ACCUMULATOR) {
+        state->acc = rotate_right (state, state->acc);
+      } else {
+        write_byte (bus, addr, rotate_right (state, read_byte (bus, addr)));
+        cycles += crossed & variant->cmos;
+      }
+      break;
+    case RTI:
+      cpu_set_status (state, pull (state, bus) & ~FLAG_BREAK);
+      state->pc = pull (state, bus);
+      state->pc |= pull (state, bus) << 8;
+      break;
+    case RTS:
+      state->pc = pull (state, bus);
+      state->pc |= pull (state, bus) << 8;
+      state->pc += 1;
+      break;
+    case SBC:
+      cycles += subtract (state, read_byte (bus, addr)) + crossed;
+      break;
+    case SEC:
+      state->s_carry = 1;
+      break;
+    case SED:
+      state->s_decimal = 1;
+      break;
+    case SEI:
+      state->s_interrupt = 1;
+      break;
+    case STA:
+      write_byte (bus, addr, state->acc);
+      break;
+    case STX:
+      write_byte (bus, addr, state->idx_x);
+      break;
+    case STY:
+      write_byte (bus, addr, state->idx_y);
+      break;
+    case TAX:
+      state->idx_x = state->acc;
+      set_nz (state, state->idx_x);
+      break;
+    case TAY:
+      state->idx_y = state->acc;
+      set_nz (state, state->idx_y);
+      break;
+    case TSX:
+      state->idx_x = state->sp;
+      set_nz (state, state->idx_x);
+      break;
+    case TXA:
+      state->acc = state->idx_x;
+      set_nz (state, state->acc);
+      break;
+    case TXS:
+      state->sp = state->idx_x;
+      break;
+    case TYA:
+      state->acc = state->idx_y;
+      set_nz (state, state->acc);
+      break;
+    case ALR:
+      state->acc = shift_right (state, state->acc & read_byte (bus, addr));
+      break;
+    case ANC:
+      state->acc &= read_byte (bus, addr);
+      set_nz (state, state->acc);
+      state->s_carry = state->s_negative;
+      break;
+    case ANE:
+      /* The magic constant varies between chips, $EE is the common one */
+      state->acc = (state->acc | 0xEE) & state->idx_x & read_byte (bus, addr);
+      set_nz (state, state->acc);
+      break;
+    case ARR:
+      state->acc = rotate_right (state, state->acc & read_byte (bus, addr));
+      state->s_carry = (state->acc >> 6) & 1;
+      state->s_overflow = ((state->acc >> 6) ^ (state->acc >> 5)) & 1;
+      break;
+    case DCP:
+      value = read_byte (bus, addr) - 1;
+      write_byte (bus, addr, value);
+      compare (state, state->acc, value);
+      break;
+    case ISC:
+      value = read_byte (bus, addr) + 1;
+      write_byte (bus, addr, value);
+      subtract (state, value);
+      break;
+    case LAS:
+      state->acc = state->idx_x = state->sp = read_byte (bus, addr) & state->sp;
+      set_nz (state, state->acc);
+      cycles += crossed;
+      break;
+    case LAX:
+      state->acc = state->idx_x = read_byte (bus, addr);
+      set_nz (state, state->acc);
+      cycles += crossed;
+      break;
+    case LXA:
+      state->acc = state->idx_x = (state->acc | 0xEE) & read_byte (bus, addr);
+      set_nz (state, state->acc);
+      break;
+    case RLA:
+      value = rotate_left (state, read_byte (bus, addr));
+      write_byte (bus, addr, value);
+      state->acc &= value;
+      set_nz (state, state->acc);
+      break;
+    case RRA:
+      value = rotate_right (state, read_byte (bus, addr));
+      write_byte (bus, addr, value);
+      add (state, value);
+      break;
+    case SAX:
+      write_byte (bus, addr, state->acc & state->idx_x);
+      break;
+    case SBX:
+      value = read_byte (bus, addr);
+      state->s_carry = (state->acc & state->idx_x) >= value;
+      state->idx_x = (state->acc & state->idx_x) - value;
+      set_nz (state, state->idx_x);
+      break;
+    case SHA:
+      store_high (bus, addr, crossed, state->idx_y, state->acc & state->idx_x);
+      break;
+    case SHX:
+      store_high (bus, addr, crossed, state->idx_y, state->idx_x);
+      break;
+    case SHY:
+      store_high (bus, addr, crossed, state->idx_x, state->idx_y);
+      break;
+    case SLO:
+      value = shift_left (state, read_byte (bus, addr));
+      write_byte (bus, addr, value);
+      state->acc |= value;
+      set_nz (state, state->acc);
+      break;
+    case SRE:
+      value = shift_right (state, read_byte (bus, addr));
+      write_byte (bus, addr, value);
+      state->acc ^= value;
+      set_nz (state, state->acc);
+      break;
+    case TAS:
+      state->sp = state->acc & state->idx_x;
+      store_high (bus, addr, crossed, state->idx_y, state->sp);
+      break;
+    case BRA:
+      cycles += branch (state, addr, 1);
+      break;
+    case PHX:
+      push (state, bus, state->idx_x);
+      break;
+    case PHY:
+      push (state, bus, state->idx_y);
+      break;
+    case PLX:
+      state->idx_x = pull (state, bus);
+      set_nz (state, state->idx_x);
+      break;
+    case PLY:
+      state->idx_y = pull (state, bus);
+      set_nz (state, state->idx_y);
+      break;
+    case STZ:
+      write_byte (bus, addr, 0);
+      break;
+    case TRB:
+      value = read_byte (bus, addr);
+      state->s_zero = (state->acc & value) == 0;
+      write_byte (bus, addr, value & ~state->acc);
+      break;
+    case TSB:
+      value = read_byte (bus, addr);
+      state->s_zero = (state->acc & value) == 0;
+      write_byte (bus, addr, value | state->acc);
+      break;
+    case OPCODE_SIZE:
+      return 0;
   }
+
+  state->instructions++;
+  return cycles;
+}
+
+/*
+ * The fused sequences only start without a pending interrupt and never read
+ * from an I/O page before their last instruction, so no interrupt can become
+ * pending within them and taking it after the sequence is exact. A store to
+ * an I/O page is fine as it is the final access.
+ */
+unsigned int
+tick_fused (cpu_t* state, bus_t* bus, uint64_t budget)
+{
+  uint16_t const pc = state->pc;
+  uint8_t const* cycles = state->variant->cycles;
+  uint8_t const* flags = bus->page_flags;
+  uint8_t const* code = bus->pages[pc >> 8] + (pc & 0xFF);
+  uint8_t copy[FUSED_LENGTH];
+  uint16_t addr;
+  unsigned int taken;
+
+  if (state->nmi || (state->irq && !state->s_interrupt)
+      || (flags[pc >> 8] | flags[(uint16_t) (pc + FUSED_LENGTH - 1) >> 8]) & PAGE_TRAP)
+    return tick (state, bus);
+
+  /* Sequences crossing into the next page are gathered first */
+  if ((pc & 0xFF) > BUS_PAGE_SIZE - FUSED_LENGTH) {
+    for (int i = 0; i < FUSED_LENGTH; i++)
+      copy[i] = bus_peek (bus, pc + i);
+    code = copy;
+  }
+
+  switch (code[0]) {
+    case 0x18:
+      /* CLC; ADC #imm */
+      if (code[1] != 0x69 || budget <= cycles[0x18])
+        break;
+
+      state->s_carry = 0;
+      state->pc = pc + 3;
+      state->instructions += 2;
+      state->fused += 2;
+      return cycles[0x18] + cycles[0x69] + add (state, code[2]);
+    case 0xA5:
+    case 0xA9:
+    case 0xAD:
+      {
+        /* LDA #imm, zp or abs; STA zp or abs */
+        uint8_t const load = code[0];
+        unsigned int const next = load == 0xAD ? 3 : 2;
+        uint8_t const store = code[next];
+
+        if ((store != 0x85 && store != 0x8D) || budget <= cycles[load])
+          break;
+
+        if (load == 0xA9) {
+          state->acc = code[1];
+        } else {
+          addr = code[1];
+          if (load == 0xAD)
+            addr |= code[2] << 8;
+          if (flags[addr >> 8] & PAGE_TRAP)
+            break;
+          state->acc = bus->pages[addr >> 8][addr & 0xFF];
+        }
+        set_nz (state, state->acc);
+
+        addr = code[next + 1];
+        if (store == 0x8D)
+          addr |= code[next + 2] << 8;
+        state->pc = pc + next + (store == 0x8D ? 3 : 2);
+        state->instructions += 2;
+        state->fused += 2;
+        write_byte (bus, addr, state->acc);
+
+        return cycles[load] + cycles[store];
+      }
+    case 0xE8:
+      /* INX; CPX #imm; BNE rel */
+      if (code[1] != 0xE0 || code[3] != 0xD0
+          || budget <= (uint64_t) cycles[0xE8] + cycles[0xE0])
+        break;
+
+      set_nz (state, ++state->idx_x);
+      compare (state, state->idx_x, code[2]);
+      state->pc = pc + 5;
+      state->instructions += 3;
+      state->fused += 3;
+      taken = cycles[0xE8] + cycles[0xE0] + cycles[0xD0];
+      return taken + branch (state, state->pc + (int8_t) code[4],
+                             !state->s_zero);
+    case 0x88:
+      /* DEY; BNE rel */
+      if (code[1] != 0xD0 || budget <= cycles[0x88])
+        break;
+
+      set_nz (state, --state->idx_y);
+      state->pc = pc + 3;
+      state->instructions += 2;
+      state->fused += 2;
+      taken = cycles[0x88] + cycles[0xD0];
+      return taken + branch (state, state->pc + (int8_t) code[2],
+                             !state->s_zero);
+    default:
+      break;
+  }
+
+  return tick (state, bus);
 }
@@ -0,0 +1,686 @@
+/**
+ * cycle.c
+ *
+ * The bus cycles of every instruction follow the NMOS 6502 as documented in
+ * the classic 64doc timing tables. Each call performs the access of the
+ * cycle numbered by cycle_t.step, so an instruction can be suspended after
+ * any of them.
+ */
+
+#include "core.h"
+#include "cycle.h"
+
+/* How an instruction accesses its effective address */
+typedef enum Access {
+    ACCESS_NONE,
+    ACCESS_READ,
+    ACCESS_WRITE,
+    ACCESS_MODIFY,
+} Access;
+
+static const uint8_t accesses[OPCODE_SIZE] = {
+    [ADC] = ACCESS_READ, [AND] = ACCESS_READ, [BIT] = ACCESS_READ,
+    [CMP] = ACCESS_READ, [CPX] = ACCESS_READ, [CPY] = ACCESS_READ,
+    [EOR] = ACCESS_READ, [LDA] = ACCESS_READ, [LDX] = ACCESS_READ,
+    [LDY] = ACCESS_READ, [NOP] = ACCESS_READ, [ORA] = ACCESS_READ,
+    [SBC] = ACCESS_READ, [ALR] = ACCESS_READ, [ANC] = ACCESS_READ,
+    [ANE] = ACCESS_READ, [ARR] = ACCESS_READ, [LAS] = ACCESS_READ,
+    [LAX] = ACCESS_READ, [LXA] = ACCESS_READ, [SBX] = ACCESS_READ,
+
+    [STA] = ACCESS_WRITE, [STX] = ACCESS_WRITE, [STY] = ACCESS_WRITE,
+    [SAX] = ACCESS_WRITE, [SHA] = ACCESS_WRITE, [SHX] = ACCESS_WRITE,
+    [SHY] = ACCESS_WRITE, [TAS] = ACCESS_WRITE,
+
+    [ASL] = ACCESS_MODIFY, [DEC] = ACCESS_MODIFY, [INC] = ACCESS_MODIFY,
+    [LSR] = ACCESS_MODIFY, [ROL] = ACCESS_MODIFY, [ROR] = ACCESS_MODIFY,
+    [DCP] = ACCESS_MODIFY, [ISC] = ACCESS_MODIFY, [RLA] = ACCESS_MODIFY,
+    [RRA] = ACCESS_MODIFY, [SLO] = ACCESS_MODIFY, [SRE] = ACCESS_MODIFY,
+};
+
+static void
+execute_implied (cpu_t* state, OpCode code)
+{
+  switch (code) {
+    case CLC:
+      state->s_carry = 0;
+      break;
+    case CLD:
+      state->s_decimal = 0;
+      break;
+    case CLI:
+      state->s_interrupt = 0;
+      break;
+    case CLV:
+      state->s_overflow = 0;
+      break;
+    case DEX:
+      set_nz (state, --state->idx_x);
+      break;
+    case DEY:
+      set_nz (state, --state->idx_y);
+      break;
+    case INX:
+      set_nz (state, ++state->idx_x);
+      break;
+    case INY:
+      set_nz (state, ++state->idx_y);
+      break;
+    case SEC:
+      state->s_carry = 1;
+      break;
+    case SED:
+      state->s_decimal = 1;
+      break;
+    case SEI:
+      state->s_interrupt = 1;
+      break;
+    case TAX:
+      state->idx_x = state->acc;
+      set_nz (state, state->idx_x);
+      break;
+    case TAY:
+      state->idx_y = state->acc;
+      set_nz (state, state->idx_y);
+      break;
+    case TSX:
+      state->idx_x = state->sp;
+      set_nz (state, state->idx_x);
+      break;
+    case TXA:
+      state->acc = state->idx_x;
+      set_nz (state, state->acc);
+      break;
+    case TXS:
+      state->sp = state->idx_x;
+      break;
+    case TYA:
+      state->acc = state->idx_y;
+      set_nz (state, state->acc);
+      break;
+    default:
+      break;
+  }
+}
+
+static void
+execute_read (cpu_t* state, OpCode code, uint8_t value)
+{
+  switch (code) {
+    case ADC:
+      add (state, value);
+      break;
+    case AND:
+      state->acc &= value;
+      set_nz (state, state->acc);
+      break;
+    case BIT:
+      state->s_negative = value >> 7;
+      state->s_overflow = (value >> 6) & 1;
+      state->s_zero = (state->acc & value) == 0;
+      break;
+    case CMP:
+      compare (state, state->acc, value);
+      break;
+    case CPX:
+      compare (state, state->idx_x, value);
+      break;
+    case CPY:
+      compare (state, state->idx_y, value);
+      break;
+    case EOR:
+      state->acc ^= value;
+      set_nz (state, state->acc);
+      break;
+    case LDA:
+      state->acc = value;
+      set_nz (state, state->acc);
+      break;
+    case LDX:
+      state->idx_x = value;
+      set_nz (state, state->idx_x);
+      break;
+    case LDY:
+      state->idx_y = value;
+      set_nz (state, state->idx_y);
+      break;
+    case ORA:
+      state->acc |= value;
+      set_nz (state, state->acc);
+      break;
+    case SBC:
+      subtract (state, value);
+      break;
+    case ALR:
+      state->acc = shift_right (state, state->acc & value);
+      break;
+    case ANC:
+      state->acc &= value;
+      set_nz (state, state->acc);
+      state->s_carry = state->s_negative;
+      break;
+    case ANE:
+      state->acc = (state->acc | 0xEE) & state->idx_x & value;
+      set_nz (state, state->acc);
+      break;
+    case ARR:
+      state->acc = rotate_right (state, state->acc & value);
+      state->s_carry = (state->acc >> 6) & 1;
+      state->s_overflow = ((state->acc >> 6) ^ (state->acc >> 5)) & 1;
+      break;
+    case LAS:
+      state->acc = state->idx_x = state->sp = value & state->sp;
+      set_nz (state, state->acc);
+      break;
+    case LAX:
+      state->acc = state->idx_x = value;
+      set_nz (state, state->acc);
+      break;
+    case LXA:
+      state->acc = state->idx_x = (state->acc | 0xEE) & value;
+      set_nz (state, state->acc);
+      break;
+    case SBX:
+      state->s_carry = (state->acc & state->idx_x) >= value;
+      state->idx_x = (state->acc & state->idx_x) - value;
+      set_nz (state, state->idx_x);
+      break;
+    default:
+      break;
+  }
+}
+
+/* Returns the value written back by a read-modify-write instruction */
+static uint8_t
+execute_modify (cpu_t* state, OpCode code, uint8_t value)
+{
+  switch (code) {
+    case ASL:
+      return shift_left (state, value);
+    case LSR:
+      return shift_right (state, value);
+    case ROL:
+      return rotate_left (state, value);
+    case ROR:
+      return rotate_right (state, value);
+    case DEC:
+      set_nz (state, --value);
+      return value;
+    case INC:
+      set_nz (state, ++value);
+      return value;
+    case DCP:
+      compare (state, state->acc, --value);
+      return value;
+    case ISC:
+      subtract (state, ++value);
+      return value;
+    case RLA:
+      value = rotate_left (state, value);
+      state->acc &= value;
+      set_nz (state, state->acc);
+      return value;
+    case RRA:
+      value = rotate_right (state, value);
+      add (state, value);
+      return value;
+    case SLO:
+      value = shift_left (state, value);
+      state->acc |= value;
+      set_nz (state, state->acc);
+      return value;
+    case SRE:
+      value = shift_right (state, value);
+      state->acc ^= value;
+      set_nz (state, state->acc);
+      return value;
+    default:
+      return value;
+  }
+}
+
+static void
+execute_write (cpu_t* state, const cycle_t* cycle, bus_t* bus, OpCode code)
+{
+  uint16_t addr = cycle->addr;
+  uint8_t value;
+
+  switch (code) {
+    case STA:
+      write_byte (bus, addr, state->acc);
+      return;
+    case STX:
+      write_byte (bus, addr, state->idx_x);
+      return;
+    case STY:
+      write_byte (bus, addr, state->idx_y);
+      return;
+    case SAX:
+      write_byte (bus, addr, state->acc & state->idx_x);
+      return;
+    case SHA:
+      value = state->acc & state->idx_x;
+      break;
+    case SHX:
+      value = state->idx_x;
+      break;
+    case SHY:
+      value = state->idx_y;
+      break;
+    case TAS:
+      value = state->sp = state->acc & state->idx_x;
+      break;
+    default:
+      return;
+  }
+
+  /* The unstable stores AND the value with the base high byte plus one */
+  value &= (cycle->base >> 8) + 1;
+  if ((cycle->base ^ addr) & 0xFF00)
+    addr = value << 8 | (addr & 0xFF);
+
+  write_byte (bus, addr, value);
+}
+
+static int
+branch_taken (const cpu_t* state, OpCode code)
+{
+  switch (code) {
+    case BCC:
+      return !state->s_carry;
+    case BCS:
+      return state->s_carry;
+    case BEQ:
+      return state->s_zero;
+    case BMI:
+      return state->s_negative;
+    case BNE:
+      return !state->s_zero;
+    case BPL:
+      return !state->s_negative;
+    case BVC:
+      return !state->s_overflow;
+    case BVS:
+      return state->s_overflow;
+    default:
+      return 0;
+  }
+}
+
+/*
+ * The cycle functions below return non-zero after the last cycle of the
+ * instruction.
+ */
+
+static int
+branch_cycle (cpu_t* state, cycle_t* cycle, bus_t* bus, OpCode code)
+{
+  switch (cycle->step) {
+    case 1:
+      cycle->data = read_byte (bus, state->pc++);
+      return !branch_taken (state, code);
+    case 2:
+      /* The next opcode is read while the low byte of the target is added */
+      read_byte (bus, state->pc);
+      cycle->addr = state->pc + (int8_t) cycle->data;
+      state->pc = (state->pc & 0xFF00) | (cycle->addr & 0xFF);
+      return state->pc == cycle->addr;
+    default:
+      read_byte (bus, state->pc);
+      state->pc = cycle->addr;
+      return 1;
+  }
+}
+
+/* Cycles 2 to 6 of BRK and of entering an interrupt */
+static int
+interrupt_cycle (cpu_t* state, cycle_t* cycle, bus_t* bus, uint16_t vector,
+                 uint8_t flags)
+{
+  switch (cycle->step) {
+    case 2:
+      push (state, bus, state->pc >> 8);
+      return 0;
+    case 3:
+      push (state, bus, state->pc);
+      return 0;
+    case 4:
+      push (state, bus, (cpu_get_status (state) & ~FLAG_BREAK) | flags);
+      return 0;
+    case 5:
+      cycle->addr = read_byte (bus, vector);
+      state->s_interrupt = 1;
+      return 0;
+    default:
+      state->pc = read_byte (bus, vector + 1) << 8 | cycle->addr;
+      return 1;
+  }
+}
+
+/* Access cycles of an instruction once its effective address is known */
+static int
+access_cycle (cpu_t* state, cycle_t* cycle, bus_t* bus, OpCode code,
+              unsigned int phase)
+{
+  switch (accesses[code]) {
+    case ACCESS_READ:
+      execute_read (state, code, read_byte (bus, cycle->addr));
+      return 1;
+    case ACCESS_WRITE:
+      execute_write (state, cycle, bus, code);
+      return 1;
+    case ACCESS_MODIFY:
+      switch (phase) {
+        case 0:
+          cycle->data = read_byte (bus, cycle->addr);
+          return 0;
+        case 1:
+          /* The unmodified value is written back while the ALU works */
+          write_byte (bus, cycle->addr, cycle->data);
+          cycle->data = execute_modify (state, code, cycle->data);
+          return 0;
+        default:
+          write_byte (bus, cycle->addr, cycle->data);
+          return 1;
+      }
+    default:
+      return 1;
+  }
+}
+
+/*
+ * Reads from the effective address before the carry into its high byte is
+ * applied. For a read without a page crossing this already is the final
+ * access, otherwise it is a dummy read.
+ */
+static int
+unfixed_cycle (cpu_t* state, cycle_t* cycle, bus_t* bus, OpCode code)
+{
+  uint8_t const value = read_byte (bus, (cycle->base & 0xFF00) | (cycle->addr & 0xFF));
+
+  if (accesses[code] != ACCESS_READ || (cycle->base ^ cycle->addr) & 0xFF00)
+    return 0;
+
+  execute_read (state, code, value);
+  return 1;
+}
+
+static int
+memory_cycle (cpu_t* state, cycle_t* cycle, bus_t* bus, const opcode_t* op)
+{
+  unsigned int const step = cycle->step;
+  uint8_t index;
+
+  switch (op->mode) {
+    case ZERO_PAGE:
+      if (step == 1) {
+        cycle->addr = read_byte (bus, state->pc++);
+        return 0;
+      }
+      return access_cycle (state, cycle, bus, op->code, step - 2);
+    case ZERO_PAGE_X:
+    case ZERO_PAGE_Y:
+      index = op->mode == ZERO_PAGE_X ? state->idx_x : state->idx_y;
+      switch (step) {
+        case 1:
+          cycle->addr = read_byte (bus, state->pc++);
+          return 0;
+        case 2:
+          read_byte (bus, cycle->addr);
+          cycle->addr = (uint8_t) (cycle->addr + index);
+          return 0;
+        default:
+          return access_cycle (state, cycle, bus, op->code, step - 3);
+      }
+    case ABSOLUTE:
+      switch (step) {
+        case 1:
+          cycle->addr = read_byte (bus, state->pc++);
+          return 0;
+        case 2:
+          cycle->addr |= read_byte (bus, state->pc++) << 8;
+          return 0;
+        default:
+          return access_cycle (state, cycle, bus, op->code, step - 3);
+      }
+    case ABSOLUTE_X:
+    case ABSOLUTE_Y:
+      index = op->mode == ABSOLUTE_X ? state->idx_x : state->idx_y;
+      switch (step) {
+        case 1:
+          cycle->base = read_byte (bus, state->pc++);
+          return 0;
+        case 2:
+          cycle->base |= read_byte (bus, state->pc++) << 8;
+          cycle->addr = cycle->base + index;
+          return 0;
+        case 3:
+          return unfixed_cycle (state, cycle, bus, op->code);
+        default:
+          return access_cycle (state, cycle, bus, op->code, step - 4);
+      }
+    case INDEXED_INDIRECT:
+      switch (step) {
+        case 1:
+          cycle->base = read_byte (bus, state->pc++);
+          return 0;
+        case 2:
+          read_byte (bus, cycle->base);
+          cycle->base = (uint8_t) (cycle->base + state->idx_x);
+          return 0;
+        case 3:
+          cycle->addr = read_byte (bus, cycle->base);
+          return 0;
+        case 4:
+          cycle->addr |= read_byte (bus, (uint8_t) (cycle->base + 1)) << 8;
+          return 0;
+        default:
+          return access_cycle (state, cycle, bus, op->code, step - 5);
+      }
+    case INDIRECT_INDEXED:
+      switch (step) {
+        case 1:
+          cycle->data = read_byte (bus, state->pc++);
+          return 0;
+        case 2:
+          cycle->base = read_byte (bus, cycle->data);
+          return 0;
+        case 3:
+          cycle->base |= read_byte (bus, (uint8_t) (cycle->data + 1)) << 8;
+          cycle->addr = cycle->base + state->idx_y;
+          return 0;
+        case 4:
+          return unfixed_cycle (state, cycle, bus, op->code);
+        default:
+          return access_cycle (state, cycle, bus, op->code, step - 5);
+      }
+    default:
+      return 1;
+  }
+}
+
+static int
+execute_cycle (cpu_t* state, cycle_t* cycle, bus_t* bus)
+{
+  opcode_t const* op = &state->variant->opcodes[cycle->opcode];
+  unsigned int const step = cycle->step;
+
+  switch (op->code) {
+    case BRK:
+      /* BRK skips a padding byte after the opcode */
+      if (step == 1) {
+        read_byte (bus, state->pc++);
+        return 0;
+      }
+      return interrupt_cycle (state, cycle, bus, IRQ_VECTOR, FLAG_BREAK);
+    case JSR:
+      switch (step) {
+        case 1:
+          cycle->addr = read_byte (bus, state->pc++);
+          return 0;
+        case 2:
+          read_byte (bus, STACK_BASE | state->sp);
+          return 0;
+        case 3:
+          push (state, bus, state->pc >> 8);
+          return 0;
+        case 4:
+          push (state, bus, state->pc);
+          return 0;
+        default:
+          state->pc = read_byte (bus, state->pc) << 8 | cycle->addr;
+          return 1;
+      }
+    case RTI:
+    case RTS:
+      switch (step) {
+        case 1:
+          read_byte (bus, state->pc);
+          return 0;
+        case 2:
+          read_byte (bus, STACK_BASE | state->sp);
+          return 0;
+        case 3:
+          if (op->code == RTI) {
+            cpu_set_status (state, pull (state, bus) & ~FLAG_BREAK);
+            return 0;
+          }
+          cycle->addr = pull (state, bus);
+          return 0;
+        case 4:
+          if (op->code == RTI) {
+            cycle->addr = pull (state, bus);
+            return 0;
+          }
+          cycle->addr |= pull (state, bus) << 8;
+          return 0;
+        default:
+          if (op->code == RTI) {
+            state->pc = pull (state, bus) << 8 | cycle->addr;
+            return 1;
+          }
+          /* The pulled address points to the last byte of the JSR */
+          read_byte (bus, cycle->addr);
+          state->pc = cycle->addr + 1;
+          return 1;
+      }
+    case PHA:
+    case PHP:
+      if (step == 1) {
+        read_byte (bus, state->pc);
+        return 0;
+      }
+      push (state, bus, op->code == PHA ? state->acc : cpu_get_status (state) | FLAG_BREAK);
+      return 1;
+    case PLA:
+    case PLP:
+      switch (step) {
+        case 1:
+          read_byte (bus, state->pc);
+          return 0;
+        case 2:
+          read_byte (bus, STACK_BASE | state->sp);
+          return 0;
+        default:
+          if (op->code == PLA) {
+            state->acc = pull (state, bus);
+            set_nz (state, state->acc);
+          } else {
+            cpu_set_status (state, pull (state, bus) & ~FLAG_BREAK);
+          }
+          return 1;
+      }
+    case JMP:
+      switch (step) {
+        case 1:
+          cycle->base = read_byte (bus, state->pc++);
+          return 0;
+        case 2:
+          cycle->base |= read_byte (bus, state->pc) << 8;
+          if (op->mode == ABSOLUTE) {
+            state->pc = cycle->base;
+            return 1;
+          }
+          return 0;
+        case 3:
+          cycle->addr = read_byte (bus, cycle->base);
+          return 0;
+        default:
+          /* The NMOS 6502 does not carry into the high byte of the pointer */
+          state->pc = read_byte (bus, (cycle->base & 0xFF00) | (uint8_t) (cycle->base + 1)) << 8
+                      | cycle->addr;
+          return 1;
+      }
+    default:
+      break;
+  }
+
+  switch (op->mode) {
+    case IMPLICIT:
+    case ACCUMULATOR:
+      /* Instructions without operand still read the byte after the opcode */
+      read_byte (bus, state->pc);
+      if (op->mode == ACCUMULATOR)
+        state->acc = execute_modify (state, op->code, state->acc);
+      else
+        execute_implied (state, op->code);
+      return 1;
+    case IMMEDIATE:
+      execute_read (state, op->code, read_byte (bus, state->pc++));
+      return 1;
+    case RELATIVE:
+      return branch_cycle (state, cycle, bus, op->code);
+    default:
+      return memory_cycle (state, cycle, bus, op);
+  }
+}
+
+/* Fetches the next opcode, or starts entering a pending interrupt instead */
+static unsigned int
+fetch_cycle (cpu_t* state, cycle_t* cycle, bus_t* bus)
+{
+  cycle->vector = 0;
+  if (state->nmi) {
+    state->nmi = 0;
+    cycle->vector = NMI_VECTOR;
+  } else if (state->irq && !state->s_interrupt) {
+    cycle->vector = IRQ_VECTOR;
+  }
+
+  uint8_t const byte = read_byte (bus, state->pc);
+
+  if (cycle->vector == 0) {
+    if (state->variant->opcodes[byte].code == UNDEFINED_OP)
+      return 0;
+
+    cycle->opcode = byte;
+    state->pc++;
+    state->instructions++;
+  } else {
+    state->interrupts++;
+  }
+
+  cycle->step = 1;
+  return 1;
+}
+
+unsigned int
+tick_cycle (cpu_t* state, cycle_t* cycle, bus_t* bus)
+{
+  int done;
+
+  if (cycle->step == 0)
+    return fetch_cycle (state, cycle, bus);
+
+  if (cycle->vector == 0) {
+    done = execute_cycle (state, cycle, bus);
+  } else if (cycle->step == 1) {
+    /* An interrupt holds the program counter on the opcode it replaced */
+    read_byte (bus, state->pc);
+    done = 0;
+  } else {
+    done = interrupt_cycle (state, cycle, bus, cycle->vector, 0);
+  }
+
+  cycle->step = done ? 0 : cycle->step + 1;
+  return 1;
+}
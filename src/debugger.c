@@ -0,0 +1,780 @@
+/**
+ * debugger.c
+ *
+ * Implementation of the terminal step debugger.
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include "debugger.h"
+#include "disasm.h"
+#include "machine.h"
+
+#define RUN_SLICE 100000
+#define REFRESH_INTERVAL 200
+#define OUTPUT_SIZE 8192
+#define TEXT_SIZE 256
+
+#define MIN_ROWS 24
+#define MIN_COLS 80
+#define CODE_ROW 3
+#define CODE_WIDTH 40
+#define VIEW_COL 41
+#define VIEW_COUNT 2
+#define VIEW_LINES 64
+#define VIEW_WIDTH 8
+#define BACK_MAX 32
+
+#define MAX_LENGTH 3
+#define OPCODE_JSR 0x20
+
+#define ATTR_BOLD    0x01
+#define ATTR_REVERSE 0x02
+
+#define KEY_CTRL_C    0x03
+#define KEY_BACKSPACE 0x08
+#define KEY_TAB       0x09
+#define KEY_ENTER     0x0D
+#define KEY_ESCAPE    0x1B
+#define KEY_DELETE    0x7F
+#define KEY_UP        0x100
+#define KEY_DOWN      0x101
+#define KEY_PAGE_UP   0x102
+#define KEY_PAGE_DOWN 0x103
+
+#define ENTER_SCREEN "\x1b[?1049h\x1b[?25l\x1b[0m\x1b[2J"
+#define LEAVE_SCREEN "\x1b[0m\x1b[?25h\x1b[?1049l"
+
+static const char* const help_text =
+    " s step  n over  c cont  r to cursor  b break  g go to  m mem  tab view  q quit";
+
+typedef struct cell_t {
+    char ch;
+    uint8_t attr;
+} cell_t;
+
+typedef enum prompt_t {
+    PROMPT_NONE,
+    PROMPT_CODE,                          /* Address to move the cursor to */
+    PROMPT_VIEW,                          /* Address of the active memory view */
+} prompt_t;
+
+typedef struct debugger_t {
+    emu2_machine_t* machine;
+    int in;
+    int out;
+
+    unsigned int rows;
+    unsigned int cols;
+    cell_t* screen;                       /* Cells as shown by the terminal */
+    cell_t* frame;                        /* Cells of the frame being drawn */
+    int cursor_row;                       /* Terminal cursor, or -1 if unknown */
+    int cursor_col;
+    uint8_t attr;                         /* Attributes the terminal is set to */
+    char output[OUTPUT_SIZE];             /* Pending escape sequences and text */
+    size_t output_len;
+
+    uint16_t top;                         /* Address of the first line of code */
+    uint16_t cursor;                      /* Address of the selected line */
+    uint16_t views[VIEW_COUNT];           /* First address of each memory view */
+    unsigned int active;                  /* View moved by the keys */
+
+    emu2_regs_t regs;                     /* Registers when last resumed */
+    uint64_t cycles;                      /* Cycles when last resumed */
+    uint16_t captured[VIEW_COUNT];        /* Addresses of the views when resumed */
+    unsigned int captured_len;            /* Bytes captured of every view */
+    uint8_t before[VIEW_COUNT][VIEW_LINES * VIEW_WIDTH];
+
+    prompt_t prompt;
+    char input[5];                        /* Hex digits typed at the prompt */
+    const char* message;                  /* Outcome of the last command */
+} debugger_t;
+
+static void
+flush_output (debugger_t* dbg)
+{
+  size_t written = 0;
+
+  while (written < dbg->output_len) {
+    ssize_t const n = write (dbg->out, dbg->output + written, dbg->output_len - written);
+
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      break;
+    written += n;
+  }
+
+  dbg->output_len = 0;
+}
+
+static void
+emit (debugger_t* dbg, const char* text, size_t len)
+{
+  if (dbg->output_len + len > OUTPUT_SIZE)
+    flush_output (dbg);
+
+  memcpy (dbg->output + dbg->output_len, text, len);
+  dbg->output_len += len;
+}
+
+static void
+emit_string (debugger_t* dbg, const char* text)
+{
+  emit (dbg, text, strlen (text));
+}
+
+/* Sends the cells that differ from what the terminal shows */
+static void
+flush_frame (debugger_t* dbg)
+{
+  char sequence[32];
+
+  for (unsigned int row = 0; row < dbg->rows; row++) {
+    for (unsigned int col = 0; col < dbg->cols; col++) {
+      cell_t const* cell = &dbg->frame[row * dbg->cols + col];
+      cell_t* shown = &dbg->screen[row * dbg->cols + col];
+
+      if (cell->ch == shown->ch && cell->attr == shown->attr)
+        continue;
+
+      if (dbg->cursor_row != (int) row || dbg->cursor_col != (int) col)
+        emit (dbg, sequence, snprintf (sequence, sizeof (sequence), "\x1b[%u;%uH", row + 1, col + 1));
+
+      if (cell->attr != dbg->attr) {
+        emit (dbg, sequence, snprintf (sequence, sizeof (sequence), "\x1b[0%s%sm",
+                                       cell->attr & ATTR_BOLD ? ";1" : "",
+                                       cell->attr & ATTR_REVERSE ? ";7" : ""));
+        dbg->attr = cell->attr;
+      }
+
+      emit (dbg, &cell->ch, 1);
+      *shown = *cell;
+
+      /* Terminals differ in where the cursor goes after the last column */
+      dbg->cursor_row = col + 1 < dbg->cols ? (int) row : -1;
+      dbg->cursor_col = col + 1;
+    }
+  }
+
+  flush_output (dbg);
+}
+
+/* Adapts the cells to the size of the terminal, which is redrawn if it changed */
+static int
+resize (debugger_t* dbg)
+{
+  struct winsize size;
+  unsigned int rows = MIN_ROWS;
+  unsigned int cols = MIN_COLS;
+
+  if (ioctl (dbg->out, TIOCGWINSZ, &size) == 0 && size.ws_row > 0 && size.ws_col > 0) {
+    rows = size.ws_row;
+    cols = size.ws_col;
+  }
+
+  if (rows == dbg->rows && cols == dbg->cols)
+    return 0;
+
+  cell_t* screen = calloc (rows * cols, sizeof (*screen));
+  cell_t* frame = calloc (rows * cols, sizeof (*frame));
+  if (screen == NULL || frame == NULL) {
+    free (screen);
+    free (frame);
+    return -1;
+  }
+
+  free (dbg->screen);
+  free (dbg->frame);
+  dbg->screen = screen;
+  dbg->frame = frame;
+  dbg->rows = rows;
+  dbg->cols = cols;
+
+  /* The screen holds no character cell can hold, so all of it is sent */
+  emit_string (dbg, "\x1b[0m\x1b[2J");
+  dbg->attr = 0;
+  dbg->cursor_row = -1;
+
+  return 0;
+}
+
+static void
+put_text (debugger_t* dbg, unsigned int row, unsigned int col, uint8_t attr, const char* text)
+{
+  cell_t* line = &dbg->frame[row * dbg->cols];
+
+  for (; *text != '\0' && col < dbg->cols; text++, col++) {
+    line[col].ch = *text >= ' ' && *text < 0x7F ? *text : '.';
+    line[col].attr = attr;
+  }
+}
+
+static void
+put_format (debugger_t* dbg, unsigned int row, unsigned int col, uint8_t attr,
+            const char* format, ...)
+{
+  char text[TEXT_SIZE];
+  va_list args;
+
+  va_start (args, format);
+  vsnprintf (text, sizeof (text), format, args);
+  va_end (args);
+
+  put_text (dbg, row, col, attr, text);
+}
+
+static void
+fill (debugger_t* dbg, unsigned int row, unsigned int col, unsigned int width, uint8_t attr)
+{
+  cell_t* line = &dbg->frame[row * dbg->cols];
+
+  for (; width > 0 && col < dbg->cols; width--, col++) {
+    line[col].ch = ' ';
+    line[col].attr = attr;
+  }
+}
+
+/* Lines of the layout, which is only drawn on terminals of the minimum size */
+static unsigned int
+code_lines (const debugger_t* dbg)
+{
+  return (dbg->rows > MIN_ROWS ? dbg->rows : MIN_ROWS) - CODE_ROW - 2;
+}
+
+static unsigned int
+view_lines (const debugger_t* dbg)
+{
+  unsigned int const lines = code_lines (dbg) / VIEW_COUNT - 1;
+
+  return lines < VIEW_LINES ? lines : VIEW_LINES;
+}
+
+/* Reads the bytes of the instruction at an address, returning its opcode */
+static const opcode_t*
+fetch (const debugger_t* dbg, uint16_t addr, uint8_t* code)
+{
+  for (unsigned int i = 0; i < MAX_LENGTH; i++)
+    code[i] = emu2_read (dbg->machine, addr + i);
+
+  return &dbg->machine->cpu.variant->opcodes[code[0]];
+}
+
+static unsigned int
+length_at (const debugger_t* dbg, uint16_t addr)
+{
+  uint8_t code[MAX_LENGTH];
+
+  return get_instruction_length (fetch (dbg, addr, code));
+}
+
+/*
+ * Finds the address the specified number of instructions before another,
+ * decoding from as far back as possible so the instructions line up with it
+ */
+static uint16_t
+back (const debugger_t* dbg, uint16_t addr, unsigned int count)
+{
+  if (count > BACK_MAX)
+    count = BACK_MAX;
+
+  for (unsigned int distance = MAX_LENGTH * count; distance > 0; distance--) {
+    uint16_t starts[BACK_MAX];
+    unsigned int offset = 0;
+    unsigned int found = 0;
+
+    while (offset < distance) {
+      starts[found++ % BACK_MAX] = addr - distance + offset;
+      offset += length_at (dbg, addr - distance + offset);
+    }
+
+    if (offset == distance && found >= count)
+      return starts[(found - count) % BACK_MAX];
+  }
+
+  return addr - count;
+}
+
+/* Returns the line showing an address, or -1 if it is not visible */
+static int
+line_of (const debugger_t* dbg, uint16_t addr)
+{
+  uint16_t line_addr = dbg->top;
+
+  for (unsigned int line = 0; line < code_lines (dbg); line++) {
+    if (line_addr == addr)
+      return line;
+    line_addr += length_at (dbg, line_addr);
+  }
+
+  return -1;
+}
+
+/* Moves the cursor, scrolling the code so some lines before it stay visible */
+static void
+select_line (debugger_t* dbg, uint16_t addr)
+{
+  dbg->cursor = addr;
+  if (line_of (dbg, addr) < 0)
+    dbg->top = back (dbg, addr, code_lines (dbg) / 4);
+}
+
+static void
+cursor_down (debugger_t* dbg)
+{
+  dbg->cursor += length_at (dbg, dbg->cursor);
+  while (line_of (dbg, dbg->cursor) < 0)
+    dbg->top += length_at (dbg, dbg->top);
+}
+
+static void
+cursor_up (debugger_t* dbg)
+{
+  dbg->cursor = back (dbg, dbg->cursor, 1);
+  if (line_of (dbg, dbg->cursor) < 0)
+    dbg->top = dbg->cursor;
+}
+
+static void
+draw_registers (debugger_t* dbg, const emu2_regs_t* regs)
+{
+  static const char flag_names[] = "nv-bdizc";
+  char flags[sizeof (flag_names)];
+
+  for (unsigned int i = 0; i < 8; i++) {
+    int const set = regs->p >> (7 - i) & 1;
+    flags[i] = set && flag_names[i] != '-' ? flag_names[i] - 'a' + 'A' : flag_names[i];
+  }
+  flags[8] = '\0';
+
+  /* Registers changed by the last command stand out */
+  put_format (dbg, 1, 1, regs->pc != dbg->regs.pc ? ATTR_BOLD : 0, "PC %04x", regs->pc);
+  put_format (dbg, 1, 10, regs->a != dbg->regs.a ? ATTR_BOLD : 0, "A %02x", regs->a);
+  put_format (dbg, 1, 16, regs->x != dbg->regs.x ? ATTR_BOLD : 0, "X %02x", regs->x);
+  put_format (dbg, 1, 22, regs->y != dbg->regs.y ? ATTR_BOLD : 0, "Y %02x", regs->y);
+  put_format (dbg, 1, 28, regs->sp != dbg->regs.sp ? ATTR_BOLD : 0, "SP %02x", regs->sp);
+  put_format (dbg, 1, 35, regs->p != dbg->regs.p ? ATTR_BOLD : 0, "P %02x %s", regs->p, flags);
+}
+
+static void
+draw_code (debugger_t* dbg, const emu2_regs_t* regs)
+{
+  uint16_t addr = dbg->top;
+
+  for (unsigned int line = 0; line < code_lines (dbg); line++) {
+    uint8_t code[MAX_LENGTH];
+    char bytes[3 * MAX_LENGTH + 1] = "";
+    char text[TEXT_SIZE] = "";
+    opcode_t const* opcode = fetch (dbg, addr, code);
+    unsigned int const len = get_instruction_length (opcode);
+    uint8_t attr = addr == dbg->cursor ? ATTR_REVERSE : 0;
+
+    for (unsigned int i = 0; i < len; i++)
+      snprintf (bytes + 3 * i, sizeof (bytes) - 3 * i, "%02x ", code[i]);
+
+    FILE* stream = fmemopen (text, sizeof (text), "w");
+    if (stream != NULL) {
+      disassemble_instruction (opcode, code, stream);
+      fclose (stream);
+    }
+
+    if (addr == regs->pc)
+      attr |= ATTR_BOLD;
+
+    fill (dbg, CODE_ROW + line, 0, CODE_WIDTH, attr);
+    put_format (dbg, CODE_ROW + line, 0, attr, "%c%c %04x  %-9s %s",
+                addr == regs->pc ? '>' : ' ', emu2_is_breakpoint (dbg->machine, addr) ? '*' : ' ',
+                addr, bytes, text);
+    addr += len;
+  }
+}
+
+static void
+draw_views (debugger_t* dbg)
+{
+  unsigned int const lines = view_lines (dbg);
+
+  for (unsigned int view = 0; view < VIEW_COUNT; view++) {
+    unsigned int const row = CODE_ROW + view * (lines + 1);
+    int const compare = dbg->captured[view] == dbg->views[view];
+
+    put_format (dbg, row, VIEW_COL, view == dbg->active ? ATTR_REVERSE : ATTR_BOLD,
+                " Memory $%04x ", dbg->views[view]);
+
+    for (unsigned int line = 0; line < lines; line++) {
+      uint16_t const addr = dbg->views[view] + line * VIEW_WIDTH;
+      char chars[VIEW_WIDTH + 1];
+
+      put_format (dbg, row + 1 + line, VIEW_COL, 0, "%04x", addr);
+      for (unsigned int i = 0; i < VIEW_WIDTH; i++) {
+        uint8_t const value = emu2_read (dbg->machine, addr + i);
+        unsigned int const offset = line * VIEW_WIDTH + i;
+        int const changed = compare && offset < dbg->captured_len
+                            && dbg->before[view][offset] != value;
+
+        put_format (dbg, row + 1 + line, VIEW_COL + 6 + 3 * i, changed ? ATTR_BOLD : 0,
+                    "%02x", value);
+        chars[i] = value >= ' ' && value < 0x7F ? value : '.';
+      }
+      chars[VIEW_WIDTH] = '\0';
+      put_text (dbg, row + 1 + line, VIEW_COL + 7 + 3 * VIEW_WIDTH, 0, chars);
+    }
+  }
+}
+
+static void
+draw (debugger_t* dbg)
+{
+  emu2_regs_t regs;
+
+  if (resize (dbg) != 0)
+    return;
+
+  for (size_t i = 0; i < (size_t) dbg->rows * dbg->cols; i++)
+    dbg->frame[i] = (cell_t) {' ', 0};
+
+  if (dbg->rows < MIN_ROWS || dbg->cols < MIN_COLS) {
+    put_format (dbg, 0, 0, 0, "Terminal too small, %ux%u needed.", MIN_COLS, MIN_ROWS);
+    flush_frame (dbg);
+    return;
+  }
+
+  emu2_get_regs (dbg->machine, &regs);
+  uint64_t const cycles = emu2_get_cycles (dbg->machine);
+
+  fill (dbg, 0, 0, dbg->cols, ATTR_REVERSE);
+  put_text (dbg, 0, 1, ATTR_REVERSE, "65emu2 debugger");
+  put_format (dbg, 0, CODE_WIDTH, ATTR_REVERSE, "cycles %" PRIu64 " (+%" PRIu64 ")",
+              cycles, cycles - dbg->cycles);
+
+  draw_registers (dbg, &regs);
+  draw_code (dbg, &regs);
+  draw_views (dbg);
+
+  unsigned int const status = dbg->rows - 2;
+  if (dbg->prompt != PROMPT_NONE)
+    put_format (dbg, status, 1, ATTR_BOLD, "%s: $%s_",
+                dbg->prompt == PROMPT_CODE ? "Go to address" : "Show memory at", dbg->input);
+  else if (dbg->message != NULL)
+    put_text (dbg, status, 1, ATTR_BOLD, dbg->message);
+
+  fill (dbg, dbg->rows - 1, 0, dbg->cols, ATTR_REVERSE);
+  put_text (dbg, dbg->rows - 1, 0, ATTR_REVERSE, help_text);
+
+  flush_frame (dbg);
+}
+
+/* Returns the next key, or -1 if the terminal is gone */
+static int
+read_key (debugger_t* dbg)
+{
+  unsigned char keys[8];
+  ssize_t len;
+
+  do {
+    len = read (dbg->in, keys, sizeof (keys));
+  } while (len < 0 && errno == EINTR);
+
+  if (len <= 0)
+    return -1;
+
+  /* Escape sequences arrive in one piece */
+  if (keys[0] == KEY_ESCAPE && len >= 3 && (keys[1] == '[' || keys[1] == 'O')) {
+    switch (keys[2]) {
+      case 'A':
+        return KEY_UP;
+      case 'B':
+        return KEY_DOWN;
+      case '5':
+        return KEY_PAGE_UP;
+      case '6':
+        return KEY_PAGE_DOWN;
+      default:
+        return 0;
+    }
+  }
+
+  return keys[0];
+}
+
+/* Consumes a key pressed while the machine is running */
+static int
+key_pressed (debugger_t* dbg)
+{
+  struct pollfd pfd = {dbg->in, POLLIN, 0};
+
+  if (poll (&pfd, 1, 0) <= 0)
+    return 0;
+
+  read_key (dbg);
+  return 1;
+}
+
+/* Remembers the state before resuming, so changes can be highlighted */
+static void
+capture (debugger_t* dbg)
+{
+  unsigned int const lines = view_lines (dbg);
+
+  emu2_get_regs (dbg->machine, &dbg->regs);
+  dbg->cycles = emu2_get_cycles (dbg->machine);
+
+  dbg->captured_len = lines * VIEW_WIDTH;
+  for (unsigned int view = 0; view < VIEW_COUNT; view++) {
+    dbg->captured[view] = dbg->views[view];
+    for (unsigned int i = 0; i < dbg->captured_len; i++)
+      dbg->before[view][i] = emu2_read (dbg->machine, dbg->views[view] + i);
+  }
+}
+
+static void
+stopped (debugger_t* dbg, emu2_status_t status, int interrupted)
+{
+  emu2_regs_t regs;
+
+  switch (status) {
+    case EMU2_OK:
+      dbg->message = interrupted ? "Stopped." : NULL;
+      break;
+    case EMU2_BREAKPOINT:
+      dbg->message = "Breakpoint reached.";
+      break;
+    case EMU2_STALLED:
+      dbg->message = "CPU stalled on undefined opcode.";
+      break;
+    case EMU2_NOMEM:
+      dbg->message = "Could not allocate memory.";
+      break;
+    case EMU2_DIVERGED:
+      dbg->message = "Replay no longer matches its log.";
+      break;
+    default:
+      dbg->message = "CPU stopped.";
+      break;
+  }
+
+  emu2_get_regs (dbg->machine, &regs);
+  select_line (dbg, regs.pc);
+}
+
+static void
+step (debugger_t* dbg)
+{
+  capture (dbg);
+  stopped (dbg, emu2_step (dbg->machine), 0);
+}
+
+/* Runs until a breakpoint, optionally a temporary one, or until a key is pressed */
+static void
+run (debugger_t* dbg, long until)
+{
+  emu2_machine_t* machine = dbg->machine;
+  int const temporary = until >= 0 && !emu2_is_breakpoint (machine, until);
+  emu2_status_t status;
+  int interrupted = 0;
+
+  if (temporary && emu2_set_breakpoint (machine, until) != EMU2_OK) {
+    dbg->message = "Could not set breakpoint.";
+    return;
+  }
+
+  capture (dbg);
+  dbg->message = "Running, press any key to stop.";
+  draw (dbg);
+
+  /* The terminal is only checked between slices, so the core runs undisturbed */
+  do {
+    status = emu2_run (machine, RUN_SLICE);
+  } while (status == EMU2_OK && !(interrupted = key_pressed (dbg)));
+
+  if (temporary)
+    emu2_clear_breakpoint (machine, until);
+
+  stopped (dbg, status, interrupted);
+}
+
+static void
+step_over (debugger_t* dbg)
+{
+  emu2_regs_t regs;
+
+  emu2_get_regs (dbg->machine, &regs);
+  if (emu2_read (dbg->machine, regs.pc) == OPCODE_JSR)
+    run (dbg, (uint16_t) (regs.pc + 3));
+  else
+    step (dbg);
+}
+
+static void
+toggle_breakpoint (debugger_t* dbg)
+{
+  if (emu2_is_breakpoint (dbg->machine, dbg->cursor))
+    emu2_clear_breakpoint (dbg->machine, dbg->cursor);
+  else if (emu2_set_breakpoint (dbg->machine, dbg->cursor) != EMU2_OK)
+    dbg->message = "Could not set breakpoint.";
+}
+
+static void
+scroll_view (debugger_t* dbg, int pages)
+{
+  dbg->views[dbg->active] += pages * (int) (view_lines (dbg) * VIEW_WIDTH);
+}
+
+static void
+handle_prompt (debugger_t* dbg, int key)
+{
+  size_t const len = strlen (dbg->input);
+
+  if (key == KEY_ENTER && len > 0) {
+    uint16_t const addr = strtoul (dbg->input, NULL, 16);
+
+    if (dbg->prompt == PROMPT_CODE)
+      select_line (dbg, addr);
+    else
+      dbg->views[dbg->active] = addr;
+    dbg->prompt = PROMPT_NONE;
+  } else if (key == KEY_ESCAPE || key == KEY_CTRL_C || key == KEY_ENTER) {
+    dbg->prompt = PROMPT_NONE;
+  } else if ((key == KEY_BACKSPACE || key == KEY_DELETE) && len > 0) {
+    dbg->input[len - 1] = '\0';
+  } else if (key < 0x80 && isxdigit (key) && len + 1 < sizeof (dbg->input)) {
+    dbg->input[len] = key;
+    dbg->input[len + 1] = '\0';
+  }
+}
+
+/* Carries out the command bound to a key, returning 0 if the user quit */
+static int
+handle_key (debugger_t* dbg, int key)
+{
+  emu2_regs_t regs;
+
+  if (dbg->prompt != PROMPT_NONE) {
+    handle_prompt (dbg, key);
+    return 1;
+  }
+
+  dbg->message = NULL;
+  switch (key) {
+    case 's':
+    case ' ':
+      step (dbg);
+      break;
+    case 'n':
+      step_over (dbg);
+      break;
+    case 'c':
+      run (dbg, -1);
+      break;
+    case 'r':
+      run (dbg, dbg->cursor);
+      break;
+    case 'b':
+      toggle_breakpoint (dbg);
+      break;
+    case 'g':
+    case 'm':
+      dbg->prompt = key == 'g' ? PROMPT_CODE : PROMPT_VIEW;
+      dbg->input[0] = '\0';
+      break;
+    case '.':
+      emu2_get_regs (dbg->machine, &regs);
+      select_line (dbg, regs.pc);
+      break;
+    case 'j':
+    case KEY_DOWN:
+      cursor_down (dbg);
+      break;
+    case 'k':
+    case KEY_UP:
+      cursor_up (dbg);
+      break;
+    case ']':
+    case KEY_PAGE_DOWN:
+      scroll_view (dbg, 1);
+      break;
+    case '[':
+    case KEY_PAGE_UP:
+      scroll_view (dbg, -1);
+      break;
+    case KEY_TAB:
+      dbg->active = (dbg->active + 1) % VIEW_COUNT;
+      break;
+    case 'q':
+    case KEY_CTRL_C:
+      return 0;
+    default:
+      break;
+  }
+
+  return 1;
+}
+
+int
+debugger_run (emu2_machine_t* machine, int in, int out)
+{
+  struct termios saved;
+  emu2_regs_t regs;
+
+  if (!isatty (in) || tcgetattr (in, &saved) != 0)
+    return -1;
+
+  debugger_t* dbg = calloc (1, sizeof (*dbg));
+  if (dbg == NULL)
+    return -1;
+
+  /* Keys are read one at a time, and ^C is a command of its own */
+  struct termios raw = saved;
+  raw.c_iflag &= ~(ICRNL | IXON);
+  raw.c_lflag &= ~(ICANON | ECHO | ISIG | IEXTEN);
+  raw.c_cc[VMIN] = 1;
+  raw.c_cc[VTIME] = 0;
+  tcsetattr (in, TCSAFLUSH, &raw);
+
+  dbg->machine = machine;
+  dbg->in = in;
+  dbg->out = out;
+  dbg->views[0] = 0x0000;
+  dbg->views[1] = 0x0100;
+  emit_string (dbg, ENTER_SCREEN);
+
+  /* Sizes the layout before the code and the views are placed in it */
+  resize (dbg);
+  emu2_get_regs (machine, &regs);
+  select_line (dbg, regs.pc);
+  capture (dbg);
+
+  for (;;) {
+    struct pollfd pfd = {in, POLLIN, 0};
+
+    /* Redrawn on a timer as well, to follow changes of the terminal size */
+    draw (dbg);
+    int const ready = poll (&pfd, 1, REFRESH_INTERVAL);
+    if (ready < 0 && errno != EINTR)
+      break;
+    if (ready <= 0)
+      continue;
+
+    int const key = read_key (dbg);
+    if (key < 0 || !handle_key (dbg, key))
+      break;
+  }
+
+  emit_string (dbg, LEAVE_SCREEN);
+  flush_output (dbg);
+  tcsetattr (in, TCSAFLUSH, &saved);
+
+  free (dbg->screen);
+  free (dbg->frame);
+  free (dbg);
+  return 0;
+}
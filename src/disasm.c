@@ -5,127 +5,86 @@
  */
 
 #include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
 #include <stdint.h>
 #include "disasm.h"
 #include "opcode.h"
 
 size_t
-read_file (const char* filename, uint8_t** dest)
+disassemble_instruction (const opcode_t* opcode, const uint8_t* code, FILE* dest)
 {
-  FILE* fp = fopen (filename, "rb");
+  char const* name = get_opcode_name (opcode);
 
-  if (fp == NULL) {
-    fprintf (stderr, "Could not open file %s for reading.\n", filename);
-    exit (EXIT_FAILURE);
+  switch (opcode->mode) {
+    case IMPLICIT:
+      fprintf (dest, "%s", name);
+      return 1;
+    case ACCUMULATOR:
+      fprintf (dest, "%s A", name);
+      return 1;
+    case IMMEDIATE:
+      fprintf (dest, "%s #$%02x", name, code[1]);
+      return 2;
+    case ZERO_PAGE:
+      fprintf (dest, "%s $%02x", name, code[1]);
+      return 2;
+    case ZERO_PAGE_X:
+      fprintf (dest, "%s $%02x,X", name, code[1]);
+      return 2;
+    case ZERO_PAGE_Y:
+      fprintf (dest, "%s $%02x,Y", name, code[1]);
+      return 2;
+    case RELATIVE:
+      fprintf (dest, "%s $%02x", name, code[1]);
+      return 2;
+    case INDIRECT:
+      fprintf (dest, "%s ($%02x%02x)", name, code[2], code[1]);
+      return 3;
+    case INDEXED_INDIRECT:
+      fprintf (dest, "%s ($%02x,X)", name, code[1]);
+      return 2;
+    case INDIRECT_INDEXED:
+      fprintf (dest, "%s ($%02x),Y", name, code[1]);
+      return 2;
+    case ZERO_PAGE_INDIRECT:
+      fprintf (dest, "%s ($%02x)", name, code[1]);
+      return 2;
+    case ABSOLUTE_INDEXED_INDIRECT:
+      fprintf (dest, "%s ($%02x%02x,X)", name, code[2], code[1]);
+      return 3;
+    case ABSOLUTE:
+      fprintf (dest, "%s $%02x%02x", name, code[2], code[1]);
+      return 3;
+    case ABSOLUTE_X:
+      fprintf (dest, "%s $%02x%02x,X", name, code[2], code[1]);
+      return 3;
+    case ABSOLUTE_Y:
+      fprintf (dest, "%s $%02x%02x,Y", name, code[2], code[1]);
+      return 3;
+    default:
+      return 1;
   }
-
-  fseek (fp, 0L, SEEK_END);
-  long fsize = ftell (fp);
-  fseek (fp, 0L, SEEK_SET);
-
-  long nsize = fsize + 1;
-  if (nsize == 0) {
-    fprintf (stderr, "Could not allocate buffer while seeking file %s.\n", filename);
-    fclose (fp);
-    exit (EXIT_FAILURE);
-  }
-
-  *dest = malloc (nsize);
-  fread (*dest, fsize, 1, fp);
-  fclose (fp);
-
-  return fsize;
 }
 
 void
 disassemble (const uint8_t* buf, size_t fsize, FILE* dest)
 {
   unsigned int pc = 0;
-  uint8_t const* code;
-  opcode_t const* opcode;
-  char const* name;
 
   while (pc < fsize) {
-    code = &buf[pc];
-    printf ("%04x:  ", pc);
-    opcode = decode_opcode (code);
-    name = get_opcode_name (opcode);
+    opcode_t const* opcode = decode_opcode (&buf[pc]);
 
-    switch (opcode->mode) {
-      case IMPLICIT:
-        fprintf (dest, "%s", name);
-        pc += 1;
-        break;
-      case ACCUMULATOR:
-        fprintf (dest, "%s A", name);
-        pc += 1;
-        break;
-      case IMMEDIATE:
-        fprintf (dest, "%s #$%02x", name, code[1]);
-        pc += 2;
-        break;
-      case ZERO_PAGE:
-        fprintf (dest, "%s $%02x", name, code[1]);
-        pc += 2;
-        break;
-      case ZERO_PAGE_X:
-        fprintf (dest, "%s $%02x,X", name, code[1]);
-        pc += 2;
-        break;
-      case ZERO_PAGE_Y:
-        fprintf (dest, "%s $%02x,Y", name, code[1]);
-        pc += 2;
-        break;
-      case RELATIVE:
-        fprintf (dest, "%s $%02x", name, code[1]);
-        pc += 2;
-        break;
-      case INDIRECT:
-        fprintf (dest, "%s $%02x", name, code[1]);
-        pc += 2;
-        break;
-      case INDEXED_INDIRECT:
-        fprintf (dest, "%s ($%02x,X)", name, code[1]);
-        pc += 2;
-        break;
-      case INDIRECT_INDEXED:
-        fprintf (dest, "%s ($%02x),Y", name, code[1]);
-        pc += 2;
-        break;
-      case ABSOLUTE:
-        fprintf (dest, "%s $%02x%02x", name, code[1], code[2]);
-        pc += 3;
-        break;
-      case ABSOLUTE_X:
-        fprintf (dest, "%s $%02x%02x,X", name, code[1], code[2]);
-        pc += 3;
-        break;
-      case ABSOLUTE_Y:
-        fprintf (dest, "%s $%02x%02x,Y", name, code[1], code[2]);
-        pc += 3;
-        break;
-      default:
-        pc += 1;
+    fprintf (dest, "%04x:  ", pc);
+
+    /* An instruction cut short by the end of the file is shown as data */
+    if (pc + get_instruction_length (opcode) > fsize) {
+      fprintf (dest, ".byte");
+      for (char const* separator = " "; pc < fsize; pc++, separator = ",")
+        fprintf (dest, "%s$%02x", separator, buf[pc]);
+      fprintf (dest, "\n");
+      break;
     }
 
+    pc += disassemble_instruction (opcode, &buf[pc], dest);
     fprintf (dest, "\n");
   }
 }
-
-int
-main (int argc, char* argv[])
-{
-  if (argc == 2) {
-    uint8_t* buf;
-    size_t fsize = read_file (argv[1], &buf);
-    disassemble (buf, fsize, stdout);
-    free (buf);
-  } else {
-    fprintf (stderr, "Usage: %s [FILE]\n", argv[0]);
-    exit (EXIT_FAILURE);
-  }
-
-  exit (EXIT_SUCCESS);
-}
\ No newline at end of file
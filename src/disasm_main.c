@@ -0,0 +1,283 @@
+/**
+ * disasm_main.c
+ *
+ * Command line front-end of the MOS 6502 disassembler.
+ */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "disasm.h"
+#include "file.h"
+#include "pack.h"
+#include "stats.h"
+
+#define MAX_THREADS 256
+
+/* Files to be counted, handed out to the workers one at a time */
+typedef struct job_t {
+    char** paths;
+    size_t count;
+    size_t capacity;
+    atomic_size_t next;                   /* Index of the next file to count */
+} job_t;
+
+typedef struct worker_t {
+    pthread_t thread;
+    job_t* job;
+    stats_t stats;                        /* Counts of this worker only */
+} worker_t;
+
+static void
+usage (const char* name)
+{
+  fprintf (stderr, "Usage: %s FILE\n", name);
+  fprintf (stderr, "       %s -s [-j THREADS] FILE|DIR...\n", name);
+  exit (EXIT_FAILURE);
+}
+
+static void
+add_path (job_t* job, const char* path)
+{
+  if (job->count == job->capacity) {
+    job->capacity = job->capacity > 0 ? job->capacity * 2 : 256;
+    job->paths = realloc (job->paths, job->capacity * sizeof (*job->paths));
+  }
+
+  if (job->paths == NULL || (job->paths[job->count] = strdup (path)) == NULL) {
+    fprintf (stderr, "Could not allocate file list.\n");
+    exit (EXIT_FAILURE);
+  }
+  job->count++;
+}
+
+/*
+ * Adds a file, or all files below a directory, to the job. Below the paths
+ * given, symbolic links are only followed to files, so that links to
+ * directories cannot make the walk loop.
+ */
+static void
+collect (job_t* job, const char* path, int below)
+{
+  struct stat st;
+
+  if ((below ? lstat (path, &st) : stat (path, &st)) != 0) {
+    fprintf (stderr, "Could not access %s, skipping.\n", path);
+    return;
+  }
+
+  int const link = S_ISLNK (st.st_mode);
+  if (link && stat (path, &st) != 0)
+    return;
+
+  if (S_ISREG (st.st_mode)) {
+    add_path (job, path);
+    return;
+  }
+
+  if (!S_ISDIR (st.st_mode) || link)
+    return;
+
+  DIR* dir = opendir (path);
+  if (dir == NULL) {
+    fprintf (stderr, "Could not open directory %s, skipping.\n", path);
+    return;
+  }
+
+  struct dirent* entry;
+  while ((entry = readdir (dir)) != NULL) {
+    if (strcmp (entry->d_name, ".") == 0 || strcmp (entry->d_name, "..") == 0)
+      continue;
+
+    size_t const len = strlen (path) + strlen (entry->d_name) + 2;
+    char* child = malloc (len);
+    if (child == NULL) {
+      fprintf (stderr, "Could not allocate file list.\n");
+      exit (EXIT_FAILURE);
+    }
+
+    snprintf (child, len, "%s/%s", path, entry->d_name);
+    collect (job, child, 1);
+    free (child);
+  }
+
+  closedir (dir);
+}
+
+/* Reads a file into a buffer reused between files, returning -1 on failure */
+static long
+load (const char* path, uint8_t** buf, size_t* capacity)
+{
+  int const fd = open (path, O_RDONLY);
+  struct stat st;
+  size_t size = 0;
+  ssize_t got;
+
+  if (fd < 0)
+    return -1;
+
+  if (fstat (fd, &st) == 0 && (size_t) st.st_size > *capacity) {
+    uint8_t* grown = realloc (*buf, st.st_size);
+    if (grown == NULL) {
+      close (fd);
+      return -1;
+    }
+    *buf = grown;
+    *capacity = st.st_size;
+  }
+
+  while (size < *capacity && (got = read (fd, *buf + size, *capacity - size)) > 0)
+    size += got;
+
+  close (fd);
+  return size;
+}
+
+/* Counts the instructions of every image of a pack rather than its encoding */
+static void
+count_pack (worker_t* worker, pack_t* pack, const char* path)
+{
+  for (size_t i = 0; i < pack_image_count (pack); i++) {
+    uint8_t* image;
+    long const len = pack_extract (pack, i, &image);
+
+    if (len < 0) {
+      fprintf (stderr, "Could not extract image %zu from pack %s, skipping.\n", i, path);
+      continue;
+    }
+
+    stats_count (&worker->stats, image, len);
+    free (image);
+  }
+}
+
+static void*
+count_files (void* arg)
+{
+  worker_t* worker = arg;
+  job_t* job = worker->job;
+  uint8_t* buf = NULL;
+  size_t capacity = 0;
+  size_t index;
+
+  while ((index = atomic_fetch_add (&job->next, 1)) < job->count) {
+    long const size = load (job->paths[index], &buf, &capacity);
+
+    if (size < 0) {
+      fprintf (stderr, "Could not read %s, skipping.\n", job->paths[index]);
+      continue;
+    }
+
+    /* Only files starting with the magic are opened once more as packs */
+    if ((size_t) size < sizeof (PACK_MAGIC) - 1
+        || memcmp (buf, PACK_MAGIC, sizeof (PACK_MAGIC) - 1) != 0) {
+      stats_count (&worker->stats, buf, size);
+      continue;
+    }
+
+    pack_t* pack = pack_open (job->paths[index]);
+    if (pack == NULL) {
+      fprintf (stderr, "Could not open pack %s, skipping.\n", job->paths[index]);
+      continue;
+    }
+
+    count_pack (worker, pack, job->paths[index]);
+    pack_close (pack);
+  }
+
+  free (buf);
+  return NULL;
+}
+
+/* Counts all files on several threads, each into its own table */
+static void
+run_stats (job_t* job, long threads)
+{
+  stats_t total = {{0}, 0, 0};
+
+  if (threads > (long) job->count)
+    threads = job->count > 0 ? job->count : 1;
+
+  worker_t* workers = calloc (threads, sizeof (*workers));
+  if (workers == NULL) {
+    fprintf (stderr, "Could not allocate workers.\n");
+    exit (EXIT_FAILURE);
+  }
+
+  long started = 0;
+  for (; started < threads; started++) {
+    workers[started].job = job;
+    if (pthread_create (&workers[started].thread, NULL, count_files, &workers[started]) != 0)
+      break;
+  }
+
+  /* Without any thread the files are counted here */
+  if (started == 0) {
+    workers[0].job = job;
+    count_files (&workers[0]);
+    started = 1;
+  } else {
+    for (long i = 0; i < started; i++)
+      pthread_join (workers[i].thread, NULL);
+  }
+
+  for (long i = 0; i < started; i++)
+    stats_merge (&total, &workers[i].stats);
+
+  stats_print (&total, stdout);
+  free (workers);
+}
+
+int
+main (int argc, char* argv[])
+{
+  int statistics = 0;
+  long threads = sysconf (_SC_NPROCESSORS_ONLN);
+  int opt;
+
+  while ((opt = getopt (argc, argv, "sj:")) != -1) {
+    switch (opt) {
+      case 's':
+        statistics = 1;
+        break;
+      case 'j':
+        threads = strtol (optarg, NULL, 10);
+        break;
+      default:
+        usage (argv[0]);
+    }
+  }
+
+  if (threads < 1)
+    threads = 1;
+  else if (threads > MAX_THREADS)
+    threads = MAX_THREADS;
+
+  if (statistics && optind < argc) {
+    job_t job = {NULL, 0, 0, 0};
+
+    for (int i = optind; i < argc; i++)
+      collect (&job, argv[i], 0);
+
+    run_stats (&job, threads);
+
+    for (size_t i = 0; i < job.count; i++)
+      free (job.paths[i]);
+    free (job.paths);
+  } else if (!statistics && optind == argc - 1) {
+    uint8_t* buf;
+    size_t fsize = read_file (argv[optind], &buf);
+    disassemble (buf, fsize, stdout);
+    free (buf);
+  } else {
+    usage (argv[0]);
+  }
+
+  exit (EXIT_SUCCESS);
+}
@@ -0,0 +1,590 @@
+/**
+ * emu2.c
+ *
+ * Implementation of the public library interface on top of the CPU core.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "emu2.h"
+#include "machine.h"
+
+#define RESET_VECTOR 0xFFFC
+
+static void*
+default_alloc (size_t size, void* user)
+{
+  (void) user;
+  return malloc (size);
+}
+
+static void
+default_free (void* ptr, void* user)
+{
+  (void) user;
+  free (ptr);
+}
+
+static inline int
+has_breakpoint (const emu2_machine_t* machine, uint16_t addr)
+{
+  return machine->breakpoints[addr >> 3] >> (addr & 7) & 1;
+}
+
+static void
+publish_metrics (emu2_machine_t* machine)
+{
+  metrics_slot_t* slot = machine->metrics;
+  metrics_sample_t* published = &machine->published;
+
+  metrics_add (&slot->instructions, machine->cpu.instructions, &published->instructions);
+  metrics_add (&slot->fused, machine->cpu.fused, &published->fused);
+  metrics_add (&slot->cycles, machine->cycles, &published->cycles);
+  metrics_add (&slot->interrupts, machine->cpu.interrupts, &published->interrupts);
+  metrics_add (&slot->stalls, machine->stalls, &published->stalls);
+}
+
+/*
+ * Completes a call of emu2_step() or emu2_run(): reports a page that could
+ * not be copied on write, which lost the write, and publishes the counters.
+ */
+static emu2_status_t
+finish (emu2_machine_t* machine, emu2_status_t status)
+{
+  if (status == EMU2_STALLED)
+    machine->stalls++;
+
+  if (machine->bus.failed) {
+    machine->bus.failed = 0;
+    status = EMU2_NOMEM;
+  }
+
+  if (machine->metrics != NULL)
+    publish_metrics (machine);
+
+  return status;
+}
+
+/* Runs the cycle-stepped core, checking breakpoints on instruction boundaries */
+static emu2_status_t
+run_cycles (emu2_machine_t* machine, uint64_t until)
+{
+  while (machine->cycles < until) {
+    if (machine->cycle.step == 0 && machine->breakpoint_count > 0
+        && has_breakpoint (machine, machine->cpu.pc))
+      return EMU2_BREAKPOINT;
+
+    if (tick_cycle (&machine->cpu, &machine->cycle, &machine->bus) == 0)
+      return EMU2_STALLED;
+
+    machine->cycles++;
+  }
+
+  return EMU2_OK;
+}
+
+/*
+ * Runs a recording machine one instruction or cycle at a time, logging the
+ * interrupt changes devices made during each as soon as it completes
+ */
+static emu2_status_t
+run_recording (emu2_machine_t* machine, uint64_t until)
+{
+  while (machine->cycles < until) {
+    if (machine->cycle.step == 0 && machine->breakpoint_count > 0
+        && has_breakpoint (machine, machine->cpu.pc))
+      return EMU2_BREAKPOINT;
+
+    if (machine->cycle_exact) {
+      if (tick_cycle (&machine->cpu, &machine->cycle, &machine->bus) == 0)
+        return EMU2_STALLED;
+      machine->cycles++;
+    } else {
+      unsigned int const taken = tick (&machine->cpu, &machine->bus);
+      if (taken == 0)
+        return EMU2_STALLED;
+      machine->cycles += taken;
+    }
+
+    replay_flush (machine);
+  }
+
+  return EMU2_OK;
+}
+
+/* Runs until the limit is reached, checking breakpoints only if any are set */
+static emu2_status_t
+run_until (emu2_machine_t* machine, uint64_t until)
+{
+  unsigned int taken;
+
+  if (machine->replay.mode == REPLAY_RECORD)
+    return run_recording (machine, until);
+
+  if (machine->cycle_exact)
+    return run_cycles (machine, until);
+
+  if (machine->breakpoint_count > 0) {
+    while (machine->cycles < until) {
+      if (has_breakpoint (machine, machine->cpu.pc))
+        return EMU2_BREAKPOINT;
+
+      taken = tick (&machine->cpu, &machine->bus);
+      if (taken == 0)
+        return EMU2_STALLED;
+
+      machine->cycles += taken;
+    }
+
+    return EMU2_OK;
+  }
+
+  while (machine->cycles < until) {
+    taken = tick_fused (&machine->cpu, &machine->bus, until - machine->cycles);
+    if (taken == 0)
+      return EMU2_STALLED;
+
+    machine->cycles += taken;
+  }
+
+  return EMU2_OK;
+}
+
+static uint8_t
+bus_io_read (uint16_t addr, void* user)
+{
+  emu2_machine_t* machine = user;
+  uint8_t value;
+
+  switch (machine->replay.mode) {
+    case REPLAY_PLAY:
+      return replay_io_read (machine, addr);
+    case REPLAY_RECORD:
+      value = device_read (machine, addr);
+      replay_append (machine, RECORD_IO_READ, value);
+      return value;
+    default:
+      return device_read (machine, addr);
+  }
+}
+
+static void
+bus_io_write (uint16_t addr, uint8_t value, void* user)
+{
+  emu2_machine_t* machine = user;
+
+  if (machine->io.write == NULL)
+    return;
+
+  machine->replay.in_access = 1;
+  machine->io.write (addr, value, machine->io.user);
+  machine->replay.in_access = 0;
+}
+
+emu2_machine_t*
+emu2_create (const emu2_allocator_t* allocator)
+{
+  return emu2_create_variant (allocator, EMU2_NMOS_6502);
+}
+
+emu2_machine_t*
+emu2_create_variant (const emu2_allocator_t* allocator, emu2_variant_t variant)
+{
+  static Variant const variants[] = {
+      [EMU2_NMOS_6502] = VARIANT_NMOS,
+      [EMU2_CMOS_65C02] = VARIANT_CMOS,
+      [EMU2_RICOH_2A03] = VARIANT_RICOH,
+  };
+  emu2_allocator_t const fallback = {default_alloc, default_free, NULL};
+
+  /* The value comes from across the API and may be anything */
+  if ((unsigned int) variant >= sizeof (variants) / sizeof (variants[0]))
+    return NULL;
+
+  if (allocator == NULL)
+    allocator = &fallback;
+
+  cpu_init ();
+
+  emu2_machine_t* machine = allocator->alloc (sizeof (*machine), allocator->user);
+  if (machine == NULL)
+    return NULL;
+
+  memset (machine, 0, sizeof (*machine));
+  machine->allocator = *allocator;
+  bus_init (&machine->bus, allocator->alloc, allocator->free, allocator->user);
+  machine->cpu.variant = get_variant (variants[variant]);
+  machine->bus.io_read = bus_io_read;
+  machine->bus.io_write = bus_io_write;
+  machine->bus.io_user = machine;
+
+  return machine;
+}
+
+void
+emu2_destroy (emu2_machine_t* machine)
+{
+  if (machine == NULL)
+    return;
+
+  if (machine->breakpoints != NULL)
+    machine->allocator.free (machine->breakpoints, machine->allocator.user);
+
+  replay_free (machine);
+  bus_free (&machine->bus);
+  machine->allocator.free (machine, machine->allocator.user);
+}
+
+void
+emu2_reset (emu2_machine_t* machine)
+{
+  cpu_t* cpu = &machine->cpu;
+
+  cpu->sp = 0xFD;
+  cpu->s_interrupt = 1;
+  cpu->pc = bus_peek (&machine->bus, RESET_VECTOR + 1) << 8
+            | bus_peek (&machine->bus, RESET_VECTOR);
+  machine->cycle.step = 0;
+  machine->cycles += 7;
+}
+
+/* Completes the current instruction of the cycle-stepped core */
+static emu2_status_t
+step_cycles (emu2_machine_t* machine)
+{
+  do {
+    if (machine->replay.mode == REPLAY_PLAY)
+      replay_events (machine);
+
+    if (tick_cycle (&machine->cpu, &machine->cycle, &machine->bus) == 0)
+      return EMU2_STALLED;
+
+    machine->cycles++;
+    if (machine->replay.mode == REPLAY_RECORD)
+      replay_flush (machine);
+  } while (machine->cycle.step != 0);
+
+  return EMU2_OK;
+}
+
+static emu2_status_t
+step (emu2_machine_t* machine)
+{
+  if (machine->cycle_exact)
+    return step_cycles (machine);
+
+  if (machine->replay.mode == REPLAY_PLAY)
+    replay_events (machine);
+
+  unsigned int cycles = tick (&machine->cpu, &machine->bus);
+
+  if (cycles == 0)
+    return EMU2_STALLED;
+
+  machine->cycles += cycles;
+  if (machine->replay.mode == REPLAY_RECORD)
+    replay_flush (machine);
+  return EMU2_OK;
+}
+
+emu2_status_t
+emu2_step (emu2_machine_t* machine)
+{
+  return finish (machine, step (machine));
+}
+
+emu2_status_t
+emu2_run (emu2_machine_t* machine, uint64_t cycles)
+{
+  uint64_t const until = cycles > UINT64_MAX - machine->cycles
+                         ? UINT64_MAX : machine->cycles + cycles;
+  emu2_status_t status = EMU2_OK;
+
+  /* Step off a breakpoint at the initial program counter */
+  if (until > machine->cycles && machine->breakpoint_count > 0
+      && has_breakpoint (machine, machine->cpu.pc))
+    status = step (machine);
+
+  while (status == EMU2_OK && machine->cycles < until) {
+    if (machine->replay.mode != REPLAY_PLAY) {
+      status = run_until (machine, until);
+      break;
+    }
+
+    /* Stop at the next recorded interrupt to raise it on the same cycle */
+    replay_events (machine);
+    status = run_until (machine, machine->replay.next_event < until
+                                 ? machine->replay.next_event : until);
+
+    if (machine->replay.diverged)
+      return finish (machine, EMU2_DIVERGED);
+  }
+
+  return finish (machine, status);
+}
+
+emu2_status_t
+emu2_set_cycle_exact (emu2_machine_t* machine, int enabled)
+{
+  if (enabled && machine->cpu.variant->cmos)
+    return EMU2_UNSUPPORTED;
+
+  emu2_status_t status = EMU2_OK;
+
+  /* The fast core can only start on an instruction boundary */
+  if (!enabled && machine->cycle.step != 0)
+    status = finish (machine, step_cycles (machine));
+
+  machine->cycle_exact = enabled != 0;
+  return status;
+}
+
+emu2_status_t
+emu2_set_breakpoint (emu2_machine_t* machine, uint16_t addr)
+{
+  if (machine->breakpoints == NULL) {
+    machine->breakpoints = machine->allocator.alloc (EMU2_MEMORY_SIZE / 8,
+                                                     machine->allocator.user);
+    if (machine->breakpoints == NULL)
+      return EMU2_NOMEM;
+
+    memset (machine->breakpoints, 0, EMU2_MEMORY_SIZE / 8);
+  }
+
+  if (!has_breakpoint (machine, addr)) {
+    machine->breakpoints[addr >> 3] |= 1 << (addr & 7);
+    machine->breakpoint_count++;
+  }
+
+  return EMU2_OK;
+}
+
+void
+emu2_clear_breakpoint (emu2_machine_t* machine, uint16_t addr)
+{
+  if (machine->breakpoints != NULL && has_breakpoint (machine, addr)) {
+    machine->breakpoints[addr >> 3] &= ~(1 << (addr & 7));
+    machine->breakpoint_count--;
+  }
+}
+
+int
+emu2_is_breakpoint (const emu2_machine_t* machine, uint16_t addr)
+{
+  return machine->breakpoints != NULL && has_breakpoint (machine, addr);
+}
+
+void
+emu2_clear_breakpoints (emu2_machine_t* machine)
+{
+  if (machine->breakpoints != NULL)
+    memset (machine->breakpoints, 0, EMU2_MEMORY_SIZE / 8);
+
+  machine->breakpoint_count = 0;
+}
+
+uint64_t
+emu2_get_cycles (const emu2_machine_t* machine)
+{
+  return machine->cycles;
+}
+
+void
+emu2_set_io (emu2_machine_t* machine, const emu2_io_t* io)
+{
+  emu2_io_t const none = {NULL, NULL, NULL};
+
+  machine->io = io != NULL ? *io : none;
+}
+
+void
+emu2_map_io (emu2_machine_t* machine, uint16_t first, uint16_t last)
+{
+  for (unsigned int page = first >> 8; page <= last >> 8; page++)
+    machine->bus.page_flags[page] |= PAGE_IO;
+}
+
+void
+emu2_set_irq (emu2_machine_t* machine, int asserted)
+{
+  if (machine->replay.mode == REPLAY_PLAY || machine->cpu.irq == (asserted != 0))
+    return;
+
+  machine->cpu.irq = asserted != 0;
+  if (machine->replay.mode == REPLAY_RECORD)
+    replay_interrupt (machine, asserted ? RECORD_IRQ_ASSERT : RECORD_IRQ_RELEASE);
+}
+
+void
+emu2_nmi (emu2_machine_t* machine)
+{
+  if (machine->replay.mode == REPLAY_PLAY)
+    return;
+
+  machine->cpu.nmi = 1;
+  if (machine->replay.mode == REPLAY_RECORD)
+    replay_interrupt (machine, RECORD_NMI);
+}
+
+void
+emu2_get_regs (const emu2_machine_t* machine, emu2_regs_t* regs)
+{
+  cpu_t const* cpu = &machine->cpu;
+
+  regs->a = cpu->acc;
+  regs->x = cpu->idx_x;
+  regs->y = cpu->idx_y;
+  regs->sp = cpu->sp;
+  regs->p = cpu_get_status (cpu);
+  regs->pc = cpu->pc;
+}
+
+void
+emu2_set_regs (emu2_machine_t* machine, const emu2_regs_t* regs)
+{
+  cpu_t* cpu = &machine->cpu;
+
+  cpu->acc = regs->a;
+  cpu->idx_x = regs->x;
+  cpu->idx_y = regs->y;
+  cpu->sp = regs->sp;
+  cpu_set_status (cpu, regs->p);
+  cpu->pc = regs->pc;
+}
+
+uint8_t
+emu2_read (const emu2_machine_t* machine, uint16_t addr)
+{
+  /* Providing a page on demand does not change what the machine holds */
+  return bus_peek ((bus_t*) &machine->bus, addr);
+}
+
+void
+emu2_write (emu2_machine_t* machine, uint16_t addr, uint8_t value)
+{
+  bus_poke (&machine->bus, addr, value);
+}
+
+void
+emu2_read_block (const emu2_machine_t* machine, uint16_t addr, uint8_t* dest,
+                 size_t len)
+{
+  while (len > 0) {
+    size_t chunk = BUS_PAGE_SIZE - (addr & 0xFF);
+
+    if (chunk > len)
+      chunk = len;
+
+    memcpy (dest, bus_page ((bus_t*) &machine->bus, addr >> 8) + (addr & 0xFF), chunk);
+    dest += chunk;
+    addr += chunk;
+    len -= chunk;
+  }
+}
+
+void
+emu2_write_block (emu2_machine_t* machine, uint16_t addr, const uint8_t* src,
+                  size_t len)
+{
+  while (len > 0) {
+    size_t chunk = BUS_PAGE_SIZE - (addr & 0xFF);
+    uint8_t* page = bus_own_page (&machine->bus, addr >> 8);
+
+    if (chunk > len)
+      chunk = len;
+
+    if (page != NULL)
+      memcpy (page + (addr & 0xFF), src, chunk);
+    src += chunk;
+    addr += chunk;
+    len -= chunk;
+  }
+}
+
+emu2_status_t
+emu2_map_image (emu2_machine_t* machine, uint16_t addr, const uint8_t* image,
+                size_t len)
+{
+  while (len > 0) {
+    size_t chunk = BUS_PAGE_SIZE - (addr & 0xFF);
+
+    if (chunk > len)
+      chunk = len;
+
+    /* Only whole pages can be shared, the others are copied */
+    if (chunk == BUS_PAGE_SIZE) {
+      bus_share_page (&machine->bus, addr >> 8, image);
+    } else {
+      uint8_t* page = bus_own_page (&machine->bus, addr >> 8);
+      if (page == NULL)
+        return EMU2_NOMEM;
+
+      memcpy (page + (addr & 0xFF), image, chunk);
+    }
+    image += chunk;
+    addr += chunk;
+    len -= chunk;
+  }
+
+  return EMU2_OK;
+}
+
+void
+emu2_map_pages (emu2_machine_t* machine, uint8_t first, unsigned int count,
+                emu2_page_source_t source, void* user)
+{
+  bus_map_source (&machine->bus, first, count, source, user);
+}
+
+void
+emu2_save (const emu2_machine_t* machine, emu2_snapshot_t* snapshot)
+{
+  emu2_get_regs (machine, &snapshot->regs);
+  snapshot->cycles = machine->cycles;
+  snapshot->irq = machine->cpu.irq;
+  snapshot->nmi = machine->cpu.nmi;
+  snapshot->progress.step = machine->cycle.step;
+  snapshot->progress.opcode = machine->cycle.opcode;
+  snapshot->progress.data = machine->cycle.data;
+  snapshot->progress.vector = machine->cycle.vector;
+  snapshot->progress.addr = machine->cycle.addr;
+  snapshot->progress.base = machine->cycle.base;
+  for (unsigned int page = 0; page < PAGE_COUNT; page++)
+    memcpy (snapshot->mem + page * BUS_PAGE_SIZE, bus_page ((bus_t*) &machine->bus, page),
+            BUS_PAGE_SIZE);
+}
+
+void
+emu2_restore (emu2_machine_t* machine, const emu2_snapshot_t* snapshot)
+{
+  emu2_set_regs (machine, &snapshot->regs);
+  machine->cycles = snapshot->cycles;
+  machine->cpu.irq = snapshot->irq;
+  machine->cpu.nmi = snapshot->nmi;
+  machine->cycle.step = snapshot->progress.step;
+  machine->cycle.opcode = snapshot->progress.opcode;
+  machine->cycle.data = snapshot->progress.data;
+  machine->cycle.vector = snapshot->progress.vector;
+  machine->cycle.addr = snapshot->progress.addr;
+  machine->cycle.base = snapshot->progress.base;
+
+  /* Pages that did not change stay shared, as do pages of zeros */
+  for (unsigned int page = 0; page < PAGE_COUNT; page++) {
+    uint8_t const* contents = snapshot->mem + page * BUS_PAGE_SIZE;
+
+    if (memcmp (bus_page (&machine->bus, page), contents, BUS_PAGE_SIZE) == 0)
+      continue;
+
+    if (contents[0] == 0 && memcmp (contents, contents + 1, BUS_PAGE_SIZE - 1) == 0) {
+      bus_share_page (&machine->bus, page, NULL);
+    } else {
+      uint8_t* owned = bus_own_page (&machine->bus, page);
+      if (owned != NULL)
+        memcpy (owned, contents, BUS_PAGE_SIZE);
+    }
+  }
+
+  /* The default core can only start on an instruction boundary */
+  if (!machine->cycle_exact && machine->cycle.step != 0)
+    step_cycles (machine);
+}
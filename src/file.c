@@ -0,0 +1,81 @@
+/**
+ * file.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "file.h"
+
+pack_t*
+open_pack (const char* filename, size_t* index)
+{
+  pack_t* pack = pack_open (filename);
+  const char* name = NULL;
+
+  /* Only split off a name if the whole argument is no pack */
+  char const* colon = strrchr (filename, ':');
+  if (pack == NULL && colon != NULL) {
+    char* path = strndup (filename, colon - filename);
+
+    if (path != NULL) {
+      pack = pack_open (path);
+      name = colon + 1;
+      free (path);
+    }
+  }
+
+  if (pack == NULL)
+    return NULL;
+
+  long const found = name != NULL ? pack_find (pack, name) : 0;
+  if (found < 0 || (size_t) found >= pack_image_count (pack)) {
+    fprintf (stderr, "Could not find image in pack %s.\n", filename);
+    exit (EXIT_FAILURE);
+  }
+
+  *index = found;
+  return pack;
+}
+
+size_t
+read_file (const char* filename, uint8_t** dest)
+{
+  size_t index;
+  pack_t* pack = open_pack (filename, &index);
+
+  if (pack != NULL) {
+    long const len = pack_extract (pack, index, dest);
+
+    pack_close (pack);
+    if (len < 0) {
+      fprintf (stderr, "Could not extract image from pack %s.\n", filename);
+      exit (EXIT_FAILURE);
+    }
+    return len;
+  }
+
+  FILE* fp = fopen (filename, "rb");
+
+  if (fp == NULL) {
+    fprintf (stderr, "Could not open file %s for reading.\n", filename);
+    exit (EXIT_FAILURE);
+  }
+
+  fseek (fp, 0L, SEEK_END);
+  long fsize = ftell (fp);
+  fseek (fp, 0L, SEEK_SET);
+
+  long nsize = fsize + 1;
+  if (nsize == 0) {
+    fprintf (stderr, "Could not allocate buffer while seeking file %s.\n", filename);
+    fclose (fp);
+    exit (EXIT_FAILURE);
+  }
+
+  *dest = malloc (nsize);
+  fread (*dest, fsize, 1, fp);
+  fclose (fp);
+
+  return fsize;
+}
@@ -0,0 +1,611 @@
+/**
+ * gdbstub.c
+ *
+ * Implementation of the GDB remote serial protocol stub.
+ */
+
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "gdbstub.h"
+
+#define PACKET_SIZE 0x4000
+#define INPUT_SIZE 4096
+#define RUN_SLICE 100000
+
+#define REGISTER_COUNT 6
+
+#define BREAK_IN 0x03
+
+#define SIGNAL_INT  "S02"
+#define SIGNAL_ILL  "S04"
+#define SIGNAL_TRAP "S05"
+
+typedef enum session_t {
+    SESSION_ACTIVE,                       /* Debugger is still attached */
+    SESSION_DETACHED,                     /* Debugger detached or hung up */
+    SESSION_KILLED,                       /* Debugger killed the program */
+} session_t;
+
+struct gdbstub {
+    emu2_machine_t* machine;
+    int listen_fd;
+    int client_fd;
+    int no_ack;
+    const char* stop;                     /* Reply to '?', why the machine halted */
+    char unix_path[sizeof (((struct sockaddr_un*) 0)->sun_path)];
+
+    char input[INPUT_SIZE];               /* Buffered bytes from the client */
+    size_t input_pos;
+    size_t input_len;
+
+    char packet[PACKET_SIZE + 1];         /* Payload of the current packet */
+    char reply[PACKET_SIZE + 4];          /* Framed reply to the packet */
+    uint8_t block[PACKET_SIZE / 2];       /* Memory transferred in bulk */
+    uint8_t inserted[EMU2_MEMORY_SIZE / 8]; /* Breakpoints set by the debugger */
+};
+
+static const char hex_digits[] = "0123456789abcdef";
+
+static int
+hex_value (char c)
+{
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+static char*
+encode_hex (char* dest, const uint8_t* src, size_t len)
+{
+  for (size_t i = 0; i < len; i++) {
+    *dest++ = hex_digits[src[i] >> 4];
+    *dest++ = hex_digits[src[i] & 0xF];
+  }
+
+  *dest = '\0';
+  return dest;
+}
+
+static size_t
+decode_hex (uint8_t* dest, const char* src, size_t max)
+{
+  size_t len = 0;
+
+  while (len < max && hex_value (src[0]) >= 0 && hex_value (src[1]) >= 0) {
+    dest[len++] = hex_value (src[0]) << 4 | hex_value (src[1]);
+    src += 2;
+  }
+
+  return len;
+}
+
+/* Returns the next byte sent by the client, or -1 if it hung up */
+static int
+read_byte (gdbstub_t* stub)
+{
+  if (stub->input_pos == stub->input_len) {
+    ssize_t len = read (stub->client_fd, stub->input, INPUT_SIZE);
+
+    if (len <= 0)
+      return -1;
+
+    stub->input_pos = 0;
+    stub->input_len = len;
+  }
+
+  return (unsigned char) stub->input[stub->input_pos++];
+}
+
+static int
+write_all (gdbstub_t* stub, const char* data, size_t len)
+{
+  while (len > 0) {
+    ssize_t written = write (stub->client_fd, data, len);
+
+    if (written <= 0)
+      return -1;
+
+    data += written;
+    len -= written;
+  }
+
+  return 0;
+}
+
+/* Receives the payload of the next packet into stub->packet */
+static int
+receive_packet (gdbstub_t* stub)
+{
+  for (;;) {
+    int c;
+
+    do {
+      c = read_byte (stub);
+    } while (c != '$' && c != -1);
+
+    if (c == -1)
+      return -1;
+
+    size_t len = 0;
+    uint8_t sum = 0;
+
+    while ((c = read_byte (stub)) != '#' && c != -1) {
+      if (len < PACKET_SIZE)
+        stub->packet[len++] = (char) c;
+      sum += c;
+    }
+
+    int high = read_byte (stub);
+    int low = read_byte (stub);
+
+    if (c == -1 || high == -1 || low == -1)
+      return -1;
+
+    stub->packet[len] = '\0';
+
+    if (stub->no_ack)
+      return 0;
+
+    if (hex_value (high) << 4 == (sum & 0xF0) && hex_value (low) == (sum & 0xF))
+      return write_all (stub, "+", 1);
+
+    if (write_all (stub, "-", 1) < 0)
+      return -1;
+  }
+}
+
+static int
+send_packet (gdbstub_t* stub, const char* payload)
+{
+  size_t len = strlen (payload);
+  uint8_t sum = 0;
+
+  stub->reply[0] = '$';
+  for (size_t i = 0; i < len; i++) {
+    stub->reply[i + 1] = payload[i];
+    sum += (uint8_t) payload[i];
+  }
+
+  stub->reply[len + 1] = '#';
+  stub->reply[len + 2] = hex_digits[sum >> 4];
+  stub->reply[len + 3] = hex_digits[sum & 0xF];
+
+  for (;;) {
+    if (write_all (stub, stub->reply, len + 4) < 0)
+      return -1;
+
+    if (stub->no_ack)
+      return 0;
+
+    int c = read_byte (stub);
+    if (c == '+')
+      return 0;
+    if (c != '-')
+      return -1;
+  }
+}
+
+/* Buffers bytes from the client without blocking, returning -1 if it hung up */
+static int
+fill_input (gdbstub_t* stub)
+{
+  struct pollfd pfd = {stub->client_fd, POLLIN, 0};
+
+  if (stub->input_pos < stub->input_len)
+    return 1;
+
+  if (poll (&pfd, 1, 0) <= 0)
+    return 0;
+
+  ssize_t len = read (stub->client_fd, stub->input, INPUT_SIZE);
+  if (len <= 0)
+    return -1;
+
+  stub->input_pos = 0;
+  stub->input_len = len;
+  return 1;
+}
+
+/* Checks whether the client sent a break-in or hung up without blocking */
+static int
+interrupted (gdbstub_t* stub)
+{
+  for (;;) {
+    int const pending = fill_input (stub);
+
+    if (pending <= 0)
+      return pending < 0;
+
+    /* Stray acknowledgements are dropped, packets are left for serve() */
+    char const c = stub->input[stub->input_pos];
+    if (c != '+' && c != '-') {
+      if (c == BREAK_IN)
+        stub->input_pos++;
+      return c == BREAK_IN;
+    }
+
+    stub->input_pos++;
+  }
+}
+
+static int
+is_inserted (const gdbstub_t* stub, uint16_t addr)
+{
+  return stub->inserted[addr >> 3] >> (addr & 7) & 1;
+}
+
+/* Sets a breakpoint for the debugger, leaving those of the host alone */
+static emu2_status_t
+insert_breakpoint (gdbstub_t* stub, uint16_t addr)
+{
+  if (emu2_is_breakpoint (stub->machine, addr))
+    return EMU2_OK;
+
+  emu2_status_t const status = emu2_set_breakpoint (stub->machine, addr);
+  if (status == EMU2_OK)
+    stub->inserted[addr >> 3] |= 1 << (addr & 7);
+
+  return status;
+}
+
+static void
+remove_breakpoint (gdbstub_t* stub, uint16_t addr)
+{
+  if (!is_inserted (stub, addr))
+    return;
+
+  emu2_clear_breakpoint (stub->machine, addr);
+  stub->inserted[addr >> 3] &= ~(1 << (addr & 7));
+}
+
+/* Returns the stop reply for the status a run or step ended with */
+static const char*
+stop_signal (emu2_status_t status, int interrupt)
+{
+  switch (status) {
+    case EMU2_STALLED:
+      return SIGNAL_ILL;
+    case EMU2_OK:
+      return interrupt ? SIGNAL_INT : SIGNAL_TRAP;
+    default:
+      return SIGNAL_TRAP;
+  }
+}
+
+static const char*
+resume (gdbstub_t* stub, int single_step)
+{
+  emu2_status_t status;
+
+  if (single_step) {
+    status = emu2_step (stub->machine);
+  } else {
+    do {
+      status = emu2_run (stub->machine, RUN_SLICE);
+    } while (status == EMU2_OK && !interrupted (stub));
+  }
+
+  stub->stop = stop_signal (status, !single_step);
+  return stub->stop;
+}
+
+static void
+pack_regs (const emu2_regs_t* regs, uint8_t* raw)
+{
+  raw[0] = regs->a;
+  raw[1] = regs->x;
+  raw[2] = regs->y;
+  raw[3] = regs->sp;
+  raw[4] = regs->p;
+  raw[5] = regs->pc;
+  raw[6] = regs->pc >> 8;
+}
+
+static void
+unpack_regs (emu2_regs_t* regs, const uint8_t* raw)
+{
+  regs->a = raw[0];
+  regs->x = raw[1];
+  regs->y = raw[2];
+  regs->sp = raw[3];
+  regs->p = raw[4];
+  regs->pc = raw[5] | raw[6] << 8;
+}
+
+/* Parses "ADDR,LEN" and returns the position after it */
+static const char*
+parse_range (const char* args, unsigned long* addr, unsigned long* len)
+{
+  char* end;
+
+  *addr = strtoul (args, &end, 16);
+  if (*end != ',')
+    return NULL;
+
+  *len = strtoul (end + 1, &end, 16);
+  return end;
+}
+
+static session_t
+handle_packet (gdbstub_t* stub, const char** reply)
+{
+  emu2_machine_t* machine = stub->machine;
+  char* packet = stub->packet;
+  static char const* const ok = "OK";
+  static char const* const error = "E01";
+  unsigned long addr, len;
+  const char* rest;
+  char* end;
+  emu2_regs_t regs;
+  uint8_t raw[7];
+
+  /* Replies built on the fly reuse the packet buffer once it is parsed */
+  *reply = "";
+
+  switch (packet[0]) {
+    case '?':
+      *reply = stub->stop;
+      break;
+    case 'g':
+      emu2_get_regs (machine, &regs);
+      pack_regs (&regs, raw);
+      encode_hex (packet, raw, sizeof (raw));
+      *reply = packet;
+      break;
+    case 'G':
+      if (decode_hex (raw, packet + 1, sizeof (raw)) != sizeof (raw)) {
+        *reply = error;
+        break;
+      }
+      unpack_regs (&regs, raw);
+      emu2_set_regs (machine, &regs);
+      *reply = ok;
+      break;
+    case 'p':
+      addr = strtoul (packet + 1, NULL, 16);
+      if (addr >= REGISTER_COUNT) {
+        *reply = error;
+        break;
+      }
+      emu2_get_regs (machine, &regs);
+      pack_regs (&regs, raw);
+      encode_hex (packet, raw + addr, addr == REGISTER_COUNT - 1 ? 2 : 1);
+      *reply = packet;
+      break;
+    case 'P':
+      addr = strtoul (packet + 1, &end, 16);
+      if (addr >= REGISTER_COUNT || *end != '=') {
+        *reply = error;
+        break;
+      }
+      emu2_get_regs (machine, &regs);
+      pack_regs (&regs, raw);
+      decode_hex (raw + addr, end + 1, addr == REGISTER_COUNT - 1 ? 2 : 1);
+      unpack_regs (&regs, raw);
+      emu2_set_regs (machine, &regs);
+      *reply = ok;
+      break;
+    case 'm':
+      if (parse_range (packet + 1, &addr, &len) == NULL) {
+        *reply = error;
+        break;
+      }
+      if (len > sizeof (stub->block))
+        len = sizeof (stub->block);
+      emu2_read_block (machine, addr, stub->block, len);
+      encode_hex (packet, stub->block, len);
+      *reply = packet;
+      break;
+    case 'M':
+      rest = parse_range (packet + 1, &addr, &len);
+      if (rest == NULL || *rest != ':' || len > sizeof (stub->block)
+          || decode_hex (stub->block, rest + 1, len) != len) {
+        *reply = error;
+        break;
+      }
+      emu2_write_block (machine, addr, stub->block, len);
+      *reply = ok;
+      break;
+    case 'Z':
+    case 'z':
+      /* Software and hardware breakpoints are the same thing here */
+      if ((packet[1] != '0' && packet[1] != '1') || packet[2] != ','
+          || parse_range (packet + 3, &addr, &len) == NULL)
+        break;
+      if (packet[0] == 'z')
+        remove_breakpoint (stub, addr);
+      else if (insert_breakpoint (stub, addr) != EMU2_OK) {
+        *reply = error;
+        break;
+      }
+      *reply = ok;
+      break;
+    case 'c':
+    case 's':
+      if (packet[1] != '\0') {
+        emu2_get_regs (machine, &regs);
+        regs.pc = strtoul (packet + 1, NULL, 16);
+        emu2_set_regs (machine, &regs);
+      }
+      *reply = resume (stub, packet[0] == 's');
+      break;
+    case 'D':
+      send_packet (stub, ok);
+      return SESSION_DETACHED;
+    case 'k':
+      return SESSION_KILLED;
+    case 'H':
+      *reply = ok;
+      break;
+    case 'q':
+      if (strncmp (packet, "qSupported", 10) == 0)
+        *reply = "PacketSize=4000;QStartNoAckMode+";
+      else if (strcmp (packet, "qAttached") == 0)
+        *reply = "1";
+      break;
+    case 'Q':
+      if (strcmp (packet, "QStartNoAckMode") == 0) {
+        send_packet (stub, ok);
+        stub->no_ack = 1;
+        *reply = NULL;
+      }
+      break;
+    default:
+      break;
+  }
+
+  return SESSION_ACTIVE;
+}
+
+static session_t
+serve (gdbstub_t* stub)
+{
+  const char* reply;
+  session_t session;
+
+  stub->no_ack = 0;
+  stub->input_pos = stub->input_len = 0;
+
+  for (;;) {
+    if (receive_packet (stub) < 0)
+      return SESSION_DETACHED;
+
+    session = handle_packet (stub, &reply);
+    if (session != SESSION_ACTIVE)
+      return session;
+
+    if (reply != NULL && send_packet (stub, reply) < 0)
+      return SESSION_DETACHED;
+  }
+}
+
+static int
+listen_on (gdbstub_t* stub, const char* address)
+{
+  int fd;
+
+  if (strncmp (address, "unix:", 5) == 0) {
+    struct sockaddr_un addr = {0};
+
+    if (strlen (address + 5) >= sizeof (addr.sun_path))
+      return -1;
+
+    addr.sun_family = AF_UNIX;
+    strcpy (addr.sun_path, address + 5);
+    strcpy (stub->unix_path, address + 5);
+    unlink (addr.sun_path);
+
+    fd = socket (AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || bind (fd, (struct sockaddr*) &addr, sizeof (addr)) < 0)
+      goto fail;
+  } else {
+    struct sockaddr_in addr = {0};
+    int reuse = 1;
+
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons ((uint16_t) strtoul (address, NULL, 10));
+    addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+
+    fd = socket (AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+      return -1;
+
+    setsockopt (fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof (reuse));
+    if (bind (fd, (struct sockaddr*) &addr, sizeof (addr)) < 0)
+      goto fail;
+  }
+
+  if (listen (fd, 1) < 0)
+    goto fail;
+
+  return fd;
+
+fail:
+  if (fd >= 0)
+    close (fd);
+  return -1;
+}
+
+gdbstub_t*
+gdbstub_create (emu2_machine_t* machine, const char* address)
+{
+  gdbstub_t* stub = calloc (1, sizeof (*stub));
+
+  if (stub == NULL)
+    return NULL;
+
+  stub->machine = machine;
+  stub->client_fd = -1;
+  stub->listen_fd = listen_on (stub, address);
+
+  if (stub->listen_fd < 0) {
+    free (stub);
+    return NULL;
+  }
+
+  return stub;
+}
+
+void
+gdbstub_destroy (gdbstub_t* stub)
+{
+  if (stub == NULL)
+    return;
+
+  close (stub->listen_fd);
+  if (stub->unix_path[0] != '\0')
+    unlink (stub->unix_path);
+
+  free (stub);
+}
+
+/* Serves a debugger connecting within the timeout, in milliseconds or -1 */
+static int
+attach (gdbstub_t* stub, int timeout, const char* stop)
+{
+  struct pollfd pfd = {stub->listen_fd, POLLIN, 0};
+
+  if (poll (&pfd, 1, timeout) <= 0)
+    return 0;
+
+  stub->client_fd = accept (stub->listen_fd, NULL, NULL);
+  if (stub->client_fd < 0)
+    return 0;
+
+  int nodelay = 1;
+  setsockopt (stub->client_fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof (nodelay));
+
+  stub->stop = stop;
+  session_t session = serve (stub);
+
+  close (stub->client_fd);
+  stub->client_fd = -1;
+  for (unsigned int addr = 0; addr < EMU2_MEMORY_SIZE; addr++)
+    remove_breakpoint (stub, addr);
+
+  return session == SESSION_KILLED ? -1 : 0;
+}
+
+int
+gdbstub_poll (gdbstub_t* stub)
+{
+  return attach (stub, 0, SIGNAL_TRAP);
+}
+
+int
+gdbstub_wait (gdbstub_t* stub, emu2_status_t status)
+{
+  return attach (stub, -1, stop_signal (status, 0));
+}
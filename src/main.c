@@ -0,0 +1,197 @@
+/**
+ * main.c
+ *
+ * Command line runner of the MOS 6502 emulator.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "debugger.h"
+#include "emu2.h"
+#include "file.h"
+#include "gdbstub.h"
+#include "metrics.h"
+#include "pack.h"
+
+#define RUN_SLICE 1000000
+#define METRICS_INTERVAL 1000
+
+static void
+usage (const char* name)
+{
+  fprintf (stderr, "Usage: %s [-l LOAD] [-p PC] [-c CYCLES] [-x] [-d] [-g PORT|unix:PATH] [-m FILE|unix:PATH] FILE|PACK[:NAME]\n", name);
+  exit (EXIT_FAILURE);
+}
+
+static void
+print_regs (const emu2_machine_t* machine)
+{
+  emu2_regs_t regs;
+
+  emu2_get_regs (machine, &regs);
+  printf ("pc=%04x a=%02x x=%02x y=%02x sp=%02x p=%02x cycles=%" PRIu64 "\n",
+          regs.pc, regs.a, regs.x, regs.y, regs.sp, regs.p,
+          emu2_get_cycles (machine));
+}
+
+/* Explains why a run stopped early, returning non-zero if it failed */
+static int
+report (emu2_status_t status)
+{
+  switch (status) {
+    case EMU2_OK:
+      return 0;
+    case EMU2_BREAKPOINT:
+      fprintf (stderr, "CPU stopped at a breakpoint.\n");
+      return 0;
+    case EMU2_STALLED:
+      fprintf (stderr, "CPU stalled on undefined opcode.\n");
+      return 1;
+    case EMU2_NOMEM:
+      fprintf (stderr, "Could not allocate memory page.\n");
+      return 1;
+    case EMU2_DIVERGED:
+      fprintf (stderr, "Replay diverged from its log.\n");
+      return 1;
+    default:
+      fprintf (stderr, "Run failed with status %d.\n", status);
+      return 1;
+  }
+}
+
+int
+main (int argc, char* argv[])
+{
+  unsigned long load = 0;
+  long start = -1;
+  uint64_t cycles = UINT64_MAX;
+  const char* debug = NULL;
+  const char* export = NULL;
+  int exact = 0;
+  int interactive = 0;
+  int opt;
+
+  while ((opt = getopt (argc, argv, "l:p:c:xdg:m:")) != -1) {
+    switch (opt) {
+      case 'l':
+        load = strtoul (optarg, NULL, 16) & UINT16_MAX;
+        break;
+      case 'p':
+        start = strtol (optarg, NULL, 16) & UINT16_MAX;
+        break;
+      case 'c':
+        cycles = strtoull (optarg, NULL, 10);
+        break;
+      case 'x':
+        exact = 1;
+        break;
+      case 'd':
+        interactive = 1;
+        break;
+      case 'g':
+        debug = optarg;
+        break;
+      case 'm':
+        export = optarg;
+        break;
+      default:
+        usage (argv[0]);
+    }
+  }
+
+  if (optind != argc - 1)
+    usage (argv[0]);
+
+  emu2_machine_t* machine = emu2_create (NULL);
+  if (machine == NULL) {
+    fprintf (stderr, "Could not allocate machine.\n");
+    exit (EXIT_FAILURE);
+  }
+
+  emu2_set_cycle_exact (machine, exact);
+
+  /* Images in packs come with their load address and are mapped page by page */
+  uint8_t* buf = NULL;
+  size_t image;
+  emu2_status_t mapped;
+  pack_t* pack = open_pack (argv[optind], &image);
+  if (pack != NULL) {
+    mapped = pack_map (pack, image, machine);
+  } else {
+    size_t fsize = read_file (argv[optind], &buf);
+    mapped = emu2_map_image (machine, load, buf, fsize);
+  }
+
+  if (mapped != EMU2_OK) {
+    fprintf (stderr, "Could not allocate machine.\n");
+    exit (EXIT_FAILURE);
+  }
+
+  emu2_reset (machine);
+  if (start >= 0) {
+    emu2_regs_t regs;
+    emu2_get_regs (machine, &regs);
+    regs.pc = start;
+    emu2_set_regs (machine, &regs);
+  }
+
+  gdbstub_t* stub = NULL;
+  if (debug != NULL && (stub = gdbstub_create (machine, debug)) == NULL) {
+    fprintf (stderr, "Could not listen for debugger on %s.\n", debug);
+    exit (EXIT_FAILURE);
+  }
+
+  metrics_t* metrics = NULL;
+  if (export != NULL) {
+    if ((metrics = metrics_create (1)) == NULL
+        || metrics_export (metrics, export, METRICS_INTERVAL) != 0) {
+      fprintf (stderr, "Could not export metrics to %s.\n", export);
+      exit (EXIT_FAILURE);
+    }
+    metrics_attach (machine, metrics, 0);
+  }
+
+  emu2_status_t status = EMU2_OK;
+  int killed = 0;
+  if (interactive) {
+    if (debugger_run (machine, STDIN_FILENO, STDOUT_FILENO) != 0) {
+      fprintf (stderr, "Debugger needs a terminal.\n");
+      exit (EXIT_FAILURE);
+    }
+  } else if (stub == NULL && metrics == NULL) {
+    status = emu2_run (machine, cycles);
+  } else {
+    /*
+     * The stub is only polled and the counters only published between
+     * slices, so the core runs undisturbed
+     */
+    uint64_t const now = emu2_get_cycles (machine);
+    uint64_t const until = cycles > UINT64_MAX - now ? UINT64_MAX : now + cycles;
+    do {
+      uint64_t remaining = until - emu2_get_cycles (machine);
+      status = emu2_run (machine, remaining < RUN_SLICE ? remaining : RUN_SLICE);
+      if (status == EMU2_OK && stub != NULL && gdbstub_poll (stub) != 0)
+        killed = 1;
+    } while (status == EMU2_OK && !killed && emu2_get_cycles (machine) < until);
+  }
+
+  int const failed = report (status);
+
+  /* A debugger can still inspect the machine where the run stopped */
+  if (stub != NULL && !killed) {
+    fprintf (stderr, "Waiting for debugger on %s.\n", debug);
+    gdbstub_wait (stub, status);
+  }
+
+  print_regs (machine);
+  gdbstub_destroy (stub);
+  metrics_attach (machine, NULL, 0);
+  metrics_destroy (metrics);
+  emu2_destroy (machine);
+  pack_close (pack);
+  free (buf);
+
+  exit (failed ? EXIT_FAILURE : EXIT_SUCCESS);
+}
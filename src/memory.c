@@ -0,0 +1,111 @@
+/**
+ * memory.c
+ *
+ * Copy-on-write page map of the address space.
+ */
+
+#include <string.h>
+#include "memory.h"
+
+/* Shared by all buses for every page that was never written */
+static uint8_t const zero_page[BUS_PAGE_SIZE];
+
+void
+bus_init (bus_t* bus, page_alloc_t alloc, page_free_t free, void* user)
+{
+  bus->page_alloc = alloc;
+  bus->page_free = free;
+  bus->page_user = user;
+  bus->failed = 0;
+  bus->source = NULL;
+
+  for (unsigned int page = 0; page < PAGE_COUNT; page++) {
+    bus->pages[page] = (uint8_t*) zero_page;
+    bus->page_flags[page] = PAGE_SHARED;
+  }
+}
+
+void
+bus_free (bus_t* bus)
+{
+  for (unsigned int page = 0; page < PAGE_COUNT; page++)
+    bus_share_page (bus, page, NULL);
+}
+
+uint8_t*
+bus_own_page (bus_t* bus, unsigned int page)
+{
+  if (!(bus->page_flags[page] & PAGE_SHARED))
+    return bus->pages[page];
+
+  if (bus->page_flags[page] & PAGE_LAZY)
+    bus_fault (bus, page);
+
+  uint8_t* owned = bus->page_alloc (BUS_PAGE_SIZE, bus->page_user);
+  if (owned == NULL) {
+    bus->failed = 1;
+    return NULL;
+  }
+
+  memcpy (owned, bus->pages[page], BUS_PAGE_SIZE);
+  bus->pages[page] = owned;
+  bus->page_flags[page] &= ~PAGE_SHARED;
+  return owned;
+}
+
+void
+bus_share_page (bus_t* bus, unsigned int page, const uint8_t* contents)
+{
+  if (!(bus->page_flags[page] & PAGE_SHARED))
+    bus->page_free (bus->pages[page], bus->page_user);
+
+  /* Shared pages are never written through, see bus_poke() */
+  bus->pages[page] = (uint8_t*) (contents != NULL ? contents : zero_page);
+  bus->page_flags[page] = (bus->page_flags[page] & ~PAGE_LAZY) | PAGE_SHARED;
+}
+
+void
+bus_map_source (bus_t* bus, unsigned int first, unsigned int count,
+                page_source_t source, void* user)
+{
+  if (bus->source != source || bus->source_user != user) {
+    for (unsigned int page = 0; page < PAGE_COUNT; page++) {
+      if (bus->page_flags[page] & PAGE_LAZY)
+        bus_fault (bus, page);
+    }
+  }
+
+  bus->source = source;
+  bus->source_user = user;
+  for (unsigned int page = first; page < first + count && page < PAGE_COUNT; page++) {
+    bus_share_page (bus, page, NULL);
+    bus->page_flags[page] |= PAGE_LAZY;
+  }
+}
+
+void
+bus_fault (bus_t* bus, unsigned int page)
+{
+  uint8_t const* contents = bus->source (page, bus->source_user);
+
+  if (contents == NULL)
+    bus->failed = 1;
+
+  bus_share_page (bus, page, contents);
+}
+
+uint8_t
+bus_read_trap (bus_t* bus, uint16_t addr)
+{
+  if (bus->page_flags[addr >> 8] & PAGE_IO)
+    return bus->io_read (addr, bus->io_user);
+
+  bus_fault (bus, addr >> 8);
+  return bus->pages[addr >> 8][addr & 0xFF];
+}
+
+int
+bus_is_zero_page (const bus_t* bus, unsigned int page)
+{
+  return bus->pages[page] == zero_page;
+}
@@ -0,0 +1,341 @@
+/**
+ * metrics.c
+ *
+ * Aggregation and export of the runtime counters.
+ */
+
+#include <inttypes.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "machine.h"
+#include "metrics.h"
+
+#define UNIX_PREFIX "unix:"
+
+struct metrics {
+    metrics_slot_t* slots;                /* One per thread */
+    size_t count;
+
+    uint64_t window_cycles;               /* Cycles at the start of the rate window */
+    struct timespec window_time;          /* Start of the rate window */
+    double mhz;                           /* Clock rate over the last window */
+
+    pthread_t thread;                     /* Exporter, if running */
+    int running;
+    int wake[2];                          /* Pipe stopping the exporter */
+    int listen_fd;                        /* Socket of the exporter, or -1 */
+    char* path;                           /* File or socket written to */
+    unsigned int interval;
+};
+
+metrics_t*
+metrics_create (size_t threads)
+{
+  metrics_t* metrics = calloc (1, sizeof (*metrics));
+
+  if (metrics == NULL)
+    return NULL;
+
+  if (threads == 0)
+    threads = 1;
+
+  size_t const size = threads * sizeof (metrics_slot_t);
+  metrics->slots = aligned_alloc (METRICS_LINE_SIZE, size);
+  if (metrics->slots == NULL) {
+    free (metrics);
+    return NULL;
+  }
+
+  memset (metrics->slots, 0, size);
+  metrics->count = threads;
+  metrics->listen_fd = -1;
+  clock_gettime (CLOCK_MONOTONIC, &metrics->window_time);
+
+  return metrics;
+}
+
+int
+metrics_attach (emu2_machine_t* machine, metrics_t* metrics, size_t thread)
+{
+  metrics_sample_t const current = {
+      machine->cpu.instructions,
+      machine->cpu.fused,
+      machine->cycles,
+      machine->cpu.interrupts,
+      machine->stalls,
+  };
+
+  if (metrics != NULL && thread >= metrics->count)
+    return -1;
+
+  /* Only progress made from now on is counted */
+  machine->metrics = metrics != NULL ? &metrics->slots[thread] : NULL;
+  machine->published = current;
+  return 0;
+}
+
+static void
+write_counter (FILE* dest, const char* name, const char* help, uint64_t value)
+{
+  fprintf (dest, "# HELP %s %s\n# TYPE %s counter\n%s %" PRIu64 "\n",
+           name, help, name, name, value);
+}
+
+static void
+write_gauge (FILE* dest, const char* name, const char* help, double value)
+{
+  fprintf (dest, "# HELP %s %s\n# TYPE %s gauge\n%s %.6g\n", name, help, name, name, value);
+}
+
+static void
+sum_slots (const metrics_t* metrics, metrics_sample_t* total)
+{
+  memset (total, 0, sizeof (*total));
+  for (size_t i = 0; i < metrics->count; i++) {
+    metrics_slot_t* slot = &metrics->slots[i];
+
+    total->instructions += atomic_load_explicit (&slot->instructions, memory_order_relaxed);
+    total->fused += atomic_load_explicit (&slot->fused, memory_order_relaxed);
+    total->cycles += atomic_load_explicit (&slot->cycles, memory_order_relaxed);
+    total->interrupts += atomic_load_explicit (&slot->interrupts, memory_order_relaxed);
+    total->stalls += atomic_load_explicit (&slot->stalls, memory_order_relaxed);
+  }
+}
+
+/*
+ * Measures the clock rate over the window ending now and starts the next.
+ * Only the exporter does so, on its own schedule, so readers of the counters
+ * all see the same rate however often they ask.
+ */
+static void
+measure_rate (metrics_t* metrics, const struct timespec* now)
+{
+  metrics_sample_t total;
+
+  sum_slots (metrics, &total);
+  double const elapsed = (now->tv_sec - metrics->window_time.tv_sec) * 1e6
+                         + (now->tv_nsec - metrics->window_time.tv_nsec) / 1e3;
+  metrics->mhz = elapsed > 0 ? (total.cycles - metrics->window_cycles) / elapsed : 0;
+  metrics->window_cycles = total.cycles;
+  metrics->window_time = *now;
+}
+
+int
+metrics_write (metrics_t* metrics, FILE* dest)
+{
+  metrics_sample_t total;
+
+  sum_slots (metrics, &total);
+
+  write_counter (dest, "emu2_instructions_total", "Instructions executed.",
+                 total.instructions);
+  write_counter (dest, "emu2_fused_instructions_total",
+                 "Instructions executed in fused sequences.", total.fused);
+  write_gauge (dest, "emu2_fused_ratio", "Share of instructions executed in fused sequences.",
+               total.instructions > 0 ? (double) total.fused / total.instructions : 0);
+  write_counter (dest, "emu2_cycles_total", "Clock cycles emulated.", total.cycles);
+  write_gauge (dest, "emu2_emulated_mhz", "Emulated clock rate over the last export interval.",
+               metrics->mhz);
+  write_counter (dest, "emu2_interrupts_total", "Interrupts taken.", total.interrupts);
+  write_counter (dest, "emu2_stalls_total", "Runs stopped on undefined opcodes.",
+                 total.stalls);
+
+  return ferror (dest) ? -1 : 0;
+}
+
+/* Replaces the file as a whole, so readers never see a partial export */
+static void
+write_file (metrics_t* metrics)
+{
+  size_t const len = strlen (metrics->path) + sizeof (".tmp");
+  char* temp = malloc (len);
+
+  if (temp == NULL)
+    return;
+
+  snprintf (temp, len, "%s.tmp", metrics->path);
+  FILE* file = fopen (temp, "w");
+  if (file != NULL) {
+    int const failed = metrics_write (metrics, file);
+
+    if (fclose (file) == 0 && failed == 0)
+      rename (temp, metrics->path);
+    else
+      unlink (temp);
+  }
+
+  free (temp);
+}
+
+static void
+write_client (metrics_t* metrics)
+{
+  int const fd = accept (metrics->listen_fd, NULL, NULL);
+  char* text = NULL;
+  size_t len = 0;
+
+  if (fd < 0)
+    return;
+
+  /* Written in one go, as the client may hang up at any time */
+  FILE* stream = open_memstream (&text, &len);
+  if (stream != NULL) {
+    metrics_write (metrics, stream);
+    fclose (stream);
+
+    for (size_t sent = 0; sent < len;) {
+      ssize_t const n = send (fd, text + sent, len - sent, MSG_NOSIGNAL);
+      if (n <= 0)
+        break;
+      sent += n;
+    }
+    free (text);
+  }
+
+  close (fd);
+}
+
+/* Returns the milliseconds left until a point in time, rounded up */
+static int
+remaining (const struct timespec* deadline)
+{
+  struct timespec now;
+
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  long long const ns = (deadline->tv_sec - now.tv_sec) * 1000000000LL
+                       + (deadline->tv_nsec - now.tv_nsec);
+
+  return ns > 0 ? (int) ((ns + 999999) / 1000000) : 0;
+}
+
+static void*
+export_loop (void* arg)
+{
+  metrics_t* metrics = arg;
+  struct pollfd fds[2] = {
+      {metrics->wake[0], POLLIN, 0},
+      {metrics->listen_fd, POLLIN, 0},
+  };
+  int const serving = metrics->listen_fd >= 0;
+  struct timespec deadline;
+
+  /* The rate is measured every interval, also while serving a socket */
+  clock_gettime (CLOCK_MONOTONIC, &deadline);
+  for (;;) {
+    deadline.tv_sec += metrics->interval / 1000;
+    deadline.tv_nsec += metrics->interval % 1000 * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000L;
+    }
+
+    int ready;
+    while ((ready = poll (fds, serving ? 2 : 1, remaining (&deadline))) > 0
+           && fds[0].revents == 0) {
+      if (serving && fds[1].revents != 0)
+        write_client (metrics);
+    }
+
+    if (ready < 0 || fds[0].revents != 0)
+      break;
+
+    clock_gettime (CLOCK_MONOTONIC, &deadline);
+    measure_rate (metrics, &deadline);
+    if (!serving)
+      write_file (metrics);
+  }
+
+  if (!serving)
+    write_file (metrics);
+
+  return NULL;
+}
+
+static int
+listen_on (const char* path)
+{
+  struct sockaddr_un addr = {0};
+
+  if (strlen (path) >= sizeof (addr.sun_path))
+    return -1;
+
+  addr.sun_family = AF_UNIX;
+  strcpy (addr.sun_path, path);
+  unlink (path);
+
+  int const fd = socket (AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0)
+    return -1;
+
+  if (bind (fd, (struct sockaddr*) &addr, sizeof (addr)) < 0 || listen (fd, 8) < 0) {
+    close (fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+int
+metrics_export (metrics_t* metrics, const char* target, unsigned int interval)
+{
+  size_t const prefix = strlen (UNIX_PREFIX);
+  int const serving = strncmp (target, UNIX_PREFIX, prefix) == 0;
+
+  if (metrics->running || (metrics->path = strdup (serving ? target + prefix : target)) == NULL)
+    return -1;
+
+  metrics->interval = interval > 0 ? interval : 1;
+  if (serving && (metrics->listen_fd = listen_on (metrics->path)) < 0)
+    goto fail;
+
+  if (pipe (metrics->wake) != 0)
+    goto fail;
+
+  if (pthread_create (&metrics->thread, NULL, export_loop, metrics) != 0) {
+    close (metrics->wake[0]);
+    close (metrics->wake[1]);
+    goto fail;
+  }
+
+  metrics->running = 1;
+  return 0;
+
+fail:
+  if (metrics->listen_fd >= 0) {
+    close (metrics->listen_fd);
+    unlink (metrics->path);
+    metrics->listen_fd = -1;
+  }
+  free (metrics->path);
+  metrics->path = NULL;
+  return -1;
+}
+
+void
+metrics_destroy (metrics_t* metrics)
+{
+  if (metrics == NULL)
+    return;
+
+  if (metrics->running) {
+    if (write (metrics->wake[1], "", 1) == 1)
+      pthread_join (metrics->thread, NULL);
+    close (metrics->wake[0]);
+    close (metrics->wake[1]);
+  }
+
+  if (metrics->listen_fd >= 0) {
+    close (metrics->listen_fd);
+    unlink (metrics->path);
+  }
+
+  free (metrics->path);
+  free (metrics->slots);
+  free (metrics);
+}
@@ -7,308 +7,698 @@
 
 #define UNDEF_OPCODE {UNDEFINED_OP, UNDEFINED_MODE}
 
-static const opcode_t opcodes[UINT8_MAX] = {
+static const opcode_t nmos_opcodes[UINT8_MAX + 1] = {
     /* 0x0X instructions */
     {BRK, IMPLICIT},
     {ORA, INDEXED_INDIRECT},
     UNDEF_OPCODE,
-    UNDEF_OPCODE,
-    UNDEF_OPCODE,
+    {SLO, INDEXED_INDIRECT},
+    {NOP, ZERO_PAGE},
     {ORA, ZERO_PAGE},
     {ASL, ZERO_PAGE},
-    UNDEF_OPCODE,
+    {SLO, ZERO_PAGE},
     {PHP, IMPLICIT},
     {ORA, IMMEDIATE},
     {ASL, ACCUMULATOR},
-    UNDEF_OPCODE,
-    UNDEF_OPCODE,
+    {ANC, IMMEDIATE},
+    {NOP, ABSOLUTE},
     {ORA, ABSOLUTE},
     {ASL, ABSOLUTE},
-    UNDEF_OPCODE,
+    {SLO, ABSOLUTE},
 
     /* 0x1X instructions */
     {BPL, RELATIVE},
     {ORA, INDIRECT_INDEXED},
     UNDEF_OPCODE,
-    UNDEF_OPCODE,
-    UNDEF_OPCODE,
+    {SLO, INDIRECT_INDEXED},
+    {NOP, ZERO_PAGE_X},
     {ORA, ZERO_PAGE_X},
     {ASL, ZERO_PAGE_X},
-    UNDEF_OPCODE,
+    {SLO, ZERO_PAGE_X},
     {CLC, IMPLICIT},
     {ORA, ABSOLUTE_Y},
-    UNDEF_OPCODE,
-    UNDEF_OPCODE,
-    UNDEF_OPCODE,
+    {NOP, IMPLICIT},
+    {SLO, ABSOLUTE_Y},
+    {NOP, ABSOLUTE_X},
     {ORA, ABSOLUTE_X},
     {ASL, ABSOLUTE_X},
-    UNDEF_OPCODE,
+    {SLO, ABSOLUTE_X},
 
     /* 0x2X instructions */
     {JSR, ABSOLUTE},
     {AND, INDEXED_INDIRECT},
     UNDEF_OPCODE,
-    UNDEF_OPCODE,
+    {RLA, INDEXED_INDIRECT},
     {BIT, ZERO_PAGE},
     {AND, ZERO_PAGE},
     {ROL, ZERO_PAGE},
-    UNDEF_OPCODE,
+    {RLA, ZERO_PAGE},
     {PLP, IMPLICIT},
     {AND, IMMEDIATE},
     {ROL, ACCUMULATOR},
-    UNDEF_OPCODE,
+    {ANC, IMMEDIATE},
     {BIT, ABSOLUTE},
     {AND, ABSOLUTE},
     {ROL, ABSOLUTE},
-    UNDEF_OPCODE,
+    {RLA, ABSOLUTE},
 
     /* 0x3X instructions */
     {BMI, RELATIVE},
     {AND, INDIRECT_INDEXED},
     UNDEF_OPCODE,
-    UNDEF_OPCODE,
-    UNDEF_OPCODE,
+    {RLA, INDIRECT_INDEXED},
+    {NOP, ZERO_PAGE_X},
     {AND, ZERO_PAGE_X},
     {ROL, ZERO_PAGE_X},
-    UNDEF_OPCODE,
+    {RLA, ZERO_PAGE_X},
     {SEC, IMPLICIT},
     {AND, ABSOLUTE_Y},
-    UNDEF_OPCODE,
-    UNDEF_OPCODE,
-    UNDEF_OPCODE,
+    {NOP, IMPLICIT},
+    {RLA, ABSOLUTE_Y},
+    {NOP, ABSOLUTE_X},
     {AND, ABSOLUTE_X},
     {ROL, ABSOLUTE_X},
-    UNDEF_OPCODE,
+    {RLA, ABSOLUTE_X},
 
     /* 0x4X instructions */
     {RTI, IMPLICIT},
     {EOR, INDEXED_INDIRECT},
     UNDEF_OPCODE,
-    UNDEF_OPCODE,
-    UNDEF_OPCODE,
+    {SRE, INDEXED_INDIRECT},
+    {NOP, ZERO_PAGE},
     {EOR, ZERO_PAGE},
     {LSR, ZERO_PAGE},
-    UNDEF_OPCODE,
+    {SRE, ZERO_PAGE},
     {PHA, IMPLICIT},
     {EOR, IMMEDIATE},
     {LSR, ACCUMULATOR},
-    UNDEF_OPCODE,
+    {ALR, IMMEDIATE},
     {JMP, ABSOLUTE},
     {EOR, ABSOLUTE},
     {LSR, ABSOLUTE},
-    UNDEF_OPCODE,
+    {SRE, ABSOLUTE},
 
     /* 0x5X instructions */
     {BVC, RELATIVE},
     {EOR, INDIRECT_INDEXED},
     UNDEF_OPCODE,
-    UNDEF_OPCODE,
-    UNDEF_OPCODE,
+    {SRE, INDIRECT_INDEXED},
+    {NOP, ZERO_PAGE_X},
     {EOR, ZERO_PAGE_X},
     {LSR, ZERO_PAGE_X},
-    UNDEF_OPCODE,
+    {SRE, ZERO_PAGE_X},
     {CLI, IMPLICIT},
     {EOR, ABSOLUTE_Y},
-    UNDEF_OPCODE,
-    UNDEF_OPCODE,
-    UNDEF_OPCODE,
+    {NOP, IMPLICIT},
+    {SRE, ABSOLUTE_Y},
+    {NOP, ABSOLUTE_X},
     {EOR, ABSOLUTE_X},
     {LSR, ABSOLUTE_X},
-    UNDEF_OPCODE,
+    {SRE, ABSOLUTE_X},
 
     /* 0x6X instructions */
     {RTS, IMPLICIT},
     {ADC, INDEXED_INDIRECT},
     UNDEF_OPCODE,
-    UNDEF_OPCODE,
-    UNDEF_OPCODE,
+    {RRA, INDEXED_INDIRECT},
+    {NOP, ZERO_PAGE},
     {ADC, ZERO_PAGE},
     {ROR, ZERO_PAGE},
-    UNDEF_OPCODE,
+    {RRA, ZERO_PAGE},
     {PLA, IMPLICIT},
     {ADC, IMMEDIATE},
     {ROR, ACCUMULATOR},
-    UNDEF_OPCODE,
+    {ARR, IMMEDIATE},
     {JMP, INDIRECT},
     {ADC, ABSOLUTE},
     {ROR, ABSOLUTE},
-    UNDEF_OPCODE,
+    {RRA, ABSOLUTE},
 
     /* 0x7X instructions */
     {BVS, RELATIVE},
     {ADC, INDIRECT_INDEXED},
     UNDEF_OPCODE,
-    UNDEF_OPCODE,
-    UNDEF_OPCODE,
+    {RRA, INDIRECT_INDEXED},
+    {NOP, ZERO_PAGE_X},
     {ADC, ZERO_PAGE_X},
     {ROR, ZERO_PAGE_X},
-    UNDEF_OPCODE,
+    {RRA, ZERO_PAGE_X},
     {SEI, IMPLICIT},
     {ADC, ABSOLUTE_Y},
-    UNDEF_OPCODE,
-    UNDEF_OPCODE,
-    UNDEF_OPCODE,
+    {NOP, IMPLICIT},
+    {RRA, ABSOLUTE_Y},
+    {NOP, ABSOLUTE_X},
     {ADC, ABSOLUTE_X},
     {ROR, ABSOLUTE_X},
-    UNDEF_OPCODE,
+    {RRA, ABSOLUTE_X},
 
-    /* 0x8A instructions */
-    UNDEF_OPCODE,
+    /* 0x8X instructions */
+    {NOP, IMMEDIATE},
     {STA, INDEXED_INDIRECT},
-    UNDEF_OPCODE,
-    UNDEF_OPCODE,
+    {NOP, IMMEDIATE},
+    {SAX, INDEXED_INDIRECT},
     {STY, ZERO_PAGE},
     {STA, ZERO_PAGE},
     {STX, ZERO_PAGE},
-    UNDEF_OPCODE,
+    {SAX, ZERO_PAGE},
     {DEY, IMPLICIT},
-    UNDEF_OPCODE,
+    {NOP, IMMEDIATE},
     {TXA, IMPLICIT},
-    UNDEF_OPCODE,
+    {ANE, IMMEDIATE},
     {STY, ABSOLUTE},
     {STA, ABSOLUTE},
     {STX, ABSOLUTE},
-    UNDEF_OPCODE,
+    {SAX, ABSOLUTE},
 
-    /* 0x9A instructions */
+    /* 0x9X instructions */
     {BCC, RELATIVE},
     {STA, INDIRECT_INDEXED},
     UNDEF_OPCODE,
-    UNDEF_OPCODE,
+    {SHA, INDIRECT_INDEXED},
     {STY, ZERO_PAGE_X},
     {STA, ZERO_PAGE_X},
     {STX, ZERO_PAGE_Y},
-    UNDEF_OPCODE,
+    {SAX, ZERO_PAGE_Y},
     {TYA, IMPLICIT},
     {STA, ABSOLUTE_Y},
     {TXS, IMPLICIT},
-    UNDEF_OPCODE,
-    UNDEF_OPCODE,
+    {TAS, ABSOLUTE_Y},
+    {SHY, ABSOLUTE_X},
     {STA, ABSOLUTE_X},
-    UNDEF_OPCODE,
-    UNDEF_OPCODE,
+    {SHX, ABSOLUTE_Y},
+    {SHA, ABSOLUTE_Y},
 
     /* 0xAX instructions */
     {LDY, IMMEDIATE},
     {LDA, INDEXED_INDIRECT},
     {LDX, IMMEDIATE},
-    UNDEF_OPCODE,
+    {LAX, INDEXED_INDIRECT},
     {LDY, ZERO_PAGE},
     {LDA, ZERO_PAGE},
     {LDX, ZERO_PAGE},
-    UNDEF_OPCODE,
+    {LAX, ZERO_PAGE},
     {TAY, IMPLICIT},
     {LDA, IMMEDIATE},
     {TAX, IMPLICIT},
-    UNDEF_OPCODE,
+    {LXA, IMMEDIATE},
     {LDY, ABSOLUTE},
     {LDA, ABSOLUTE},
     {LDX, ABSOLUTE},
-    UNDEF_OPCODE,
+    {LAX, ABSOLUTE},
 
     /* 0xBX instructions */
     {BCS, RELATIVE},
     {LDA, INDIRECT_INDEXED},
     UNDEF_OPCODE,
-    UNDEF_OPCODE,
+    {LAX, INDIRECT_INDEXED},
     {LDY, ZERO_PAGE_X},
     {LDA, ZERO_PAGE_X},
     {LDX, ZERO_PAGE_Y},
-    UNDEF_OPCODE,
+    {LAX, ZERO_PAGE_Y},
     {CLV, IMPLICIT},
     {LDA, ABSOLUTE_Y},
     {TSX, IMPLICIT},
-    UNDEF_OPCODE,
+    {LAS, ABSOLUTE_Y},
     {LDY, ABSOLUTE_X},
     {LDA, ABSOLUTE_X},
     {LDX, ABSOLUTE_Y},
-    UNDEF_OPCODE,
+    {LAX, ABSOLUTE_Y},
 
     /* 0xCX instructions */
     {CPY, IMMEDIATE},
     {CMP, INDEXED_INDIRECT},
-    UNDEF_OPCODE,
-    UNDEF_OPCODE,
+    {NOP, IMMEDIATE},
+    {DCP, INDEXED_INDIRECT},
     {CPY, ZERO_PAGE},
     {CMP, ZERO_PAGE},
     {DEC, ZERO_PAGE},
-    UNDEF_OPCODE,
+    {DCP, ZERO_PAGE},
     {INY, IMPLICIT},
     {CMP, IMMEDIATE},
     {DEX, IMPLICIT},
-    UNDEF_OPCODE,
+    {SBX, IMMEDIATE},
     {CPY, ABSOLUTE},
     {CMP, ABSOLUTE},
     {DEC, ABSOLUTE},
-    UNDEF_OPCODE,
+    {DCP, ABSOLUTE},
 
     /* 0xDX instructions */
     {BNE, RELATIVE},
     {CMP, INDIRECT_INDEXED},
     UNDEF_OPCODE,
-    UNDEF_OPCODE,
-    UNDEF_OPCODE,
+    {DCP, INDIRECT_INDEXED},
+    {NOP, ZERO_PAGE_X},
     {CMP, ZERO_PAGE_X},
     {DEC, ZERO_PAGE_X},
-    UNDEF_OPCODE,
+    {DCP, ZERO_PAGE_X},
     {CLD, IMPLICIT},
     {CMP, ABSOLUTE_Y},
-    UNDEF_OPCODE,
-    UNDEF_OPCODE,
-    UNDEF_OPCODE,
+    {NOP, IMPLICIT},
+    {DCP, ABSOLUTE_Y},
+    {NOP, ABSOLUTE_X},
     {CMP, ABSOLUTE_X},
     {DEC, ABSOLUTE_X},
-    UNDEF_OPCODE,
+    {DCP, ABSOLUTE_X},
 
     /* 0xEX instructions */
     {CPX, IMMEDIATE},
     {SBC, INDEXED_INDIRECT},
-    UNDEF_OPCODE,
-    UNDEF_OPCODE,
+    {NOP, IMMEDIATE},
+    {ISC, INDEXED_INDIRECT},
     {CPX, ZERO_PAGE},
     {SBC, ZERO_PAGE},
     {INC, ZERO_PAGE},
-    UNDEF_OPCODE,
+    {ISC, ZERO_PAGE},
     {INX, IMPLICIT},
     {SBC, IMMEDIATE},
     {NOP, IMPLICIT},
-    UNDEF_OPCODE,
+    {SBC, IMMEDIATE},
     {CPX, ABSOLUTE},
     {SBC, ABSOLUTE},
     {INC, ABSOLUTE},
-    UNDEF_OPCODE,
+    {ISC, ABSOLUTE},
 
     /* 0xFX instructions */
     {BEQ, RELATIVE},
     {SBC, INDIRECT_INDEXED},
     UNDEF_OPCODE,
-    UNDEF_OPCODE,
-    UNDEF_OPCODE,
+    {ISC, INDIRECT_INDEXED},
+    {NOP, ZERO_PAGE_X},
     {SBC, ZERO_PAGE_X},
     {INC, ZERO_PAGE_X},
-    UNDEF_OPCODE,
+    {ISC, ZERO_PAGE_X},
     {SED, IMPLICIT},
     {SBC, ABSOLUTE_Y},
-    UNDEF_OPCODE,
-    UNDEF_OPCODE,
-    UNDEF_OPCODE,
+    {NOP, IMPLICIT},
+    {ISC, ABSOLUTE_Y},
+    {NOP, ABSOLUTE_X},
     {SBC, ABSOLUTE_X},
     {INC, ABSOLUTE_X},
+    {ISC, ABSOLUTE_X},
 };
 
-char opcode_names[OPCODE_SIZE][4] = {"", "adc", "and", "asl", "bcc", "bcs", "beq", "bit",
+static const opcode_t cmos_opcodes[UINT8_MAX + 1] = {
+    /* 0x0X instructions */
+    {BRK, IMPLICIT},
+    {ORA, INDEXED_INDIRECT},
+    {NOP, IMMEDIATE},
+    {NOP, IMPLICIT},
+    {TSB, ZERO_PAGE},
+    {ORA, ZERO_PAGE},
+    {ASL, ZERO_PAGE},
+    {NOP, IMPLICIT},
+    {PHP, IMPLICIT},
+    {ORA, IMMEDIATE},
+    {ASL, ACCUMULATOR},
+    {NOP, IMPLICIT},
+    {TSB, ABSOLUTE},
+    {ORA, ABSOLUTE},
+    {ASL, ABSOLUTE},
+    {NOP, IMPLICIT},
+
+    /* 0x1X instructions */
+    {BPL, RELATIVE},
+    {ORA, INDIRECT_INDEXED},
+    {ORA, ZERO_PAGE_INDIRECT},
+    {NOP, IMPLICIT},
+    {TRB, ZERO_PAGE},
+    {ORA, ZERO_PAGE_X},
+    {ASL, ZERO_PAGE_X},
+    {NOP, IMPLICIT},
+    {CLC, IMPLICIT},
+    {ORA, ABSOLUTE_Y},
+    {INC, ACCUMULATOR},
+    {NOP, IMPLICIT},
+    {TRB, ABSOLUTE},
+    {ORA, ABSOLUTE_X},
+    {ASL, ABSOLUTE_X},
+    {NOP, IMPLICIT},
+
+    /* 0x2X instructions */
+    {JSR, ABSOLUTE},
+    {AND, INDEXED_INDIRECT},
+    {NOP, IMMEDIATE},
+    {NOP, IMPLICIT},
+    {BIT, ZERO_PAGE},
+    {AND, ZERO_PAGE},
+    {ROL, ZERO_PAGE},
+    {NOP, IMPLICIT},
+    {PLP, IMPLICIT},
+    {AND, IMMEDIATE},
+    {ROL, ACCUMULATOR},
+    {NOP, IMPLICIT},
+    {BIT, ABSOLUTE},
+    {AND, ABSOLUTE},
+    {ROL, ABSOLUTE},
+    {NOP, IMPLICIT},
+
+    /* 0x3X instructions */
+    {BMI, RELATIVE},
+    {AND, INDIRECT_INDEXED},
+    {AND, ZERO_PAGE_INDIRECT},
+    {NOP, IMPLICIT},
+    {BIT, ZERO_PAGE_X},
+    {AND, ZERO_PAGE_X},
+    {ROL, ZERO_PAGE_X},
+    {NOP, IMPLICIT},
+    {SEC, IMPLICIT},
+    {AND, ABSOLUTE_Y},
+    {DEC, ACCUMULATOR},
+    {NOP, IMPLICIT},
+    {BIT, ABSOLUTE_X},
+    {AND, ABSOLUTE_X},
+    {ROL, ABSOLUTE_X},
+    {NOP, IMPLICIT},
+
+    /* 0x4X instructions */
+    {RTI, IMPLICIT},
+    {EOR, INDEXED_INDIRECT},
+    {NOP, IMMEDIATE},
+    {NOP, IMPLICIT},
+    {NOP, ZERO_PAGE},
+    {EOR, ZERO_PAGE},
+    {LSR, ZERO_PAGE},
+    {NOP, IMPLICIT},
+    {PHA, IMPLICIT},
+    {EOR, IMMEDIATE},
+    {LSR, ACCUMULATOR},
+    {NOP, IMPLICIT},
+    {JMP, ABSOLUTE},
+    {EOR, ABSOLUTE},
+    {LSR, ABSOLUTE},
+    {NOP, IMPLICIT},
+
+    /* 0x5X instructions */
+    {BVC, RELATIVE},
+    {EOR, INDIRECT_INDEXED},
+    {EOR, ZERO_PAGE_INDIRECT},
+    {NOP, IMPLICIT},
+    {NOP, ZERO_PAGE_X},
+    {EOR, ZERO_PAGE_X},
+    {LSR, ZERO_PAGE_X},
+    {NOP, IMPLICIT},
+    {CLI, IMPLICIT},
+    {EOR, ABSOLUTE_Y},
+    {PHY, IMPLICIT},
+    {NOP, IMPLICIT},
+    {NOP, ABSOLUTE},
+    {EOR, ABSOLUTE_X},
+    {LSR, ABSOLUTE_X},
+    {NOP, IMPLICIT},
+
+    /* 0x6X instructions */
+    {RTS, IMPLICIT},
+    {ADC, INDEXED_INDIRECT},
+    {NOP, IMMEDIATE},
+    {NOP, IMPLICIT},
+    {STZ, ZERO_PAGE},
+    {ADC, ZERO_PAGE},
+    {ROR, ZERO_PAGE},
+    {NOP, IMPLICIT},
+    {PLA, IMPLICIT},
+    {ADC, IMMEDIATE},
+    {ROR, ACCUMULATOR},
+    {NOP, IMPLICIT},
+    {JMP, INDIRECT},
+    {ADC, ABSOLUTE},
+    {ROR, ABSOLUTE},
+    {NOP, IMPLICIT},
+
+    /* 0x7X instructions */
+    {BVS, RELATIVE},
+    {ADC, INDIRECT_INDEXED},
+    {ADC, ZERO_PAGE_INDIRECT},
+    {NOP, IMPLICIT},
+    {STZ, ZERO_PAGE_X},
+    {ADC, ZERO_PAGE_X},
+    {ROR, ZERO_PAGE_X},
+    {NOP, IMPLICIT},
+    {SEI, IMPLICIT},
+    {ADC, ABSOLUTE_Y},
+    {PLY, IMPLICIT},
+    {NOP, IMPLICIT},
+    {JMP, ABSOLUTE_INDEXED_INDIRECT},
+    {ADC, ABSOLUTE_X},
+    {ROR, ABSOLUTE_X},
+    {NOP, IMPLICIT},
+
+    /* 0x8X instructions */
+    {BRA, RELATIVE},
+    {STA, INDEXED_INDIRECT},
+    {NOP, IMMEDIATE},
+    {NOP, IMPLICIT},
+    {STY, ZERO_PAGE},
+    {STA, ZERO_PAGE},
+    {STX, ZERO_PAGE},
+    {NOP, IMPLICIT},
+    {DEY, IMPLICIT},
+    {BIT, IMMEDIATE},
+    {TXA, IMPLICIT},
+    {NOP, IMPLICIT},
+    {STY, ABSOLUTE},
+    {STA, ABSOLUTE},
+    {STX, ABSOLUTE},
+    {NOP, IMPLICIT},
+
+    /* 0x9X instructions */
+    {BCC, RELATIVE},
+    {STA, INDIRECT_INDEXED},
+    {STA, ZERO_PAGE_INDIRECT},
+    {NOP, IMPLICIT},
+    {STY, ZERO_PAGE_X},
+    {STA, ZERO_PAGE_X},
+    {STX, ZERO_PAGE_Y},
+    {NOP, IMPLICIT},
+    {TYA, IMPLICIT},
+    {STA, ABSOLUTE_Y},
+    {TXS, IMPLICIT},
+    {NOP, IMPLICIT},
+    {STZ, ABSOLUTE},
+    {STA, ABSOLUTE_X},
+    {STZ, ABSOLUTE_X},
+    {NOP, IMPLICIT},
+
+    /* 0xAX instructions */
+    {LDY, IMMEDIATE},
+    {LDA, INDEXED_INDIRECT},
+    {LDX, IMMEDIATE},
+    {NOP, IMPLICIT},
+    {LDY, ZERO_PAGE},
+    {LDA, ZERO_PAGE},
+    {LDX, ZERO_PAGE},
+    {NOP, IMPLICIT},
+    {TAY, IMPLICIT},
+    {LDA, IMMEDIATE},
+    {TAX, IMPLICIT},
+    {NOP, IMPLICIT},
+    {LDY, ABSOLUTE},
+    {LDA, ABSOLUTE},
+    {LDX, ABSOLUTE},
+    {NOP, IMPLICIT},
+
+    /* 0xBX instructions */
+    {BCS, RELATIVE},
+    {LDA, INDIRECT_INDEXED},
+    {LDA, ZERO_PAGE_INDIRECT},
+    {NOP, IMPLICIT},
+    {LDY, ZERO_PAGE_X},
+    {LDA, ZERO_PAGE_X},
+    {LDX, ZERO_PAGE_Y},
+    {NOP, IMPLICIT},
+    {CLV, IMPLICIT},
+    {LDA, ABSOLUTE_Y},
+    {TSX, IMPLICIT},
+    {NOP, IMPLICIT},
+    {LDY, ABSOLUTE_X},
+    {LDA, ABSOLUTE_X},
+    {LDX, ABSOLUTE_Y},
+    {NOP, IMPLICIT},
+
+    /* 0xCX instructions */
+    {CPY, IMMEDIATE},
+    {CMP, INDEXED_INDIRECT},
+    {NOP, IMMEDIATE},
+    {NOP, IMPLICIT},
+    {CPY, ZERO_PAGE},
+    {CMP, ZERO_PAGE},
+    {DEC, ZERO_PAGE},
+    {NOP, IMPLICIT},
+    {INY, IMPLICIT},
+    {CMP, IMMEDIATE},
+    {DEX, IMPLICIT},
+    {NOP, IMPLICIT},
+    {CPY, ABSOLUTE},
+    {CMP, ABSOLUTE},
+    {DEC, ABSOLUTE},
+    {NOP, IMPLICIT},
+
+    /* 0xDX instructions */
+    {BNE, RELATIVE},
+    {CMP, INDIRECT_INDEXED},
+    {CMP, ZERO_PAGE_INDIRECT},
+    {NOP, IMPLICIT},
+    {NOP, ZERO_PAGE_X},
+    {CMP, ZERO_PAGE_X},
+    {DEC, ZERO_PAGE_X},
+    {NOP, IMPLICIT},
+    {CLD, IMPLICIT},
+    {CMP, ABSOLUTE_Y},
+    {PHX, IMPLICIT},
+    {NOP, IMPLICIT},
+    {NOP, ABSOLUTE},
+    {CMP, ABSOLUTE_X},
+    {DEC, ABSOLUTE_X},
+    {NOP, IMPLICIT},
+
+    /* 0xEX instructions */
+    {CPX, IMMEDIATE},
+    {SBC, INDEXED_INDIRECT},
+    {NOP, IMMEDIATE},
+    {NOP, IMPLICIT},
+    {CPX, ZERO_PAGE},
+    {SBC, ZERO_PAGE},
+    {INC, ZERO_PAGE},
+    {NOP, IMPLICIT},
+    {INX, IMPLICIT},
+    {SBC, IMMEDIATE},
+    {NOP, IMPLICIT},
+    {NOP, IMPLICIT},
+    {CPX, ABSOLUTE},
+    {SBC, ABSOLUTE},
+    {INC, ABSOLUTE},
+    {NOP, IMPLICIT},
+
+    /* 0xFX instructions */
+    {BEQ, RELATIVE},
+    {SBC, INDIRECT_INDEXED},
+    {SBC, ZERO_PAGE_INDIRECT},
+    {NOP, IMPLICIT},
+    {NOP, ZERO_PAGE_X},
+    {SBC, ZERO_PAGE_X},
+    {INC, ZERO_PAGE_X},
+    {NOP, IMPLICIT},
+    {SED, IMPLICIT},
+    {SBC, ABSOLUTE_Y},
+    {PLX, IMPLICIT},
+    {NOP, IMPLICIT},
+    {NOP, ABSOLUTE},
+    {SBC, ABSOLUTE_X},
+    {INC, ABSOLUTE_X},
+    {NOP, IMPLICIT},
+};
+
+/*
+ * Base clock cycles per opcode byte, without the penalties for taken
+ * branches and crossed pages
+ */
+static const uint8_t nmos_cycles[UINT8_MAX + 1] = {
+    /*      0  1  2  3  4  5  6  7  8  9  A  B  C  D  E  F */
+    /* 0 */ 7, 6, 2, 8, 3, 3, 5, 5, 3, 2, 2, 2, 4, 4, 6, 6,
+    /* 1 */ 2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
+    /* 2 */ 6, 6, 2, 8, 3, 3, 5, 5, 4, 2, 2, 2, 4, 4, 6, 6,
+    /* 3 */ 2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
+    /* 4 */ 6, 6, 2, 8, 3, 3, 5, 5, 3, 2, 2, 2, 3, 4, 6, 6,
+    /* 5 */ 2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
+    /* 6 */ 6, 6, 2, 8, 3, 3, 5, 5, 4, 2, 2, 2, 5, 4, 6, 6,
+    /* 7 */ 2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
+    /* 8 */ 2, 6, 2, 6, 3, 3, 3, 3, 2, 2, 2, 2, 4, 4, 4, 4,
+    /* 9 */ 2, 6, 2, 6, 4, 4, 4, 4, 2, 5, 2, 5, 5, 5, 5, 5,
+    /* A */ 2, 6, 2, 6, 3, 3, 3, 3, 2, 2, 2, 2, 4, 4, 4, 4,
+    /* B */ 2, 5, 2, 5, 4, 4, 4, 4, 2, 4, 2, 4, 4, 4, 4, 4,
+    /* C */ 2, 6, 2, 8, 3, 3, 5, 5, 2, 2, 2, 2, 4, 4, 6, 6,
+    /* D */ 2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
+    /* E */ 2, 6, 2, 8, 3, 3, 5, 5, 2, 2, 2, 2, 4, 4, 6, 6,
+    /* F */ 2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
+};
+
+static const uint8_t cmos_cycles[UINT8_MAX + 1] = {
+    /*      0  1  2  3  4  5  6  7  8  9  A  B  C  D  E  F */
+    /* 0 */ 7, 6, 2, 1, 5, 3, 5, 1, 3, 2, 2, 1, 6, 4, 6, 1,
+    /* 1 */ 2, 5, 5, 1, 5, 4, 6, 1, 2, 4, 2, 1, 6, 4, 6, 1,
+    /* 2 */ 6, 6, 2, 1, 3, 3, 5, 1, 4, 2, 2, 1, 4, 4, 6, 1,
+    /* 3 */ 2, 5, 5, 1, 4, 4, 6, 1, 2, 4, 2, 1, 4, 4, 6, 1,
+    /* 4 */ 6, 6, 2, 1, 3, 3, 5, 1, 3, 2, 2, 1, 3, 4, 6, 1,
+    /* 5 */ 2, 5, 5, 1, 4, 4, 6, 1, 2, 4, 3, 1, 8, 4, 6, 1,
+    /* 6 */ 6, 6, 2, 1, 3, 3, 5, 1, 4, 2, 2, 1, 6, 4, 6, 1,
+    /* 7 */ 2, 5, 5, 1, 4, 4, 6, 1, 2, 4, 4, 1, 6, 4, 6, 1,
+    /* 8 */ 2, 6, 2, 1, 3, 3, 3, 1, 2, 2, 2, 1, 4, 4, 4, 1,
+    /* 9 */ 2, 6, 5, 1, 4, 4, 4, 1, 2, 5, 2, 1, 4, 5, 5, 1,
+    /* A */ 2, 6, 2, 1, 3, 3, 3, 1, 2, 2, 2, 1, 4, 4, 4, 1,
+    /* B */ 2, 5, 5, 1, 4, 4, 4, 1, 2, 4, 2, 1, 4, 4, 4, 1,
+    /* C */ 2, 6, 2, 1, 3, 3, 5, 1, 2, 2, 2, 1, 4, 4, 6, 1,
+    /* D */ 2, 5, 5, 1, 4, 4, 6, 1, 2, 4, 3, 1, 4, 4, 7, 1,
+    /* E */ 2, 6, 2, 1, 3, 3, 5, 1, 2, 2, 2, 1, 4, 4, 6, 1,
+    /* F */ 2, 5, 5, 1, 4, 4, 6, 1, 2, 4, 4, 1, 4, 4, 7, 1,
+};
+
+
+static const char opcode_names[OPCODE_SIZE][4] = {"", "adc", "and", "asl", "bcc", "bcs", "beq", "bit",
                                      "bmi", "bne", "bpl", "brk", "bvc", "bvs", "clc",
                                      "cld", "cli", "clv", "cmp", "cpx", "cpy", "dec",
                                      "dex", "dey", "eor", "inc", "inx", "iny", "jmp",
                                      "jsr", "lda", "ldx", "ldy", "lsr", "nop", "ora",
                                      "pha", "php", "pla", "plp", "rol", "ror", "rti",
                                      "rts", "sbc", "sec", "sed", "sei", "sta", "stx",
-                                     "sty", "tax", "tay", "tsx", "txa", "txs", "tya"};
+                                     "sty", "tax", "tay", "tsx", "txa", "txs", "tya",
+                                     "alr", "anc", "ane", "arr", "dcp", "isc", "las",
+                                     "lax", "lxa", "rla", "rra", "sax", "sbx", "sha",
+                                     "shx", "shy", "slo", "sre", "tas", "bra", "phx",
+                                     "phy", "plx", "ply", "stz", "trb", "tsb"};
+
+static const char* const mode_names[ADDRESS_MODE_SIZE] = {
+    [UNDEFINED_MODE] = "undefined",
+    [IMPLICIT] = "implicit",
+    [ACCUMULATOR] = "accumulator",
+    [IMMEDIATE] = "immediate",
+    [ZERO_PAGE] = "zero page",
+    [ZERO_PAGE_X] = "zero page,x",
+    [ZERO_PAGE_Y] = "zero page,y",
+    [RELATIVE] = "relative",
+    [ABSOLUTE] = "absolute",
+    [ABSOLUTE_X] = "absolute,x",
+    [ABSOLUTE_Y] = "absolute,y",
+    [INDIRECT] = "indirect",
+    [INDEXED_INDIRECT] = "(zero page,x)",
+    [INDIRECT_INDEXED] = "(zero page),y",
+    [ZERO_PAGE_INDIRECT] = "(zero page)",
+    [ABSOLUTE_INDEXED_INDIRECT] = "(absolute,x)",
+};
+
+static const uint8_t mode_lengths[ADDRESS_MODE_SIZE] = {
+    [UNDEFINED_MODE] = 1,
+    [IMPLICIT] = 1,
+    [ACCUMULATOR] = 1,
+    [IMMEDIATE] = 2,
+    [ZERO_PAGE] = 2,
+    [ZERO_PAGE_X] = 2,
+    [ZERO_PAGE_Y] = 2,
+    [RELATIVE] = 2,
+    [ABSOLUTE] = 3,
+    [ABSOLUTE_X] = 3,
+    [ABSOLUTE_Y] = 3,
+    [INDIRECT] = 3,
+    [INDEXED_INDIRECT] = 2,
+    [INDIRECT_INDEXED] = 2,
+    [ZERO_PAGE_INDIRECT] = 2,
+    [ABSOLUTE_INDEXED_INDIRECT] = 3,
+};
+
+static const variant_t variants[VARIANT_SIZE] = {
+    [VARIANT_NMOS] = {nmos_opcodes, nmos_cycles, 1, 0},
+    [VARIANT_CMOS] = {cmos_opcodes, cmos_cycles, 1, 1},
+    [VARIANT_RICOH] = {nmos_opcodes, nmos_cycles, 0, 0},
+};
 
 const opcode_t*
 decode_opcode (const uint8_t* byte)
 {
-  return opcodes + *byte;
+  return nmos_opcodes + *byte;
+}
+
+const variant_t*
+get_variant (Variant variant)
+{
+  return &variants[variant];
 }
 
 const char*
@@ -316,3 +706,15 @@ get_opcode_name (const opcode_t* opcode)
 {
   return opcode_names[opcode->code];
 }
+
+const char*
+get_address_mode_name (AddressMode mode)
+{
+  return mode_names[mode];
+}
+
+unsigned int
+get_instruction_length (const opcode_t* opcode)
+{
+  return mode_lengths[opcode->mode];
+}
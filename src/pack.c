@@ -0,0 +1,576 @@
+/**
+ * pack.c
+ *
+ * Implementation of the paged image container.
+ */
+
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "pack.h"
+
+#define PACK_VERSION 1
+
+#define HEADER_SIZE 32
+#define IMAGE_SIZE 48
+#define REF_SIZE 4
+#define INDEX_SIZE 8
+
+#define LITERAL_MAX 0x80
+#define MATCH_MIN 3
+#define MATCH_MAX (0xFF - 0x7D)
+#define MATCH_BIAS 0x7D
+
+#define FNV_OFFSET 0xCBF29CE484222325ULL
+#define FNV_PRIME  0x00000100000001B3ULL
+
+/* Image as a source of pages for the machines it is loaded into */
+typedef struct pack_map_t {
+    pack_t* pack;
+    size_t index;
+    unsigned int first;                   /* Number of its first page */
+} pack_map_t;
+
+struct pack {
+    const uint8_t* base;                  /* Mapped file */
+    size_t size;
+
+    size_t image_count;
+    size_t ref_count;
+    size_t page_count;
+    const uint8_t* images;
+    const uint8_t* refs;
+    const uint8_t* index;
+
+    _Atomic (uint8_t*)* decoded;          /* Decompressed pages, set on first use */
+    pack_map_t* maps;                     /* One per image */
+};
+
+static inline uint16_t
+get_le16 (const uint8_t* src)
+{
+  return src[0] | src[1] << 8;
+}
+
+static inline uint32_t
+get_le32 (const uint8_t* src)
+{
+  return src[0] | src[1] << 8 | src[2] << 16 | (uint32_t) src[3] << 24;
+}
+
+static inline void
+put_le16 (uint8_t* dest, uint16_t value)
+{
+  dest[0] = value;
+  dest[1] = value >> 8;
+}
+
+static inline void
+put_le32 (uint8_t* dest, uint32_t value)
+{
+  put_le16 (dest, value);
+  put_le16 (dest + 2, value >> 16);
+}
+
+/* Number of pages an image covers, counting partial ones */
+static inline size_t
+count_pages (uint16_t load, size_t len)
+{
+  return ((load & 0xFF) + len + PACK_PAGE_SIZE - 1) / PACK_PAGE_SIZE;
+}
+
+static size_t
+encode_literals (const uint8_t* src, size_t len, uint8_t* dest)
+{
+  size_t written = 0;
+
+  while (len > 0) {
+    size_t const chunk = len < LITERAL_MAX ? len : LITERAL_MAX;
+
+    dest[written++] = chunk - 1;
+    memcpy (dest + written, src, chunk);
+    written += chunk;
+    src += chunk;
+    len -= chunk;
+  }
+
+  return written;
+}
+
+size_t
+pack_encode (const uint8_t* page, uint8_t* dest)
+{
+  uint8_t out[2 * PACK_PAGE_SIZE];
+  size_t len = 0;
+  size_t literals = 0;
+  size_t pos = 0;
+
+  while (pos < PACK_PAGE_SIZE && len < PACK_PAGE_SIZE) {
+    size_t best = 0;
+    size_t distance = 0;
+
+    /* Pages are small enough to try every distance */
+    for (size_t dist = 1; dist <= pos; dist++) {
+      size_t match = 0;
+
+      while (match < MATCH_MAX && pos + match < PACK_PAGE_SIZE
+             && page[pos + match] == page[pos + match - dist])
+        match++;
+
+      if (match > best) {
+        best = match;
+        distance = dist;
+      }
+    }
+
+    if (best < MATCH_MIN) {
+      pos++;
+      continue;
+    }
+
+    len += encode_literals (page + literals, pos - literals, out + len);
+    out[len++] = best + MATCH_BIAS;
+    out[len++] = distance - 1;
+    pos += best;
+    literals = pos;
+  }
+
+  if (len < PACK_PAGE_SIZE)
+    len += encode_literals (page + literals, pos - literals, out + len);
+
+  if (len >= PACK_PAGE_SIZE) {
+    memcpy (dest, page, PACK_PAGE_SIZE);
+    return PACK_PAGE_SIZE;
+  }
+
+  memcpy (dest, out, len);
+  return len;
+}
+
+int
+pack_decode (const uint8_t* src, size_t len, uint8_t* page)
+{
+  size_t in = 0;
+  size_t out = 0;
+
+  if (len == PACK_PAGE_SIZE) {
+    memcpy (page, src, PACK_PAGE_SIZE);
+    return 0;
+  }
+
+  while (in < len) {
+    uint8_t const control = src[in++];
+
+    if (control < LITERAL_MAX) {
+      size_t const count = control + 1;
+
+      if (count > len - in || count > PACK_PAGE_SIZE - out)
+        return -1;
+
+      memcpy (page + out, src + in, count);
+      in += count;
+      out += count;
+    } else {
+      size_t const count = control - MATCH_BIAS;
+
+      if (in == len)
+        return -1;
+
+      size_t const distance = src[in++] + 1;
+      if (distance > out || count > PACK_PAGE_SIZE - out)
+        return -1;
+
+      /* Copied a byte at a time, as the match may overlap itself */
+      for (size_t i = 0; i < count; i++, out++)
+        page[out] = page[out - distance];
+    }
+  }
+
+  return out == PACK_PAGE_SIZE ? 0 : -1;
+}
+
+/* Distinct pages collected while writing a pack */
+typedef struct page_set_t {
+    uint8_t (* pages)[PACK_PAGE_SIZE];
+    size_t count;
+    uint32_t* table;                      /* Page index plus one, or 0 if free */
+    size_t mask;
+} page_set_t;
+
+static uint64_t
+hash_page (const uint8_t* page)
+{
+  uint64_t hash = FNV_OFFSET;
+
+  for (size_t i = 0; i < PACK_PAGE_SIZE; i++)
+    hash = (hash ^ page[i]) * FNV_PRIME;
+
+  return hash;
+}
+
+/* Returns the index of a page, adding it if it was not seen before */
+static uint32_t
+add_page (page_set_t* set, const uint8_t* page)
+{
+  size_t slot = hash_page (page) & set->mask;
+
+  while (set->table[slot] != 0) {
+    uint32_t const index = set->table[slot] - 1;
+
+    if (memcmp (set->pages[index], page, PACK_PAGE_SIZE) == 0)
+      return index;
+
+    slot = (slot + 1) & set->mask;
+  }
+
+  memcpy (set->pages[set->count], page, PACK_PAGE_SIZE);
+  set->table[slot] = ++set->count;
+  return set->count - 1;
+}
+
+int
+pack_write (const char* path, const pack_source_t* sources, size_t count)
+{
+  size_t refs = 0;
+  page_set_t set = {NULL, 0, NULL, 0};
+
+  for (size_t i = 0; i < count; i++) {
+    if (sources[i].len > (size_t) EMU2_MEMORY_SIZE - sources[i].load)
+      return -1;
+    refs += count_pages (sources[i].load, sources[i].len);
+  }
+
+  for (set.mask = 1; set.mask < 2 * refs; set.mask <<= 1)
+    ;
+  set.table = calloc (set.mask, sizeof (*set.table));
+  set.pages = malloc ((refs > 0 ? refs : 1) * PACK_PAGE_SIZE);
+  set.mask--;
+
+  uint8_t* table = malloc (HEADER_SIZE + count * IMAGE_SIZE + refs * REF_SIZE);
+  uint8_t* data = malloc ((refs > 0 ? refs : 1) * (PACK_PAGE_SIZE + INDEX_SIZE));
+  FILE* file = NULL;
+  char* temp = NULL;
+  int result = -1;
+
+  if (set.table == NULL || set.pages == NULL || table == NULL || data == NULL)
+    goto done;
+
+  /* Split the images into pages of the address space and drop duplicates */
+  memset (table, 0, HEADER_SIZE + count * IMAGE_SIZE);
+  uint8_t* ref = table + HEADER_SIZE + count * IMAGE_SIZE;
+  size_t first_ref = 0;
+
+  for (size_t i = 0; i < count; i++) {
+    pack_source_t const* source = &sources[i];
+    uint8_t* image = table + HEADER_SIZE + i * IMAGE_SIZE;
+    size_t const pages = count_pages (source->load, source->len);
+    size_t const offset = source->load & 0xFF;
+
+    strncpy ((char*) image, source->name != NULL ? source->name : "", PACK_NAME_SIZE - 1);
+    put_le16 (image + PACK_NAME_SIZE, source->load);
+    put_le32 (image + PACK_NAME_SIZE + 4, source->len);
+    put_le32 (image + PACK_NAME_SIZE + 8, first_ref);
+
+    for (size_t page = 0; page < pages; page++) {
+      uint8_t contents[PACK_PAGE_SIZE] = {0};
+      size_t const start = page == 0 ? offset : 0;
+      size_t const from = page * PACK_PAGE_SIZE + start - offset;
+      size_t const len = source->len - from < PACK_PAGE_SIZE - start
+                         ? source->len - from : PACK_PAGE_SIZE - start;
+
+      memcpy (contents + start, source->data + from, len);
+      put_le32 (ref, add_page (&set, contents));
+      ref += REF_SIZE;
+    }
+    first_ref += pages;
+  }
+
+  memcpy (table, PACK_MAGIC, 8);
+  put_le32 (table + 8, PACK_VERSION);
+  put_le32 (table + 12, count);
+  put_le32 (table + 16, refs);
+  put_le32 (table + 20, set.count);
+
+  /* The index precedes the pages, so its offsets are known up front */
+  size_t const tables = HEADER_SIZE + count * IMAGE_SIZE + refs * REF_SIZE;
+  uint8_t* index = data;
+  uint8_t* pages = data + set.count * INDEX_SIZE;
+  size_t offset = tables + set.count * INDEX_SIZE;
+
+  for (size_t i = 0; i < set.count; i++) {
+    size_t const len = pack_encode (set.pages[i], pages);
+
+    put_le32 (index + i * INDEX_SIZE, offset);
+    put_le16 (index + i * INDEX_SIZE + 4, len);
+    put_le16 (index + i * INDEX_SIZE + 6, 0);
+    pages += len;
+    offset += len;
+  }
+
+  /* Replaces the file as a whole, so a pack mapped by others stays intact */
+  size_t const len = strlen (path) + sizeof (".tmp");
+  temp = malloc (len);
+  if (temp == NULL)
+    goto done;
+
+  snprintf (temp, len, "%s.tmp", path);
+  file = fopen (temp, "wb");
+  if (file != NULL) {
+    int const written = fwrite (table, tables, 1, file) == 1
+                        && fwrite (data, pages - data, 1, file) == 1;
+
+    if (fclose (file) == 0 && written && rename (temp, path) == 0)
+      result = 0;
+    else
+      unlink (temp);
+  }
+
+done:
+  free (temp);
+  free (set.table);
+  free (set.pages);
+  free (table);
+  free (data);
+  return result;
+}
+
+/* Checks that all tables lie within the file and refer to valid entries */
+static int
+validate (const pack_t* pack)
+{
+  for (size_t i = 0; i < pack->image_count; i++) {
+    uint8_t const* image = pack->images + i * IMAGE_SIZE;
+    uint16_t const load = get_le16 (image + PACK_NAME_SIZE);
+    uint32_t const len = get_le32 (image + PACK_NAME_SIZE + 4);
+    uint32_t const first_ref = get_le32 (image + PACK_NAME_SIZE + 8);
+
+    if (len > (uint32_t) EMU2_MEMORY_SIZE - load || first_ref > pack->ref_count
+        || count_pages (load, len) > pack->ref_count - first_ref)
+      return -1;
+  }
+
+  for (size_t i = 0; i < pack->ref_count; i++) {
+    if (get_le32 (pack->refs + i * REF_SIZE) >= pack->page_count)
+      return -1;
+  }
+
+  for (size_t i = 0; i < pack->page_count; i++) {
+    uint32_t const offset = get_le32 (pack->index + i * INDEX_SIZE);
+    uint16_t const len = get_le16 (pack->index + i * INDEX_SIZE + 4);
+
+    if (len == 0 || len > PACK_PAGE_SIZE || offset > pack->size || len > pack->size - offset)
+      return -1;
+  }
+
+  return 0;
+}
+
+pack_t*
+pack_open (const char* path)
+{
+  struct stat st;
+  int const fd = open (path, O_RDONLY);
+
+  if (fd < 0)
+    return NULL;
+
+  if (fstat (fd, &st) != 0 || st.st_size < HEADER_SIZE) {
+    close (fd);
+    return NULL;
+  }
+
+  void* base = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close (fd);
+  if (base == MAP_FAILED)
+    return NULL;
+
+  pack_t* pack = calloc (1, sizeof (*pack));
+  if (pack == NULL) {
+    munmap (base, st.st_size);
+    return NULL;
+  }
+
+  pack->base = base;
+  pack->size = st.st_size;
+  pack->image_count = get_le32 (pack->base + 12);
+  pack->ref_count = get_le32 (pack->base + 16);
+  pack->page_count = get_le32 (pack->base + 20);
+
+  /* Counts are at most 32 bits, so the sizes cannot overflow */
+  uint64_t const tables = HEADER_SIZE + (uint64_t) pack->image_count * IMAGE_SIZE
+                          + (uint64_t) pack->ref_count * REF_SIZE
+                          + (uint64_t) pack->page_count * INDEX_SIZE;
+
+  if (memcmp (pack->base, PACK_MAGIC, 8) != 0 || get_le32 (pack->base + 8) != PACK_VERSION
+      || tables > pack->size)
+    goto fail;
+
+  pack->images = pack->base + HEADER_SIZE;
+  pack->refs = pack->images + pack->image_count * IMAGE_SIZE;
+  pack->index = pack->refs + pack->ref_count * REF_SIZE;
+  if (validate (pack) != 0)
+    goto fail;
+
+  pack->decoded = calloc (pack->page_count > 0 ? pack->page_count : 1, sizeof (*pack->decoded));
+  pack->maps = calloc (pack->image_count > 0 ? pack->image_count : 1, sizeof (*pack->maps));
+  if (pack->decoded == NULL || pack->maps == NULL)
+    goto fail;
+
+  for (size_t i = 0; i < pack->image_count; i++) {
+    pack->maps[i].pack = pack;
+    pack->maps[i].index = i;
+    pack->maps[i].first = get_le16 (pack->images + i * IMAGE_SIZE + PACK_NAME_SIZE) >> 8;
+  }
+
+  return pack;
+
+fail:
+  pack_close (pack);
+  return NULL;
+}
+
+void
+pack_close (pack_t* pack)
+{
+  if (pack == NULL)
+    return;
+
+  if (pack->decoded != NULL) {
+    for (size_t i = 0; i < pack->page_count; i++)
+      free (atomic_load (&pack->decoded[i]));
+  }
+
+  free (pack->decoded);
+  free (pack->maps);
+  munmap ((void*) pack->base, pack->size);
+  free (pack);
+}
+
+size_t
+pack_image_count (const pack_t* pack)
+{
+  return pack->image_count;
+}
+
+void
+pack_get_image (const pack_t* pack, size_t index, pack_image_t* image)
+{
+  uint8_t const* entry = pack->images + index * IMAGE_SIZE;
+
+  memcpy (image->name, entry, PACK_NAME_SIZE - 1);
+  image->name[PACK_NAME_SIZE - 1] = '\0';
+  image->load = get_le16 (entry + PACK_NAME_SIZE);
+  image->len = get_le32 (entry + PACK_NAME_SIZE + 4);
+  image->first_ref = get_le32 (entry + PACK_NAME_SIZE + 8);
+}
+
+long
+pack_find (const pack_t* pack, const char* name)
+{
+  pack_image_t image;
+
+  for (size_t i = 0; i < pack->image_count; i++) {
+    pack_get_image (pack, i, &image);
+    if (strcmp (image.name, name) == 0)
+      return i;
+  }
+
+  return -1;
+}
+
+const uint8_t*
+pack_page (pack_t* pack, size_t index, size_t page)
+{
+  pack_image_t image;
+
+  pack_get_image (pack, index, &image);
+  if (page >= count_pages (image.load, image.len))
+    return NULL;
+
+  uint32_t const distinct = get_le32 (pack->refs + (image.first_ref + page) * REF_SIZE);
+  uint8_t const* entry = pack->index + distinct * INDEX_SIZE;
+  uint8_t const* src = pack->base + get_le32 (entry);
+  uint16_t const len = get_le16 (entry + 4);
+
+  /* Stored pages are used right from the mapped file */
+  if (len == PACK_PAGE_SIZE)
+    return src;
+
+  uint8_t* decoded = atomic_load_explicit (&pack->decoded[distinct], memory_order_acquire);
+  if (decoded != NULL)
+    return decoded;
+
+  decoded = malloc (PACK_PAGE_SIZE);
+  if (decoded == NULL || pack_decode (src, len, decoded) != 0) {
+    free (decoded);
+    return NULL;
+  }
+
+  /* Another thread may have decoded the page meanwhile */
+  uint8_t* expected = NULL;
+  if (!atomic_compare_exchange_strong_explicit (&pack->decoded[distinct], &expected, decoded,
+                                                memory_order_acq_rel, memory_order_acquire)) {
+    free (decoded);
+    return expected;
+  }
+
+  return decoded;
+}
+
+long
+pack_extract (pack_t* pack, size_t index, uint8_t** dest)
+{
+  pack_image_t image;
+
+  pack_get_image (pack, index, &image);
+  *dest = malloc (image.len + 1);
+  if (*dest == NULL)
+    return -1;
+
+  size_t const offset = image.load & 0xFF;
+  size_t const pages = count_pages (image.load, image.len);
+  size_t copied = 0;
+
+  for (size_t page = 0; page < pages; page++) {
+    uint8_t const* contents = pack_page (pack, index, page);
+    size_t const start = page == 0 ? offset : 0;
+    size_t const len = image.len - copied < PACK_PAGE_SIZE - start
+                       ? image.len - copied : PACK_PAGE_SIZE - start;
+
+    if (contents == NULL) {
+      free (*dest);
+      *dest = NULL;
+      return -1;
+    }
+
+    memcpy (*dest + copied, contents + start, len);
+    copied += len;
+  }
+
+  return image.len;
+}
+
+static const uint8_t*
+provide_page (uint8_t page, void* user)
+{
+  pack_map_t const* map = user;
+
+  return pack_page (map->pack, map->index, page - map->first);
+}
+
+emu2_status_t
+pack_map (pack_t* pack, size_t index, emu2_machine_t* machine)
+{
+  pack_image_t image;
+
+  pack_get_image (pack, index, &image);
+  emu2_map_pages (machine, image.load >> 8, count_pages (image.load, image.len),
+                  provide_page, &pack->maps[index]);
+
+  return EMU2_OK;
+}
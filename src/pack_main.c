@@ -0,0 +1,124 @@
+/**
+ * pack_main.c
+ *
+ * Command line tool writing and listing packs of MOS 6502 images.
+ */
+
+#include <libgen.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "file.h"
+#include "pack.h"
+
+static void
+usage (const char* name)
+{
+  fprintf (stderr, "Usage: %s -o PACK [-l LOAD] FILE[@LOAD]...\n"
+                   "       %s -t PACK\n", name, name);
+  exit (EXIT_FAILURE);
+}
+
+static void
+list (const char* filename)
+{
+  pack_t* pack = pack_open (filename);
+
+  if (pack == NULL) {
+    fprintf (stderr, "Could not open pack %s.\n", filename);
+    exit (EXIT_FAILURE);
+  }
+
+  for (size_t i = 0; i < pack_image_count (pack); i++) {
+    pack_image_t image;
+
+    pack_get_image (pack, i, &image);
+    printf ("$%04x  %6u  %s\n", image.load, image.len, image.name);
+  }
+
+  pack_close (pack);
+}
+
+int
+main (int argc, char* argv[])
+{
+  unsigned long load = 0;
+  const char* output = NULL;
+  const char* table = NULL;
+  int opt;
+
+  while ((opt = getopt (argc, argv, "o:l:t:")) != -1) {
+    switch (opt) {
+      case 'o':
+        output = optarg;
+        break;
+      case 'l':
+        load = strtoul (optarg, NULL, 16) & UINT16_MAX;
+        break;
+      case 't':
+        table = optarg;
+        break;
+      default:
+        usage (argv[0]);
+    }
+  }
+
+  if (table != NULL && output == NULL && optind == argc) {
+    list (table);
+    exit (EXIT_SUCCESS);
+  }
+
+  if (table != NULL || output == NULL || optind == argc)
+    usage (argv[0]);
+
+  size_t const count = argc - optind;
+  pack_source_t* sources = calloc (count, sizeof (*sources));
+  char** paths = calloc (count, sizeof (*paths));
+  if (sources == NULL || paths == NULL) {
+    fprintf (stderr, "Could not allocate image table.\n");
+    exit (EXIT_FAILURE);
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    pack_source_t* source = &sources[i];
+    uint8_t* buf;
+
+    paths[i] = strdup (argv[optind + i]);
+    if (paths[i] == NULL) {
+      fprintf (stderr, "Could not allocate image table.\n");
+      exit (EXIT_FAILURE);
+    }
+
+    /* A load address after the name overrides the one given with -l */
+    char* at = strrchr (paths[i], '@');
+    source->load = load;
+    if (at != NULL) {
+      *at = '\0';
+      source->load = strtoul (at + 1, NULL, 16) & UINT16_MAX;
+    }
+
+    source->len = read_file (paths[i], &buf);
+    source->data = buf;
+    if (source->len > (size_t) EMU2_MEMORY_SIZE - source->load) {
+      fprintf (stderr, "Image %s does not fit in memory at $%04x.\n", paths[i], source->load);
+      exit (EXIT_FAILURE);
+    }
+
+    source->name = basename (paths[i]);
+  }
+
+  if (pack_write (output, sources, count) != 0) {
+    fprintf (stderr, "Could not write pack %s.\n", output);
+    exit (EXIT_FAILURE);
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    free ((void*) sources[i].data);
+    free (paths[i]);
+  }
+  free (sources);
+  free (paths);
+
+  exit (EXIT_SUCCESS);
+}
@@ -0,0 +1,275 @@
+/**
+ * replay.c
+ */
+
+#include <string.h>
+#include "machine.h"
+#include "replay.h"
+
+#define INITIAL_CAPACITY 4096
+#define VARINT_MAX 10
+
+static int
+reserve (emu2_machine_t* machine, size_t extra)
+{
+  replay_t* replay = &machine->replay;
+
+  if (replay->len + extra <= replay->capacity)
+    return 0;
+
+  size_t capacity = replay->capacity > 0 ? replay->capacity * 2 : INITIAL_CAPACITY;
+  uint8_t* buf = machine->allocator.alloc (capacity, machine->allocator.user);
+
+  if (buf == NULL)
+    return -1;
+
+  if (replay->buf != NULL) {
+    memcpy (buf, replay->buf, replay->len);
+    machine->allocator.free (replay->buf, machine->allocator.user);
+  }
+
+  replay->buf = buf;
+  replay->capacity = capacity;
+  return 0;
+}
+
+static int
+read_varint (const replay_t* replay, size_t* pos, uint64_t* value)
+{
+  unsigned int shift = 0;
+
+  *value = 0;
+  while (*pos < replay->size && shift < 64) {
+    uint8_t byte = replay->log[(*pos)++];
+
+    *value |= (uint64_t) (byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0)
+      return 0;
+
+    shift += 7;
+  }
+
+  return -1;
+}
+
+/*
+ * Advances the cursor past the next record of the wanted kind, that is an I/O
+ * read or an interrupt record, and returns its kind or -1 at the end of the
+ * log. The cursor keeps track of the cycles of all records it skips.
+ */
+static int
+next_record (const replay_t* replay, replay_cursor_t* cursor, int want_io,
+             uint8_t* value)
+{
+  uint64_t header;
+
+  while (cursor->pos < replay->size) {
+    if (read_varint (replay, &cursor->pos, &header) < 0)
+      return -1;
+
+    cursor->cycle += header >> 2;
+
+    if ((header & 3) != RECORD_IO_READ) {
+      if (!want_io)
+        return header & 3;
+    } else if (cursor->pos >= replay->size) {
+      return -1;
+    } else {
+      uint8_t byte = replay->log[cursor->pos++];
+
+      if (want_io) {
+        *value = byte;
+        return RECORD_IO_READ;
+      }
+    }
+  }
+
+  return -1;
+}
+
+static void
+load_next_event (replay_t* replay)
+{
+  int kind = next_record (replay, &replay->event, 0, NULL);
+
+  if (kind < 0) {
+    replay->next_event = UINT64_MAX;
+  } else {
+    replay->pending = kind;
+    replay->next_event = replay->event.cycle;
+  }
+}
+
+/* Hands the machine back to its devices once the log is used up */
+static void
+finish_if_exhausted (replay_t* replay)
+{
+  if (replay->next_event == UINT64_MAX && replay->io.pos >= replay->size)
+    replay->mode = REPLAY_OFF;
+}
+
+void
+replay_append (emu2_machine_t* machine, replay_kind_t kind, uint8_t value)
+{
+  replay_t* replay = &machine->replay;
+
+  if (replay->failed || reserve (machine, VARINT_MAX + 1) < 0) {
+    replay->failed = 1;
+    return;
+  }
+
+  uint64_t header = (machine->cycles - replay->last_cycle) << 2 | kind;
+  replay->last_cycle = machine->cycles;
+
+  while (header >= 0x80) {
+    replay->buf[replay->len++] = (uint8_t) header | 0x80;
+    header >>= 7;
+  }
+  replay->buf[replay->len++] = (uint8_t) header;
+
+  if (kind == RECORD_IO_READ)
+    replay->buf[replay->len++] = value;
+}
+
+void
+replay_interrupt (emu2_machine_t* machine, replay_kind_t kind)
+{
+  replay_t* replay = &machine->replay;
+
+  if (replay->in_access) {
+    replay->deferred = 1;
+    if (kind == RECORD_NMI)
+      replay->deferred_nmi = 1;
+    return;
+  }
+
+  replay_append (machine, kind, 0);
+  if (kind != RECORD_NMI)
+    replay->logged_irq = kind == RECORD_IRQ_ASSERT;
+}
+
+void
+replay_flush (emu2_machine_t* machine)
+{
+  replay_t* replay = &machine->replay;
+
+  if (!replay->deferred)
+    return;
+
+  /* A line asserted and released within one access never reaches the CPU */
+  replay->deferred = 0;
+  if (machine->cpu.irq != replay->logged_irq)
+    replay_interrupt (machine, machine->cpu.irq ? RECORD_IRQ_ASSERT : RECORD_IRQ_RELEASE);
+
+  if (replay->deferred_nmi) {
+    replay->deferred_nmi = 0;
+    replay_interrupt (machine, RECORD_NMI);
+  }
+}
+
+uint8_t
+replay_io_read (emu2_machine_t* machine, uint16_t addr)
+{
+  replay_t* replay = &machine->replay;
+  uint8_t value;
+
+  if (next_record (replay, &replay->io, 1, &value) < 0) {
+    replay->io.pos = replay->size;
+    finish_if_exhausted (replay);
+    return device_read (machine, addr);
+  }
+
+  /* I/O reads happen while the cycle counter is at the instruction start */
+  if (replay->io.cycle != machine->cycles)
+    replay->diverged = 1;
+
+  return value;
+}
+
+void
+replay_events (emu2_machine_t* machine)
+{
+  replay_t* replay = &machine->replay;
+
+  while (replay->next_event <= machine->cycles) {
+    if (replay->next_event != machine->cycles)
+      replay->diverged = 1;
+
+    switch (replay->pending) {
+      case RECORD_IRQ_ASSERT:
+        machine->cpu.irq = 1;
+        break;
+      case RECORD_IRQ_RELEASE:
+        machine->cpu.irq = 0;
+        break;
+      case RECORD_NMI:
+        machine->cpu.nmi = 1;
+        break;
+      default:
+        break;
+    }
+
+    load_next_event (replay);
+  }
+
+  finish_if_exhausted (replay);
+}
+
+void
+replay_free (emu2_machine_t* machine)
+{
+  if (machine->replay.buf != NULL)
+    machine->allocator.free (machine->replay.buf, machine->allocator.user);
+
+  machine->replay.buf = NULL;
+  machine->replay.len = machine->replay.capacity = 0;
+}
+
+emu2_status_t
+emu2_record_start (emu2_machine_t* machine)
+{
+  replay_t* replay = &machine->replay;
+
+  replay->len = 0;
+  replay->failed = 0;
+  replay->last_cycle = machine->cycles;
+  replay->deferred = replay->deferred_nmi = 0;
+  replay->logged_irq = machine->cpu.irq;
+
+  if (reserve (machine, INITIAL_CAPACITY) < 0)
+    return EMU2_NOMEM;
+
+  replay->mode = REPLAY_RECORD;
+  return EMU2_OK;
+}
+
+void
+emu2_replay_start (emu2_machine_t* machine, const uint8_t* log, size_t len)
+{
+  replay_t* replay = &machine->replay;
+
+  replay->mode = REPLAY_PLAY;
+  replay->log = log;
+  replay->size = len;
+  replay->io.pos = replay->event.pos = 0;
+  replay->io.cycle = replay->event.cycle = machine->cycles;
+  replay->diverged = 0;
+
+  load_next_event (replay);
+}
+
+void
+emu2_replay_stop (emu2_machine_t* machine)
+{
+  machine->replay.mode = REPLAY_OFF;
+}
+
+const uint8_t*
+emu2_get_log (const emu2_machine_t* machine, size_t* len)
+{
+  if (machine->replay.failed)
+    return NULL;
+
+  *len = machine->replay.len;
+  return machine->replay.buf;
+}
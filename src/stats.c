@@ -0,0 +1,131 @@
+/**
+ * stats.c
+ *
+ * Implementation of the opcode frequency statistics.
+ */
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include "opcode.h"
+#include "stats.h"
+
+#define MAX_LENGTH 3
+
+typedef struct entry_t {
+    uint64_t count;
+    unsigned int index;
+} entry_t;
+
+void
+stats_count (stats_t* stats, const uint8_t* buf, size_t size)
+{
+  uint8_t lengths[256];
+  size_t pc = 0;
+
+  for (unsigned int byte = 0; byte < 256; byte++) {
+    uint8_t const code = byte;
+    lengths[byte] = get_instruction_length (decode_opcode (&code));
+  }
+
+  while (pc < size) {
+    stats->bytes[buf[pc]]++;
+    pc += lengths[buf[pc]];
+  }
+
+  stats->files++;
+  stats->size += size;
+}
+
+void
+stats_merge (stats_t* dest, const stats_t* src)
+{
+  for (unsigned int byte = 0; byte < 256; byte++)
+    dest->bytes[byte] += src->bytes[byte];
+
+  dest->files += src->files;
+  dest->size += src->size;
+}
+
+static int
+compare_entries (const void* a, const void* b)
+{
+  entry_t const* x = a;
+  entry_t const* y = b;
+
+  if (x->count != y->count)
+    return x->count < y->count ? 1 : -1;
+
+  return x->index < y->index ? -1 : x->index > y->index;
+}
+
+static void
+print_count (uint64_t count, uint64_t total, FILE* dest)
+{
+  fprintf (dest, "%14" PRIu64 "  %6.2f%%\n", count, total > 0 ? 100.0 * count / total : 0.0);
+}
+
+void
+stats_print (const stats_t* stats, FILE* dest)
+{
+  entry_t opcodes[OPCODE_SIZE] = {{0, 0}};
+  entry_t modes[ADDRESS_MODE_SIZE] = {{0, 0}};
+  entry_t bytes[256];
+  uint64_t lengths[MAX_LENGTH + 1] = {0};
+  uint64_t total = 0;
+
+  for (unsigned int i = 0; i < OPCODE_SIZE; i++)
+    opcodes[i].index = i;
+  for (unsigned int i = 0; i < ADDRESS_MODE_SIZE; i++)
+    modes[i].index = i;
+
+  for (unsigned int byte = 0; byte < 256; byte++) {
+    uint8_t const code = byte;
+    opcode_t const* op = decode_opcode (&code);
+    uint64_t const count = stats->bytes[byte];
+
+    bytes[byte].count = count;
+    bytes[byte].index = byte;
+    opcodes[op->code].count += count;
+    modes[op->mode].count += count;
+    lengths[get_instruction_length (op)] += count;
+    total += count;
+  }
+
+  qsort (opcodes, OPCODE_SIZE, sizeof (entry_t), compare_entries);
+  qsort (modes, ADDRESS_MODE_SIZE, sizeof (entry_t), compare_entries);
+  qsort (bytes, 256, sizeof (entry_t), compare_entries);
+
+  fprintf (dest, "Files: %" PRIu64 "  Bytes: %" PRIu64 "  Instructions: %" PRIu64 "\n",
+           stats->files, stats->size, total);
+
+  fprintf (dest, "\nOp codes:\n");
+  for (unsigned int i = 0; i < OPCODE_SIZE && opcodes[i].count > 0; i++) {
+    opcode_t const op = {opcodes[i].index, IMPLICIT};
+    char const* name = get_opcode_name (&op);
+
+    fprintf (dest, "  %-22s", *name != '\0' ? name : "undefined");
+    print_count (opcodes[i].count, total, dest);
+  }
+
+  fprintf (dest, "\nAddress modes:\n");
+  for (unsigned int i = 0; i < ADDRESS_MODE_SIZE && modes[i].count > 0; i++) {
+    fprintf (dest, "  %-22s", get_address_mode_name (modes[i].index));
+    print_count (modes[i].count, total, dest);
+  }
+
+  fprintf (dest, "\nOpcode bytes:\n");
+  for (unsigned int i = 0; i < 256 && bytes[i].count > 0; i++) {
+    uint8_t const code[MAX_LENGTH] = {bytes[i].index, 0, 0};
+    opcode_t const* op = decode_opcode (code);
+
+    fprintf (dest, "  $%02x  %-3s %-13s", code[0], get_opcode_name (op),
+             get_address_mode_name (op->mode));
+    print_count (bytes[i].count, total, dest);
+  }
+
+  fprintf (dest, "\nInstruction lengths:\n");
+  for (unsigned int length = 1; length <= MAX_LENGTH; length++) {
+    fprintf (dest, "  %-22u", length);
+    print_count (lengths[length], total, dest);
+  }
+}
@@ -0,0 +1,217 @@
+/**
+ * system.c
+ *
+ * Cooperative scheduling of several machines sharing memory pages. Shared
+ * pages are mapped as I/O pages in every machine, so the fast path of each
+ * CPU stays untouched and only accesses to them reach the scheduler.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "emu2.h"
+#include "machine.h"
+
+/* CPU of a system, passed to the I/O handlers of its machine */
+typedef struct system_cpu_t {
+    emu2_system_t* system;
+    emu2_machine_t* machine;
+    emu2_io_t io;                         /* Handlers of the machine itself */
+    uint8_t waiting;                      /* Non-zero while others catch up */
+    uint8_t stalled;                      /* Non-zero if it stalled catching up */
+} system_cpu_t;
+
+struct emu2_system {
+    emu2_allocator_t allocator;
+    uint64_t quantum;                     /* Cycles a CPU runs when scheduled */
+    uint8_t shared_pages[PAGE_COUNT];     /* Non-zero for pages shared by all */
+    size_t count;
+    system_cpu_t cpus[];
+};
+
+static void*
+default_alloc (size_t size, void* user)
+{
+  (void) user;
+  return malloc (size);
+}
+
+static void
+default_free (void* ptr, void* user)
+{
+  (void) user;
+  free (ptr);
+}
+
+/* Orders CPUs by their clocks, and CPUs on the same cycle by their index */
+static inline int
+is_behind (const system_cpu_t* cpu, const system_cpu_t* other)
+{
+  return cpu->machine->cycles < other->machine->cycles
+         || (cpu->machine->cycles == other->machine->cycles && cpu < other);
+}
+
+/**
+ * Steps every CPU behind the specified one up to its clock, always the one
+ * furthest behind first. Any shared access made on the way is then made by
+ * the CPU furthest behind, which never has to wait itself.
+ */
+static void
+synchronize (system_cpu_t* cpu)
+{
+  emu2_system_t* system = cpu->system;
+
+  cpu->waiting = 1;
+  for (;;) {
+    system_cpu_t* next = NULL;
+
+    for (size_t i = 0; i < system->count; i++) {
+      system_cpu_t* other = &system->cpus[i];
+
+      if (!other->waiting && !other->stalled && is_behind (other, cpu)
+          && (next == NULL || is_behind (other, next)))
+        next = other;
+    }
+
+    if (next == NULL)
+      break;
+
+    if (emu2_step (next->machine) == EMU2_STALLED)
+      next->stalled = 1;
+  }
+  cpu->waiting = 0;
+}
+
+static uint8_t
+system_io_read (uint16_t addr, void* user)
+{
+  system_cpu_t* cpu = user;
+
+  if (cpu->system->shared_pages[addr >> 8]) {
+    synchronize (cpu);
+    return bus_peek (&cpu->machine->bus, addr);
+  }
+
+  return cpu->io.read != NULL ? cpu->io.read (addr, cpu->io.user) : 0xFF;
+}
+
+static void
+system_io_write (uint16_t addr, uint8_t value, void* user)
+{
+  system_cpu_t* cpu = user;
+  emu2_system_t* system = cpu->system;
+
+  if (system->shared_pages[addr >> 8]) {
+    synchronize (cpu);
+    for (size_t i = 0; i < system->count; i++)
+      bus_poke (&system->cpus[i].machine->bus, addr, value);
+  } else if (cpu->io.write != NULL) {
+    cpu->io.write (addr, value, cpu->io.user);
+  }
+}
+
+emu2_system_t*
+emu2_system_create (const emu2_allocator_t* allocator, emu2_machine_t* const* machines,
+                    size_t count, uint64_t quantum)
+{
+  emu2_allocator_t const fallback = {default_alloc, default_free, NULL};
+
+  if (allocator == NULL)
+    allocator = &fallback;
+
+  size_t const size = sizeof (emu2_system_t) + count * sizeof (system_cpu_t);
+  emu2_system_t* system = allocator->alloc (size, allocator->user);
+  if (system == NULL)
+    return NULL;
+
+  memset (system, 0, size);
+  system->allocator = *allocator;
+  system->quantum = quantum > 0 ? quantum : 1;
+  system->count = count;
+
+  for (size_t i = 0; i < count; i++) {
+    system_cpu_t* cpu = &system->cpus[i];
+    emu2_io_t const io = {system_io_read, system_io_write, cpu};
+
+    cpu->system = system;
+    cpu->machine = machines[i];
+    cpu->io = machines[i]->io;
+    emu2_set_io (machines[i], &io);
+  }
+
+  return system;
+}
+
+void
+emu2_system_destroy (emu2_system_t* system)
+{
+  if (system == NULL)
+    return;
+
+  for (size_t i = 0; i < system->count; i++)
+    emu2_set_io (system->cpus[i].machine, &system->cpus[i].io);
+
+  system->allocator.free (system, system->allocator.user);
+}
+
+void
+emu2_system_share (emu2_system_t* system, uint16_t first, uint16_t last)
+{
+  for (unsigned int page = first >> 8; page <= last >> 8; page++) {
+    system->shared_pages[page] = 1;
+
+    for (size_t i = 0; i < system->count; i++) {
+      emu2_machine_t* machine = system->cpus[i].machine;
+
+      emu2_map_io (machine, page << 8, page << 8 | 0xFF);
+      if (i > 0)
+        emu2_write_block (machine, page << 8, bus_page (&system->cpus[0].machine->bus, page),
+                          BUS_PAGE_SIZE);
+    }
+  }
+}
+
+emu2_status_t
+emu2_system_run (emu2_system_t* system, uint64_t cycles, size_t* stopped)
+{
+  uint64_t until = UINT64_MAX;
+
+  for (size_t i = 0; i < system->count; i++) {
+    system->cpus[i].stalled = 0;
+    if (system->cpus[i].machine->cycles < until)
+      until = system->cpus[i].machine->cycles;
+  }
+  until = cycles > UINT64_MAX - until ? UINT64_MAX : until + cycles;
+
+  /* Resume the CPU furthest behind until all have reached the limit */
+  for (;;) {
+    system_cpu_t* next = NULL;
+    size_t index = 0;
+
+    for (size_t i = 0; i < system->count; i++) {
+      system_cpu_t* cpu = &system->cpus[i];
+
+      if (cpu->stalled) {
+        if (stopped != NULL)
+          *stopped = i;
+        return EMU2_STALLED;
+      }
+
+      if (cpu->machine->cycles < until && (next == NULL || is_behind (cpu, next))) {
+        next = cpu;
+        index = i;
+      }
+    }
+
+    if (next == NULL)
+      return EMU2_OK;
+
+    uint64_t const left = until - next->machine->cycles;
+    emu2_status_t const status = emu2_run (next->machine, left < system->quantum
+                                                          ? left : system->quantum);
+    if (status != EMU2_OK) {
+      if (stopped != NULL)
+        *stopped = index;
+      return status;
+    }
+  }
+}
@@ -0,0 +1,175 @@
+/**
+ * decimal_test.c
+ *
+ * Checks ADC and SBC in decimal mode for every accumulator, operand and
+ * carry against reference models of the NMOS 6502 and the 65C02, in the
+ * fast and the cycle-exact core, and that the 2A03 stays binary.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "emu2.h"
+
+#define FLAG_CARRY    0x01
+#define FLAG_ZERO     0x02
+#define FLAG_DECIMAL  0x08
+#define FLAG_OVERFLOW 0x40
+#define FLAG_NEGATIVE 0x80
+
+#define OPCODE_ADC_IMMEDIATE 0x69
+#define OPCODE_SBC_IMMEDIATE 0xE9
+
+typedef struct result_t {
+    uint8_t acc;
+    uint8_t flags;                        /* N, V, Z and C only */
+} result_t;
+
+/* Binary ADC, SBC being ADC of the complemented operand */
+static result_t
+add_binary (unsigned int a, unsigned int b, unsigned int carry)
+{
+  unsigned int const sum = a + b + carry;
+  uint8_t const flags = (sum & 0x80 ? FLAG_NEGATIVE : 0)
+                        | ((~(a ^ b) & (a ^ sum) & 0x80) != 0 ? FLAG_OVERFLOW : 0)
+                        | ((sum & 0xFF) == 0 ? FLAG_ZERO : 0)
+                        | (sum > 0xFF ? FLAG_CARRY : 0);
+
+  result_t const result = {sum & 0xFF, flags};
+  return result;
+}
+
+/*
+ * Decimal ADC of the NMOS 6502 as described in the 6502.org decimal mode
+ * tutorial: N and V come from the sum before the high nibble is adjusted,
+ * Z from the binary sum
+ */
+static result_t
+add_decimal (unsigned int a, unsigned int b, unsigned int carry)
+{
+  int low = (a & 0x0F) + (b & 0x0F) + carry;
+
+  if (low >= 0x0A)
+    low = ((low + 0x06) & 0x0F) + 0x10;
+
+  int sum = (a & 0xF0) + (b & 0xF0) + low;
+  uint8_t flags = (sum & 0x80 ? FLAG_NEGATIVE : 0)
+                  | ((~(a ^ b) & (a ^ sum) & 0x80) != 0 ? FLAG_OVERFLOW : 0)
+                  | (((a + b + carry) & 0xFF) == 0 ? FLAG_ZERO : 0);
+
+  if (sum >= 0xA0)
+    sum += 0x60;
+  if (sum >= 0x100)
+    flags |= FLAG_CARRY;
+
+  result_t const result = {sum & 0xFF, flags};
+  return result;
+}
+
+/* Decimal SBC of the NMOS 6502, whose flags all follow the binary result */
+static result_t
+subtract_decimal (unsigned int a, unsigned int b, unsigned int carry)
+{
+  int low = (a & 0x0F) - (b & 0x0F) + (int) carry - 1;
+
+  if (low < 0)
+    low = ((low - 0x06) & 0x0F) - 0x10;
+
+  int difference = (a & 0xF0) - (b & 0xF0) + low;
+  if (difference < 0)
+    difference -= 0x60;
+
+  result_t const result = {difference & 0xFF, add_binary (a, b ^ 0xFF, carry).flags};
+  return result;
+}
+
+/*
+ * Decimal SBC of the 65C02, which corrects the whole binary difference, by
+ * $60 if it borrows and by a further $06 if the low nibble borrows
+ */
+static result_t
+subtract_decimal_cmos (unsigned int a, unsigned int b, unsigned int carry)
+{
+  int const low = (a & 0x0F) - (b & 0x0F) + (int) carry - 1;
+  int difference = (int) a - (int) b + (int) carry - 1;
+
+  if (difference < 0)
+    difference -= 0x60;
+  if (low < 0)
+    difference -= 0x06;
+
+  result_t const result = {difference & 0xFF, add_binary (a, b ^ 0xFF, carry).flags};
+  return result;
+}
+
+static int
+check_variant (emu2_variant_t variant, int exact)
+{
+  emu2_machine_t* machine = emu2_create_variant (NULL, variant);
+  long failures = 0;
+
+  if (machine == NULL || emu2_set_cycle_exact (machine, exact) != EMU2_OK) {
+    emu2_destroy (machine);
+    return 0;
+  }
+
+  for (unsigned int subtract = 0; subtract <= 1; subtract++) {
+    for (unsigned int carry = 0; carry <= 1; carry++) {
+      for (unsigned int a = 0; a < 0x100; a++) {
+        for (unsigned int b = 0; b < 0x100; b++) {
+          uint8_t const code[] = {subtract ? OPCODE_SBC_IMMEDIATE : OPCODE_ADC_IMMEDIATE, b};
+          emu2_regs_t regs = {a, 0, 0, 0xFF, FLAG_DECIMAL | carry, 0x0200};
+          result_t expected;
+          unsigned int extra = 0;
+
+          if (variant == EMU2_RICOH_2A03) {
+            expected = add_binary (a, subtract ? b ^ 0xFF : b, carry);
+          } else if (variant == EMU2_CMOS_65C02 && subtract) {
+            expected = subtract_decimal_cmos (a, b, carry);
+          } else {
+            expected = subtract ? subtract_decimal (a, b, carry) : add_decimal (a, b, carry);
+          }
+
+          /* The 65C02 spends a cycle on setting N and Z from the result */
+          if (variant == EMU2_CMOS_65C02) {
+            expected.flags &= ~(FLAG_NEGATIVE | FLAG_ZERO);
+            expected.flags |= (expected.acc & 0x80 ? FLAG_NEGATIVE : 0)
+                              | (expected.acc == 0 ? FLAG_ZERO : 0);
+            extra = 1;
+          }
+
+          emu2_write_block (machine, 0x0200, code, sizeof (code));
+          emu2_set_regs (machine, &regs);
+          uint64_t const start = emu2_get_cycles (machine);
+          emu2_status_t const status = emu2_step (machine);
+          emu2_get_regs (machine, &regs);
+
+          uint8_t const mask = FLAG_NEGATIVE | FLAG_OVERFLOW | FLAG_ZERO | FLAG_CARRY;
+          if (status != EMU2_OK || regs.a != expected.acc || (regs.p & mask) != expected.flags
+              || emu2_get_cycles (machine) - start != 2 + extra) {
+            if (failures++ < 5)
+              fprintf (stderr, "variant %d exact %d: %s $%02x,$%02x carry %u gave $%02x p=$%02x, "
+                       "expected $%02x flags $%02x\n", variant, exact, subtract ? "SBC" : "ADC",
+                       a, b, carry, regs.a, regs.p, expected.acc, expected.flags);
+          }
+        }
+      }
+    }
+  }
+
+  emu2_destroy (machine);
+  return failures > 0;
+}
+
+int
+main (void)
+{
+  int failed = 0;
+
+  for (int exact = 0; exact <= 1; exact++) {
+    failed |= check_variant (EMU2_NMOS_6502, exact);
+    failed |= check_variant (EMU2_RICOH_2A03, exact);
+  }
+  failed |= check_variant (EMU2_CMOS_65C02, 0);
+
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,194 @@
+/**
+ * equivalence_test.c
+ *
+ * Runs random programs on every variant in the default core one instruction
+ * at a time, through the fused run loop and in the cycle-exact core, and
+ * checks that all of them end up in the same state after the same number of
+ * cycles.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "emu2.h"
+
+#define PROGRAMS 1000
+#define PROGRAM_START 0x0200
+#define PROGRAM_END 0x02F0
+#define MAX_CYCLES 4000
+
+typedef struct pattern_t {
+    uint8_t length;
+    uint8_t code[5];                      /* Zero operands are randomised */
+} pattern_t;
+
+/* Sequences the fused core recognises, along with single instructions */
+static const pattern_t patterns[] = {
+    {3, {0x18, 0x69, 0x00}},              /* CLC; ADC #imm */
+    {4, {0xA9, 0x00, 0x85, 0x00}},        /* LDA #imm; STA zp */
+    {5, {0xA5, 0x00, 0x8D, 0x00, 0x00}},  /* LDA zp; STA abs */
+    {5, {0xAD, 0x00, 0x00, 0x85, 0x00}},  /* LDA abs; STA zp */
+    {5, {0xE8, 0xE0, 0x00, 0xD0, 0x00}},  /* INX; CPX #imm; BNE */
+    {3, {0x88, 0xD0, 0x00}},              /* DEY; BNE */
+    {1, {0xEA}},                          /* NOP */
+    {1, {0xCA}},                          /* DEX */
+    {1, {0x38}},                          /* SEC */
+    {1, {0xF8}},                          /* SED */
+    {1, {0xD8}},                          /* CLD */
+    {1, {0xAA}},                          /* TAX */
+};
+
+static uint32_t seed = 1;
+
+static uint8_t
+random_byte (void)
+{
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return seed >> 24;
+}
+
+/*
+ * Fills memory with noise and puts a program of random sequences at $0200,
+ * looping back to its start, whose stores stay clear of the program itself
+ */
+static void
+generate (uint8_t* mem)
+{
+  uint16_t addr = PROGRAM_START;
+
+  for (size_t i = 0; i < EMU2_MEMORY_SIZE; i++)
+    mem[i] = random_byte ();
+
+  while (addr < PROGRAM_END) {
+    pattern_t const* pattern = &patterns[random_byte () % (sizeof (patterns) / sizeof (patterns[0]))];
+
+    for (int i = 0; i < pattern->length; i++)
+      mem[addr + i] = pattern->code[i] != 0 || i == 0 ? pattern->code[i] : random_byte ();
+
+    /* Branches mostly loop back a little way */
+    if (pattern->code[0] == 0xE8 || pattern->code[0] == 0x88) {
+      uint8_t const offset = random_byte ();
+      mem[addr + pattern->length - 1] = offset & 1 ? (uint8_t) -(offset % 20) : offset % 8;
+    }
+
+    if (pattern->code[0] == 0xA5 && (mem[addr + 4] == 0x02 || mem[addr + 4] == 0x03))
+      mem[addr + 4] = 0x10;
+
+    addr += pattern->length;
+  }
+
+  while (addr < 0x0300)
+    mem[addr++] = 0xEA;
+
+  mem[0x0300] = 0x4C;
+  mem[0x0301] = PROGRAM_START & 0xFF;
+  mem[0x0302] = PROGRAM_START >> 8;
+}
+
+static emu2_machine_t*
+create (emu2_variant_t variant, const uint8_t* mem, const emu2_regs_t* regs)
+{
+  emu2_machine_t* machine = emu2_create_variant (NULL, variant);
+
+  if (machine != NULL) {
+    emu2_write_block (machine, 0, mem, EMU2_MEMORY_SIZE);
+    emu2_set_regs (machine, regs);
+  }
+
+  return machine;
+}
+
+static int
+same (emu2_machine_t* machine, const emu2_snapshot_t* expected, emu2_status_t status,
+      emu2_status_t expected_status, const char* core, emu2_variant_t variant, int program)
+{
+  static emu2_snapshot_t actual;
+
+  emu2_save (machine, &actual);
+  if (status == expected_status && actual.cycles == expected->cycles
+      && memcmp (&actual.regs, &expected->regs, sizeof (actual.regs)) == 0
+      && memcmp (actual.mem, expected->mem, EMU2_MEMORY_SIZE) == 0)
+    return 1;
+
+  fprintf (stderr, "variant %d program %d: %s core gave status %d at $%04x after %llu cycles, "
+           "expected %d at $%04x after %llu\n", variant, program, core, status, actual.regs.pc,
+           (unsigned long long) actual.cycles, expected_status, expected->regs.pc,
+           (unsigned long long) expected->cycles);
+  return 0;
+}
+
+static int
+check_program (emu2_variant_t variant, int program)
+{
+  static uint8_t mem[EMU2_MEMORY_SIZE];
+  static emu2_snapshot_t expected, paused;
+  emu2_status_t status = EMU2_OK;
+  int passed = 1;
+
+  generate (mem);
+
+  emu2_regs_t const regs = {
+    random_byte (), random_byte (), random_byte (), 0xFD,
+    (random_byte () & 0xCB) | (random_byte () & 0x08) | 0x04, PROGRAM_START
+  };
+  uint64_t const cycles = 1 + (random_byte () << 8 | random_byte ()) % MAX_CYCLES;
+
+  emu2_machine_t* stepped = create (variant, mem, &regs);
+  emu2_machine_t* fused = create (variant, mem, &regs);
+  emu2_machine_t* exact = create (variant, mem, &regs);
+  emu2_machine_t* resumed = create (variant, mem, &regs);
+  if (stepped == NULL || fused == NULL || exact == NULL || resumed == NULL) {
+    passed = 0;
+    goto done;
+  }
+
+  /* Whole instructions one at a time are the reference */
+  while (status == EMU2_OK && emu2_get_cycles (stepped) < cycles)
+    status = emu2_step (stepped);
+  emu2_save (stepped, &expected);
+
+  passed &= same (fused, &expected, emu2_run (fused, cycles), status, "fused", variant, program);
+
+  /*
+   * Cycle-exact runs stop mid-instruction, and switching back completes it,
+   * also in another machine restored from a snapshot taken there
+   */
+  if (emu2_set_cycle_exact (exact, 1) == EMU2_OK) {
+    emu2_status_t exact_status = emu2_run (exact, cycles);
+    emu2_save (exact, &paused);
+    if (exact_status == EMU2_OK) {
+      exact_status = emu2_set_cycle_exact (exact, 0);
+
+      emu2_set_cycle_exact (resumed, 1);
+      emu2_restore (resumed, &paused);
+      passed &= same (resumed, &expected, emu2_set_cycle_exact (resumed, 0), status, "restored cycle-exact",
+                      variant, program);
+    }
+    passed &= same (exact, &expected, exact_status, status, "cycle-exact", variant, program);
+  }
+
+done:
+  emu2_destroy (stepped);
+  emu2_destroy (fused);
+  emu2_destroy (exact);
+  emu2_destroy (resumed);
+  return passed;
+}
+
+int
+main (void)
+{
+  static const emu2_variant_t variants[] = {EMU2_NMOS_6502, EMU2_CMOS_65C02, EMU2_RICOH_2A03};
+  int failures = 0;
+
+  for (size_t v = 0; v < sizeof (variants) / sizeof (variants[0]); v++) {
+    for (int program = 0; program < PROGRAMS; program++) {
+      if (!check_program (variants[v], program) && ++failures >= 10)
+        return EXIT_FAILURE;
+    }
+  }
+
+  return failures > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
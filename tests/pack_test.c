@@ -0,0 +1,274 @@
+/**
+ * pack_test.c
+ *
+ * Writes a pack of images with partial, shared and incompressible pages,
+ * checks that every image reads back the same when extracted and when
+ * mapped into a machine, and that truncated and corrupt packs are refused.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "pack.h"
+
+#define IMAGE_COUNT 5
+
+static uint8_t program[0x0A00];
+static uint8_t noise[0x0300];
+static uint8_t zeros[0x0400];
+static uint8_t top[0x80];
+
+static const pack_source_t sources[IMAGE_COUNT] = {
+    {"program", 0x0234, program, sizeof (program)},
+    {"again", 0x1234, program, sizeof (program)},
+    {"noise", 0x8000, noise, sizeof (noise)},
+    {"zeros", 0xC000, zeros, sizeof (zeros)},
+    {"top", 0xFF80, top, sizeof (top)},
+};
+
+static int
+write_file (const char* path, const uint8_t* data, size_t len)
+{
+  FILE* file = fopen (path, "wb");
+
+  if (file == NULL)
+    return -1;
+
+  int const written = len == 0 || fwrite (data, len, 1, file) == 1;
+  return fclose (file) == 0 && written ? 0 : -1;
+}
+
+static uint8_t*
+read_pack (const char* path, size_t* len)
+{
+  FILE* file = fopen (path, "rb");
+  uint8_t* data = NULL;
+
+  if (file != NULL) {
+    fseek (file, 0L, SEEK_END);
+    *len = ftell (file);
+    fseek (file, 0L, SEEK_SET);
+
+    data = malloc (*len);
+    if (data != NULL && fread (data, *len, 1, file) != 1) {
+      free (data);
+      data = NULL;
+    }
+    fclose (file);
+  }
+
+  return data;
+}
+
+static int
+check_image (pack_t* pack, size_t index)
+{
+  pack_source_t const* source = &sources[index];
+  pack_image_t image;
+  uint8_t* extracted;
+  static uint8_t mapped[EMU2_MEMORY_SIZE];
+
+  pack_get_image (pack, index, &image);
+  if (strcmp (image.name, source->name) != 0 || image.load != source->load
+      || image.len != source->len || pack_find (pack, source->name) != (long) index) {
+    fprintf (stderr, "image %s: table entry differs\n", source->name);
+    return 0;
+  }
+
+  long const len = pack_extract (pack, index, &extracted);
+  int const same = len == (long) source->len && memcmp (extracted, source->data, len) == 0;
+  free (extracted);
+  if (!same) {
+    fprintf (stderr, "image %s: extracted contents differ\n", source->name);
+    return 0;
+  }
+
+  emu2_machine_t* machine = emu2_create (NULL);
+  if (machine == NULL || pack_map (pack, index, machine) != EMU2_OK) {
+    emu2_destroy (machine);
+    return 0;
+  }
+  emu2_read_block (machine, source->load, mapped, source->len);
+  emu2_destroy (machine);
+
+  if (memcmp (mapped, source->data, source->len) != 0) {
+    fprintf (stderr, "image %s: mapped contents differ\n", source->name);
+    return 0;
+  }
+
+  return 1;
+}
+
+static int
+round_trip (const char* path)
+{
+  pack_t* pack = pack_open (path);
+  int passed = 1;
+
+  if (pack == NULL || pack_image_count (pack) != IMAGE_COUNT) {
+    fprintf (stderr, "pack could not be opened\n");
+    pack_close (pack);
+    return 0;
+  }
+
+  for (size_t i = 0; i < IMAGE_COUNT; i++)
+    passed &= check_image (pack, i);
+
+  if (pack_find (pack, "missing") != -1)
+    passed = 0;
+
+  pack_close (pack);
+  return passed;
+}
+
+static uint32_t
+get_le32 (const uint8_t* src)
+{
+  return src[0] | src[1] << 8 | src[2] << 16 | (uint32_t) src[3] << 24;
+}
+
+/* Every truncation cuts into the pages, which lie at the end of the file */
+static int
+truncated (const char* damaged, const uint8_t* data, size_t len)
+{
+  for (size_t cut = 0; cut < len; cut++) {
+    pack_t* pack;
+
+    if (write_file (damaged, data, cut) != 0)
+      return 0;
+
+    if ((pack = pack_open (damaged)) != NULL) {
+      fprintf (stderr, "pack truncated to %zu bytes was opened\n", cut);
+      pack_close (pack);
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+/*
+ * Makes the first token of a compressed page a match, which has nothing to
+ * copy from, so exactly the images using that page fail to extract
+ */
+static int
+corrupt_page (const char* damaged, uint8_t* data, size_t len)
+{
+  uint32_t const refs = get_le32 (data + 16);
+  uint32_t const pages = get_le32 (data + 20);
+  uint8_t const* ref = data + 32 + IMAGE_COUNT * 48;
+  uint8_t const* index = ref + refs * 4;
+  uint32_t page = 0;
+
+  while (page < pages && (index[page * 8 + 4] | index[page * 8 + 5] << 8) == PACK_PAGE_SIZE)
+    page++;
+  if (page == pages)
+    return 0;
+
+  uint8_t* token = data + get_le32 (index + page * 8);
+  uint8_t const saved = *token;
+  *token = 0xFF;
+  int const written = write_file (damaged, data, len);
+  *token = saved;
+
+  pack_t* pack = pack_open (damaged);
+  if (written != 0 || pack == NULL) {
+    fprintf (stderr, "pack with a corrupt page could not be opened\n");
+    pack_close (pack);
+    return 0;
+  }
+
+  int passed = 1;
+  int users = 0;
+  for (size_t i = 0; i < IMAGE_COUNT; i++) {
+    pack_image_t image;
+    uint8_t* extracted;
+    int uses = 0;
+
+    pack_get_image (pack, i, &image);
+    size_t const count = ((image.load & 0xFF) + image.len + PACK_PAGE_SIZE - 1) / PACK_PAGE_SIZE;
+    for (size_t j = 0; j < count; j++) {
+      if (get_le32 (ref + (image.first_ref + j) * 4) == page) {
+        uses = 1;
+        if (pack_page (pack, i, j) != NULL)
+          passed = 0;
+      }
+    }
+
+    long const extracted_len = pack_extract (pack, i, &extracted);
+    free (extracted);
+    if ((extracted_len < 0) != uses) {
+      fprintf (stderr, "image %s: extraction with a corrupt page returned %ld\n",
+               image.name, extracted_len);
+      passed = 0;
+    }
+    users += uses;
+  }
+
+  pack_close (pack);
+  return passed && users > 0;
+}
+
+/* A reference to a page beyond the index is refused on opening */
+static int
+corrupt_table (const char* damaged, uint8_t* data, size_t len)
+{
+  uint8_t* ref = data + 32 + IMAGE_COUNT * 48;
+  uint8_t saved[4];
+
+  memcpy (saved, ref, sizeof (saved));
+  memcpy (ref, data + 20, sizeof (saved));
+  int const written = write_file (damaged, data, len);
+  memcpy (ref, saved, sizeof (saved));
+
+  pack_t* pack = pack_open (damaged);
+  if (written != 0 || pack != NULL) {
+    fprintf (stderr, "pack with a corrupt reference was opened\n");
+    pack_close (pack);
+    return 0;
+  }
+
+  return 1;
+}
+
+int
+main (void)
+{
+  char path[] = "/tmp/pack_testXXXXXX";
+  char damaged[sizeof (path) + 8];
+  int passed = 1;
+  uint32_t seed = 1;
+
+  for (size_t i = 0; i < sizeof (program); i++)
+    program[i] = i % 7 == 0 ? 0xEA : (uint8_t) (i / 3);
+  for (size_t i = 0; i < sizeof (noise); i++) {
+    seed = seed * 1103515245 + 12345;
+    noise[i] = seed >> 16;
+  }
+  for (size_t i = 0; i < sizeof (top); i++)
+    top[i] = 0xFF - i;
+
+  int const fd = mkstemp (path);
+  if (fd < 0)
+    return EXIT_FAILURE;
+  close (fd);
+  snprintf (damaged, sizeof (damaged), "%s.bad", path);
+
+  size_t len;
+  uint8_t* data = NULL;
+  if (pack_write (path, sources, IMAGE_COUNT) != 0 || (data = read_pack (path, &len)) == NULL) {
+    fprintf (stderr, "pack could not be written\n");
+    passed = 0;
+  } else {
+    passed &= round_trip (path);
+    passed &= truncated (damaged, data, len);
+    passed &= corrupt_page (damaged, data, len);
+    passed &= corrupt_table (damaged, data, len);
+  }
+
+  free (data);
+  unlink (path);
+  unlink (damaged);
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
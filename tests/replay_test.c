@@ -0,0 +1,155 @@
+/**
+ * replay_test.c
+ *
+ * Records a program driven by interrupts that a device raises and clears
+ * from within its access handlers, and checks that replaying the log from
+ * the same snapshot reproduces the run exactly, in both cores.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "emu2.h"
+
+#define RUN_CYCLES 1000000
+#define DEVICE_FIRST 0xD000
+#define DEVICE_LAST 0xD0FF
+
+/* Writes to $D000 assert IRQ, reads of $D002 clear it, writes to $D003 raise NMI */
+typedef struct device_t {
+    emu2_machine_t* machine;
+    uint8_t count;                        /* Value of the next read */
+} device_t;
+
+static const uint8_t program[] = {
+    0x58,                                 /* $0200  CLI */
+    0xA9, 0x01,                           /* $0201  LDA #$01 */
+    0x8D, 0x00, 0xD0,                     /* $0203  STA $D000 */
+    0xE8,                                 /* $0206  INX */
+    0xD0, 0xFD,                           /* $0207  BNE $0206 */
+    0x8D, 0x00, 0xD0,                     /* $0209  STA $D000 */
+    0xC8,                                 /* $020C  INY */
+    0xD0, 0xF7,                           /* $020D  BNE $0206 */
+    0x8D, 0x03, 0xD0,                     /* $020F  STA $D003 */
+    0x4C, 0x06, 0x02,                     /* $0212  JMP $0206 */
+};
+
+static const uint8_t irq_handler[] = {
+    0x48,                                 /* $0300  PHA */
+    0xAD, 0x02, 0xD0,                     /* $0301  LDA $D002 */
+    0x85, 0x10,                           /* $0304  STA $10 */
+    0xE6, 0x11,                           /* $0306  INC $11 */
+    0x68,                                 /* $0308  PLA */
+    0x40,                                 /* $0309  RTI */
+};
+
+static const uint8_t nmi_handler[] = {
+    0xE6, 0x12,                           /* $0320  INC $12 */
+    0x40,                                 /* $0322  RTI */
+};
+
+static const uint8_t vectors[] = {0x20, 0x03, 0x00, 0x02, 0x00, 0x03};
+
+static uint8_t
+device_read (uint16_t addr, void* user)
+{
+  device_t* device = user;
+
+  if (addr == 0xD002)
+    emu2_set_irq (device->machine, 0);
+
+  return device->count++;
+}
+
+static void
+device_write (uint16_t addr, uint8_t value, void* user)
+{
+  device_t* device = user;
+
+  (void) value;
+  if (addr == 0xD000)
+    emu2_set_irq (device->machine, 1);
+  else if (addr == 0xD003)
+    emu2_nmi (device->machine);
+}
+
+static emu2_machine_t*
+create (device_t* device, int exact)
+{
+  emu2_machine_t* machine = emu2_create (NULL);
+
+  if (machine == NULL)
+    return NULL;
+
+  emu2_io_t const io = {device_read, device_write, device};
+  device->machine = machine;
+  device->count = 0;
+  emu2_set_io (machine, &io);
+  emu2_map_io (machine, DEVICE_FIRST, DEVICE_LAST);
+  emu2_set_cycle_exact (machine, exact);
+
+  return machine;
+}
+
+static int
+round_trip (int exact)
+{
+  static emu2_snapshot_t start, recorded, replayed;
+  device_t devices[2];
+  size_t len;
+  int failed = 1;
+
+  emu2_machine_t* recorder = create (&devices[0], exact);
+  emu2_machine_t* player = create (&devices[1], exact);
+  if (recorder == NULL || player == NULL)
+    goto done;
+
+  emu2_write_block (recorder, 0x0200, program, sizeof (program));
+  emu2_write_block (recorder, 0x0300, irq_handler, sizeof (irq_handler));
+  emu2_write_block (recorder, 0x0320, nmi_handler, sizeof (nmi_handler));
+  emu2_write_block (recorder, 0xFFFA, vectors, sizeof (vectors));
+  emu2_reset (recorder);
+  emu2_save (recorder, &start);
+
+  if (emu2_record_start (recorder) != EMU2_OK
+      || emu2_run (recorder, RUN_CYCLES) != EMU2_OK)
+    goto done;
+  emu2_save (recorder, &recorded);
+
+  uint8_t const* log = emu2_get_log (recorder, &len);
+  if (log == NULL || recorded.mem[0x11] == 0 || recorded.mem[0x12] == 0) {
+    fprintf (stderr, "exact=%d: no interrupts were recorded\n", exact);
+    goto done;
+  }
+
+  emu2_restore (player, &start);
+  emu2_replay_start (player, log, len);
+  emu2_status_t const status = emu2_run (player, RUN_CYCLES);
+  emu2_save (player, &replayed);
+
+  if (status != EMU2_OK) {
+    fprintf (stderr, "exact=%d: replay returned status %d\n", exact, status);
+  } else if (memcmp (&recorded.regs, &replayed.regs, sizeof (recorded.regs)) != 0
+             || recorded.cycles != replayed.cycles
+             || memcmp (recorded.mem, replayed.mem, EMU2_MEMORY_SIZE) != 0) {
+    fprintf (stderr, "exact=%d: replay differs from recording\n", exact);
+  } else {
+    failed = 0;
+  }
+
+done:
+  emu2_destroy (recorder);
+  emu2_destroy (player);
+  return failed;
+}
+
+int
+main (void)
+{
+  int failed = 0;
+
+  for (int exact = 0; exact <= 1; exact++)
+    failed |= round_trip (exact);
+
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}